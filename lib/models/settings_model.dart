@@ -9,6 +9,7 @@ class SettingsModel extends ChangeNotifier {
   static const String _legacyResolutionScaleKey = 'resolution_scale_percent';
   static const String _outputResolutionHeightKey = 'output_resolution_height';
   static const String _audioDeviceKey = 'audio_device';
+  static const String _variableFrameRateKey = 'variable_frame_rate';
 
   int _fps = 60;
   bool _audioEnabled = true;
@@ -17,6 +18,7 @@ class SettingsModel extends ChangeNotifier {
   int _displayHeight = 1080;
   int _outputResolutionHeight = 0; // 0 means native.
   String _audioDevice = 'auto';
+  bool _variableFrameRate = false;
   late final Future<void> ready;
 
   int get fps => _fps;
@@ -26,6 +28,7 @@ class SettingsModel extends ChangeNotifier {
   int get displayHeight => _displayHeight;
   int get outputResolutionHeight => _outputResolutionHeight;
   String get audioDevice => _audioDevice;
+  bool get variableFrameRate => _variableFrameRate;
 
   List<int> get availableResolutionHeights {
     const knownHeights = <int>[2160, 1080, 720, 480];
@@ -88,6 +91,7 @@ class SettingsModel extends ChangeNotifier {
       }
     }
     _audioDevice = prefs.getString(_audioDeviceKey) ?? 'auto';
+    _variableFrameRate = prefs.getBool(_variableFrameRateKey) ?? false;
     _normalizeOutputResolutionHeight();
     notifyListeners();
   }
@@ -128,6 +132,13 @@ class SettingsModel extends ChangeNotifier {
     notifyListeners();
   }
 
+  Future<void> updateVariableFrameRate(bool value) async {
+    _variableFrameRate = value;
+    final prefs = await SharedPreferences.getInstance();
+    await prefs.setBool(_variableFrameRateKey, value);
+    notifyListeners();
+  }
+
   void updateDisplayResolution(int width, int height) {
     if (width <= 0 || height <= 0) {
       return;
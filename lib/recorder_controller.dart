@@ -1,23 +1,96 @@
+import 'dart:async';
+
 import 'package:flutter/foundation.dart';
 
 import 'recorder_service.dart';
 
 class RecorderController extends ChangeNotifier {
-  RecorderController(this._service);
+  RecorderController(this._service) {
+    _finalizeSubscription = _service.finalizeEvents.listen(_onFinalizeEvent);
+    _stateSubscription = _service.stateEvents.listen(_onStateEvent);
+    _metricsSubscription = _service.metrics.listen(_onMetrics);
+  }
 
   final RecorderService _service;
+  late final StreamSubscription<Map<String, dynamic>> _finalizeSubscription;
+  late final StreamSubscription<Map<String, dynamic>> _stateSubscription;
+  late final StreamSubscription<Map<String, dynamic>> _metricsSubscription;
+  final StreamController<Map<String, dynamic>> _finalized =
+      StreamController<Map<String, dynamic>>.broadcast();
+  int _finalizing = 0;
 
   String _state = 'idle';
   String _message = '';
   bool _isRecording = false;
   bool _isBusy = false;
   String _error = '';
+  Map<String, int> _portalTimingsUs = const <String, int>{};
+  int _timeToRecordingUs = 0;
+  Map<String, dynamic> _metrics = const <String, dynamic>{};
+  bool _portalRestored = false;
 
   String get state => _state;
   String get message => _message;
   bool get isRecording => _isRecording;
   bool get isBusy => _isBusy;
   String get error => _error;
+  int get finalizing => _finalizing;
+
+  /// How long each portal step of the last successful start took.
+  Map<String, int> get portalTimingsUs => _portalTimingsUs;
+
+  /// Time from the start request until capture ran, for the last start.
+  int get timeToRecordingUs => _timeToRecordingUs;
+
+  /// Whether the last start reused a stored portal grant.
+  bool get portalRestored => _portalRestored;
+
+  /// Latest metrics snapshot pushed by the running recording.
+  Map<String, dynamic> get metrics => _metrics;
+
+  /// Recordings whose files were closed, with 'stage' 'complete' or 'failed'.
+  Stream<Map<String, dynamic>> get finalized => _finalized.stream;
+
+  void _onFinalizeEvent(Map<String, dynamic> event) {
+    final stage = event['stage'];
+    if (stage == 'finalizing') {
+      _finalizing++;
+    } else {
+      _finalizing = _finalizing > 0 ? _finalizing - 1 : 0;
+      _finalized.add(event);
+    }
+    notifyListeners();
+  }
+
+  void _onStateEvent(Map<String, dynamic> event) {
+    _state = event['state'] ?? 'unknown';
+    _message = event['message'] ?? '';
+    _isRecording = _state == 'recording';
+    if (_state == 'starting') {
+      _metrics = const <String, dynamic>{};
+    }
+    final timings = event['portalTimingsUs'];
+    if (_isRecording && timings is Map) {
+      _portalTimingsUs = Map<String, int>.from(timings);
+      _timeToRecordingUs = event['timeToRecordingUs'] ?? 0;
+      _portalRestored = event['portalRestored'] ?? false;
+    }
+    notifyListeners();
+  }
+
+  void _onMetrics(Map<String, dynamic> metrics) {
+    _metrics = metrics;
+    notifyListeners();
+  }
+
+  @override
+  void dispose() {
+    _finalizeSubscription.cancel();
+    _stateSubscription.cancel();
+    _metricsSubscription.cancel();
+    _finalized.close();
+    super.dispose();
+  }
 
   Future<void> start({
     required String path,
@@ -25,6 +98,8 @@ class RecorderController extends ChangeNotifier {
     bool audio = false,
     String audioDevice = 'default',
     int outputHeight = 0,
+    bool variableFrameRate = false,
+    String encoder = 'ffmpeg',
   }) async {
     try {
       _isBusy = true;
@@ -37,10 +112,11 @@ class RecorderController extends ChangeNotifier {
         audio: audio,
         audioDevice: audioDevice,
         outputHeight: outputHeight,
+        variableFrameRate: variableFrameRate,
+        encoder: encoder,
       );
       
       _isRecording = true;
-      await refreshStatus();
     } catch (e) {
       _error = e.toString();
       rethrow;
@@ -58,7 +134,6 @@ class RecorderController extends ChangeNotifier {
 
       await _service.stopRecording();
       _isRecording = false;
-      await refreshStatus();
     } catch (e) {
       _error = e.toString();
       rethrow;
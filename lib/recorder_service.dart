@@ -1,14 +1,99 @@
+import 'dart:async';
+
 import 'package:flutter/services.dart';
 
 class RecorderService {
+  RecorderService() {
+    _events.receiveBroadcastStream().listen(_onEvent);
+  }
+
   static const MethodChannel _channel = MethodChannel('screen_recorder');
+  static const EventChannel _events = EventChannel('screen_recorder/events');
+
+  final StreamController<Map<String, dynamic>> _finalizeEvents =
+      StreamController<Map<String, dynamic>>.broadcast();
+
+  /// Progress of stopped recordings: {'path', 'stage', 'error'} where stage is
+  /// 'finalizing', then 'complete' or 'failed' once the file is closed. Traced
+  /// recordings also carry 'tracePath' once the trace file is written, or
+  /// 'traceError' when no trace could be taken, e.g. because an earlier
+  /// recording was still being traced.
+  Stream<Map<String, dynamic>> get finalizeEvents => _finalizeEvents.stream;
+
+  final StreamController<Map<String, dynamic>> _stateEvents =
+      StreamController<Map<String, dynamic>>.broadcast();
+
+  /// Recorder state changes: {'state', 'message', 'portalTimingsUs',
+  /// 'timeToRecordingUs', 'portalRestored'}. The switch to 'recording' maps
+  /// each portal step to its duration and tells whether a stored grant was
+  /// reused. With autotuneEncoder, 'tuning' comes between 'starting' and
+  /// 'recording' while encoder presets are measured.
+  Stream<Map<String, dynamic>> get stateEvents => _stateEvents.stream;
+
+  final StreamController<Map<String, dynamic>> _metrics =
+      StreamController<Map<String, dynamic>>.broadcast();
+
+  /// Snapshots of the running recording, at most four a second: frame
+  /// counters, writer queue depth and copy, callback interval and pipe write
+  /// percentiles in nanoseconds. The ffmpeg encoder adds its own progress:
+  /// 'encoderSpeed' (below 1.0 it is falling behind), 'encoderFps',
+  /// 'encoderBitrateKbps', 'encoderOutTimeUs' and 'encoderDupFrames' /
+  /// 'encoderDropFrames'.
+  Stream<Map<String, dynamic>> get metrics => _metrics.stream;
+
+  void _onEvent(dynamic event) {
+    if (event is! Map) {
+      return;
+    }
+    final map = Map<String, dynamic>.from(event);
+    switch (map['type']) {
+      case 'state':
+        _stateEvents.add(map);
+        break;
+      case 'finalize':
+        _finalizeEvents.add(map);
+        break;
+      case 'metrics':
+        _metrics.add(map);
+        break;
+    }
+  }
 
+  /// Completes once the user has picked a screen and capture is running (after
+  /// any encoder tuning), or throws if the portal fails or the start is
+  /// canceled by [stopRecording].
   Future<void> startRecording({
     required String path,
     int fps = 60,
     bool audio = false,
     String audioDevice = 'default',
     int outputHeight = 0,
+    bool variableFrameRate = false,
+    String encoder = 'ffmpeg',
+    // A built-in profile name ('realtime', 'balanced', 'quality', 'hevc',
+    // 'av1', 'vp9', 'lossless') or a map overriding fields of one.
+    Object encoderProfile = 'realtime',
+    bool autotuneEncoder = false,
+    // 'mp4', or 'fmp4' / 'mkv' to keep the file playable if recording is
+    // interrupted, losing at most one fragment.
+    String container = 'mp4',
+    int fragmentDurationMs = 2000,
+    // Memory for the instant replay ring (libav encoder only); 0 disables it.
+    int replayBufferMb = 0,
+    // Extra renditions of the same capture, e.g.
+    // {'path': ..., 'outputHeight': 720, 'encoderProfile': 'balanced'}.
+    List<Map<String, Object>> outputs = const <Map<String, Object>>[],
+    // Remembers the portal grant under this key, normally one per monitor,
+    // so the next start with it skips the share dialog. '' always asks.
+    String portalRestoreKey = 'default',
+    // Writes a Chrome trace (chrome://tracing, ui.perfetto.dev) of the capture
+    // pipeline here when the recording ends. Null leaves tracing off unless
+    // SCREEN_RECORDER_TRACE names a file.
+    String? tracePath,
+    // Writes per-second frame, drop and A/V offset counters to
+    // '<path>.timing.jsonl', and likewise next to each extra output; summarize
+    // them with the timing_report tool.
+    bool timingSidecar = true,
   }) async {
     await _channel.invokeMethod<void>('startRecording', <String, dynamic>{
       'path': path,
@@ -16,13 +101,36 @@ class RecorderService {
       'audio': audio,
       'audioDevice': audioDevice,
       'outputHeight': outputHeight,
+      'variableFrameRate': variableFrameRate,
+      'encoder': encoder,
+      'encoderProfile': encoderProfile,
+      'autotuneEncoder': autotuneEncoder,
+      'container': container,
+      'fragmentDurationMs': fragmentDurationMs,
+      'replayBufferMb': replayBufferMb,
+      'outputs': outputs,
+      'portalRestoreKey': portalRestoreKey,
+      if (tracePath != null) 'tracePath': tracePath,
+      'timingSidecar': timingSidecar,
     });
   }
 
+  /// Returns once capture has stopped; the file is finished in the background
+  /// and reported on [finalizeEvents].
   Future<void> stopRecording() async {
     await _channel.invokeMethod<void>('stopRecording');
   }
 
+  /// Writes the last [seconds] of the running recording to [path] without
+  /// interrupting it.
+  Future<void> saveReplay({required String path, int seconds = 30}) async {
+    await _channel.invokeMethod<void>('saveReplay', <String, dynamic>{
+      'path': path,
+      'seconds': seconds,
+    });
+  }
+
+  /// One-off query; [stateEvents] reports every change after that.
   Future<Map<String, dynamic>> getStatus() async {
     final dynamic result = await _channel.invokeMethod<dynamic>('getStatus');
     if (result is Map) {
@@ -31,6 +139,18 @@ class RecorderService {
     return <String, dynamic>{'state': 'unknown', 'message': 'Invalid status response'};
   }
 
+  /// Counters and latency percentiles of the running recording:
+  /// {'capture': {...}, 'outputs': [{...}, ...]}, primary output first.
+  /// Latencies are maps of count/min/mean/p50/p90/p99/p999/max in
+  /// nanoseconds. Throws when nothing is recording.
+  Future<Map<String, dynamic>> getStats() async {
+    final dynamic result = await _channel.invokeMethod<dynamic>('getStats');
+    if (result is Map) {
+      return Map<String, dynamic>.from(result);
+    }
+    return <String, dynamic>{};
+  }
+
   Future<String> getRecommendedAudioDevice() async {
     final dynamic result = await _channel.invokeMethod<dynamic>('getRecommendedAudioDevice');
     if (result is String && result.trim().isNotEmpty) {
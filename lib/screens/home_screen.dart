@@ -1,3 +1,4 @@
+import 'dart:async';
 import 'dart:io';
 import 'package:flutter/material.dart';
 import 'package:provider/provider.dart';
@@ -19,10 +20,30 @@ class _HomeScreenState extends State<HomeScreen> {
 
   String _twoDigits(int n) => n.toString().padLeft(2, '0');
 
+  StreamSubscription<Map<String, dynamic>>? _finalizedSubscription;
+
   @override
   void initState() {
     super.initState();
     _isInitialized = true; // Now handled by RecorderApp
+    _finalizedSubscription = Provider.of<RecorderController>(context, listen: false)
+        .finalized
+        .listen(_onRecordingFinalized);
+  }
+
+  @override
+  void dispose() {
+    _finalizedSubscription?.cancel();
+    super.dispose();
+  }
+
+  void _onRecordingFinalized(Map<String, dynamic> event) {
+    if (!mounted) return;
+    final file = path.basename('${event['path'] ?? ''}');
+    final text = event['stage'] == 'complete'
+        ? 'Recording saved: $file'
+        : 'Saving $file failed: ${event['error'] ?? ''}';
+    ScaffoldMessenger.of(context).showSnackBar(SnackBar(content: Text(text)));
   }
 
   @override
@@ -257,6 +278,7 @@ class _HomeScreenState extends State<HomeScreen> {
         audio: settings.audioEnabled,
         audioDevice: settings.audioDevice,
         outputHeight: settings.outputResolutionHeight,
+        variableFrameRate: settings.variableFrameRate,
       );
 
       if (!mounted) return;
@@ -281,7 +303,7 @@ class _HomeScreenState extends State<HomeScreen> {
       await controller.stop();
       if (!mounted) return;
       ScaffoldMessenger.of(this.context).showSnackBar(
-        const SnackBar(content: Text('Recording saved')),
+        const SnackBar(content: Text('Recording stopped, saving in background')),
       );
     } catch (e) {
       if (!mounted) return;
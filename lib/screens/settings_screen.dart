@@ -154,6 +154,15 @@ class _SettingsScreenState extends State<SettingsScreen> {
                               color: settings.audioEnabled ? Colors.green : Colors.grey,
                             ),
                           ),
+                          SwitchListTile(
+                            title: const Text('Variable Frame Rate'),
+                            subtitle: const Text('Encode only frames that changed on screen'),
+                            value: settings.variableFrameRate,
+                            onChanged: (value) {
+                              settings.updateVariableFrameRate(value);
+                            },
+                            secondary: const Icon(Icons.speed),
+                          ),
                           DropdownButtonFormField<int>(
                             initialValue: _outputResolutionHeight,
                             decoration: InputDecoration(
@@ -0,0 +1,425 @@
+// Headless end-to-end benchmark of the capture frame path. Synthetic buffers
+// shaped like the compositor's go through PipeWireCapture exactly as
+// OnProcess hands them over, so conversion, damage handling, pacing and the
+// writer queues are all measured without a portal or a PipeWire daemon.
+//
+//   capture_bench --width 2560 --height 1440 --fps 60 --seconds 10
+//   capture_bench --matrix --encoder ffmpeg
+
+#include "pipewire_capture.h"
+#include "recording_options.h"
+
+#include <pipewire/pipewire.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/video/raw.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Distinct images the source cycles through, like a compositor's buffer pool.
+constexpr int kSourceBuffers = 4;
+
+struct BenchConfig {
+  int width = 1920;
+  int height = 1080;
+  uint32_t fps = 60;
+  double seconds = 5.0;
+  // Extra bytes at the end of every source row.
+  int stride_padding = 0;
+  // Negative chunk stride: the first row in memory is the bottom one.
+  bool bottom_up = false;
+  // Fraction of frames whose content changes; the rest carry empty damage.
+  double change_rate = 1.0;
+  // Every |stall_every| frames the source goes quiet for |stall_ms|.
+  uint32_t stall_every = 0;
+  uint32_t stall_ms = 0;
+  EncoderBackend encoder = EncoderBackend::kNull;
+  FrameFormat frame_format = FrameFormat::kI420;
+  bool variable_frame_rate = false;
+  std::string output_path = "/tmp/capture_bench.mp4";
+};
+
+struct BenchResult {
+  uint64_t submitted = 0;
+  uint64_t changed = 0;
+  uint64_t stalls = 0;
+  double elapsed_seconds = 0;
+  PipeWireCapture::Stats capture;
+  EncoderWorker::Stats worker;
+};
+
+// One synthetic stream buffer: a single MemPtr data block plus the header and
+// damage metadata OnProcess looks at.
+struct SourceBuffer {
+  std::vector<uint8_t> pixels;
+  struct spa_chunk chunk {};
+  struct spa_data data {};
+  struct spa_meta_header header {};
+  struct spa_meta_region damage {};
+  struct spa_meta metas[2] {};
+  struct spa_buffer buffer {};
+  struct pw_buffer pw {};
+};
+
+void FillSource(SourceBuffer* source, const BenchConfig& config, int index) {
+  const int row_bytes = config.width * 4 + config.stride_padding;
+  source->pixels.assign(static_cast<size_t>(row_bytes) * config.height, 0);
+  for (int y = 0; y < config.height; ++y) {
+    // Stored bottom-up, memory row 0 holds image row height - 1.
+    const int image_row = config.bottom_up ? config.height - 1 - y : y;
+    uint8_t* row = source->pixels.data() + static_cast<size_t>(y) * row_bytes;
+    for (int x = 0; x < config.width; ++x) {
+      uint8_t* pixel = row + static_cast<size_t>(x) * 4;
+      pixel[0] = static_cast<uint8_t>(x + index * 40);
+      pixel[1] = static_cast<uint8_t>(image_row + index * 40);
+      pixel[2] = static_cast<uint8_t>((x ^ image_row) + index * 40);
+      pixel[3] = 0xff;
+    }
+  }
+
+  source->chunk.offset = 0;
+  source->chunk.size = static_cast<uint32_t>(source->pixels.size());
+  source->chunk.stride = config.bottom_up ? -row_bytes : row_bytes;
+  source->data.type = SPA_DATA_MemPtr;
+  source->data.fd = -1;
+  source->data.maxsize = static_cast<uint32_t>(source->pixels.size());
+  source->data.data = source->pixels.data();
+  source->data.chunk = &source->chunk;
+
+  source->metas[0].type = SPA_META_Header;
+  source->metas[0].size = sizeof(source->header);
+  source->metas[0].data = &source->header;
+  source->metas[1].type = SPA_META_VideoDamage;
+  source->metas[1].size = sizeof(source->damage);
+  source->metas[1].data = &source->damage;
+
+  source->buffer.n_metas = 2;
+  source->buffer.metas = source->metas;
+  source->buffer.n_datas = 1;
+  source->buffer.datas = &source->data;
+  // No user_data: PlaneData reads the MemPtr block directly.
+  source->pw.buffer = &source->buffer;
+}
+
+void SetDamage(SourceBuffer* source, const BenchConfig& config, bool changed) {
+  source->damage.region.position.x = 0;
+  source->damage.region.position.y = 0;
+  source->damage.region.size.width = changed ? static_cast<uint32_t>(config.width) : 0;
+  source->damage.region.size.height = changed ? static_cast<uint32_t>(config.height) : 0;
+}
+
+int64_t MonotonicNs() {
+  struct timespec now {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+bool RunBench(const BenchConfig& config, BenchResult* result, std::string* error_out) {
+  RecordingOptions options;
+  options.output_path = config.output_path;
+  options.fps = config.fps;
+  options.encoder_backend = config.encoder;
+  options.frame_format = config.frame_format;
+  options.variable_frame_rate = config.variable_frame_rate;
+  PipeWireCapture capture(0, -1, config.width, config.height, options, 0, true);
+
+  struct spa_video_info_raw info {};
+  info.format = SPA_VIDEO_FORMAT_BGRx;
+  info.size.width = static_cast<uint32_t>(config.width);
+  info.size.height = static_cast<uint32_t>(config.height);
+  if (!capture.StartHeadless(info, error_out)) {
+    return false;
+  }
+
+  std::vector<SourceBuffer> sources(kSourceBuffers);
+  for (int i = 0; i < kSourceBuffers; ++i) {
+    FillSource(&sources[i], config, i);
+  }
+
+  const auto interval = std::chrono::nanoseconds(1000000000 / std::max<uint32_t>(config.fps, 1));
+  const auto start = std::chrono::steady_clock::now();
+  const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(config.seconds));
+  auto next = start;
+  int current = 0;
+  double change_credit = 0;
+  uint64_t seq = 0;
+  while (next < end) {
+    std::this_thread::sleep_until(next);
+    if (config.stall_every > 0 && seq > 0 && seq % config.stall_every == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(config.stall_ms));
+      // Like a compositor, resume on the next vblank rather than catching up.
+      next = std::chrono::steady_clock::now();
+      ++result->stalls;
+    }
+
+    change_credit += config.change_rate;
+    const bool changed = seq == 0 || change_credit >= 1.0;
+    if (changed) {
+      change_credit -= std::min(change_credit, 1.0);
+      current = (current + 1) % kSourceBuffers;
+      ++result->changed;
+    }
+    SourceBuffer& source = sources[current];
+    SetDamage(&source, config, changed);
+    source.header.seq = seq++;
+    source.header.pts = MonotonicNs();
+    capture.ProcessVideoBuffer(&source.pw);
+    ++result->submitted;
+    next += interval;
+  }
+  result->elapsed_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const bool finished = capture.FinishOutputs(error_out);
+  result->capture = capture.GetStats();
+  if (capture.output_count() > 0) {
+    result->worker = capture.GetEncoderStats(0);
+  }
+  return finished;
+}
+
+double CpuSeconds(int who) {
+  struct rusage usage {};
+  getrusage(who, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+long PeakRssKb() {
+  struct rusage usage {};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void PrintHeader() {
+  std::printf("%-11s %4s %8s %8s %8s %7s %7s %6s %9s %9s %9s %9s\n", "size", "fps", "frames",
+              "encoded", "fps_out", "dropped", "dupes", "stalls", "cpu_us/f", "enc_us/f",
+              "copy_p99", "rss_mb");
+  // Forked matrix runs must not inherit and repeat buffered output.
+  std::fflush(stdout);
+}
+
+void PrintResult(const BenchConfig& config,
+                 const BenchResult& result,
+                 double cpu_seconds,
+                 double child_cpu_seconds,
+                 long rss_kb) {
+  const double frames = static_cast<double>(std::max<uint64_t>(result.submitted, 1));
+  const uint64_t dropped = result.capture.frames_dropped + result.worker.enqueue_failures;
+  char size[32];
+  std::snprintf(size, sizeof(size), "%dx%d", config.width, config.height);
+  std::printf("%-11s %4u %8llu %8llu %8.2f %7llu %7llu %6llu %9.1f %9.1f %9.2f %9.1f\n", size,
+              config.fps, static_cast<unsigned long long>(result.submitted),
+              static_cast<unsigned long long>(result.worker.frames_written),
+              static_cast<double>(result.worker.frames_written) /
+                  std::max(result.elapsed_seconds, 1e-9),
+              static_cast<unsigned long long>(dropped),
+              static_cast<unsigned long long>(result.capture.frames_duplicated),
+              static_cast<unsigned long long>(result.stalls), cpu_seconds * 1e6 / frames,
+              child_cpu_seconds * 1e6 / frames,
+              static_cast<double>(result.capture.copy_ns.p99) / 1e6,
+              static_cast<double>(rss_kb) / 1024.0);
+  std::fflush(stdout);
+}
+
+// Runs |config| in this process and prints one result row.
+int RunOne(const BenchConfig& config) {
+  const double cpu_before = CpuSeconds(RUSAGE_SELF);
+  const double child_before = CpuSeconds(RUSAGE_CHILDREN);
+  BenchResult result;
+  std::string error;
+  const bool ok = RunBench(config, &result, &error);
+  const double cpu = CpuSeconds(RUSAGE_SELF) - cpu_before;
+  const double child_cpu = CpuSeconds(RUSAGE_CHILDREN) - child_before;
+  if (!ok) {
+    std::fprintf(stderr, "capture_bench: %dx%d@%u failed: %s\n", config.width, config.height,
+                 config.fps, error.c_str());
+    return 1;
+  }
+  PrintResult(config, result, cpu, child_cpu, PeakRssKb());
+  return 0;
+}
+
+// Every resolution and rate of the standard matrix, each in its own process
+// so that peak RSS belongs to that configuration alone.
+int RunMatrix(const BenchConfig& base) {
+  static const int kSizes[][2] = {{1920, 1080}, {2560, 1440}, {3840, 2160}};
+  static const uint32_t kRates[] = {30, 60, 120};
+  int failures = 0;
+  for (const auto& size : kSizes) {
+    for (uint32_t fps : kRates) {
+      BenchConfig config = base;
+      config.width = size[0];
+      config.height = size[1];
+      config.fps = fps;
+      const pid_t pid = fork();
+      if (pid < 0) {
+        std::perror("fork");
+        return 1;
+      }
+      if (pid == 0) {
+        _exit(RunOne(config));
+      }
+      int status = 0;
+      if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ++failures;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+bool ParseEncoder(const char* value, EncoderBackend* backend) {
+  if (std::strcmp(value, "null") == 0) {
+    *backend = EncoderBackend::kNull;
+  } else if (std::strcmp(value, "ffmpeg") == 0) {
+    *backend = EncoderBackend::kFfmpegCli;
+  } else if (std::strcmp(value, "libav") == 0) {
+    *backend = EncoderBackend::kLibav;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseFrameFormat(const char* value, FrameFormat* format) {
+  if (std::strcmp(value, "i420") == 0) {
+    *format = FrameFormat::kI420;
+  } else if (std::strcmp(value, "nv12") == 0) {
+    *format = FrameFormat::kNv12;
+  } else if (std::strcmp(value, "bgr0") == 0) {
+    *format = FrameFormat::kBgr0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--width N] [--height N] [--fps N] [--seconds S]\n"
+               "          [--stride-padding BYTES] [--bottom-up] [--change-rate 0..1]\n"
+               "          [--stall-every FRAMES --stall-ms MS]\n"
+               "          [--encoder null|ffmpeg|libav] [--frame-format i420|nv12|bgr0]\n"
+               "          [--vfr] [--output PATH] [--matrix]\n",
+               argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kWidth = 1,
+    kHeight,
+    kFps,
+    kSeconds,
+    kStridePadding,
+    kBottomUp,
+    kChangeRate,
+    kStallEvery,
+    kStallMs,
+    kEncoder,
+    kFrameFormat,
+    kVfr,
+    kOutput,
+    kMatrix,
+  };
+  static const struct option kOptions[] = {
+      {"width", required_argument, nullptr, kWidth},
+      {"height", required_argument, nullptr, kHeight},
+      {"fps", required_argument, nullptr, kFps},
+      {"seconds", required_argument, nullptr, kSeconds},
+      {"stride-padding", required_argument, nullptr, kStridePadding},
+      {"bottom-up", no_argument, nullptr, kBottomUp},
+      {"change-rate", required_argument, nullptr, kChangeRate},
+      {"stall-every", required_argument, nullptr, kStallEvery},
+      {"stall-ms", required_argument, nullptr, kStallMs},
+      {"encoder", required_argument, nullptr, kEncoder},
+      {"frame-format", required_argument, nullptr, kFrameFormat},
+      {"vfr", no_argument, nullptr, kVfr},
+      {"output", required_argument, nullptr, kOutput},
+      {"matrix", no_argument, nullptr, kMatrix},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  BenchConfig config;
+  bool matrix = false;
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+    switch (option) {
+      case kWidth:
+        config.width = std::atoi(optarg);
+        break;
+      case kHeight:
+        config.height = std::atoi(optarg);
+        break;
+      case kFps:
+        config.fps = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        break;
+      case kSeconds:
+        config.seconds = std::atof(optarg);
+        break;
+      case kStridePadding:
+        config.stride_padding = std::max(std::atoi(optarg), 0);
+        break;
+      case kBottomUp:
+        config.bottom_up = true;
+        break;
+      case kChangeRate:
+        config.change_rate = std::min(std::max(std::atof(optarg), 0.0), 1.0);
+        break;
+      case kStallEvery:
+        config.stall_every = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        break;
+      case kStallMs:
+        config.stall_ms = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        break;
+      case kEncoder:
+        if (!ParseEncoder(optarg, &config.encoder)) {
+          PrintUsage(argv[0]);
+          return 2;
+        }
+        break;
+      case kFrameFormat:
+        if (!ParseFrameFormat(optarg, &config.frame_format)) {
+          PrintUsage(argv[0]);
+          return 2;
+        }
+        break;
+      case kVfr:
+        config.variable_frame_rate = true;
+        break;
+      case kOutput:
+        config.output_path = optarg;
+        break;
+      case kMatrix:
+        matrix = true;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 2;
+    }
+  }
+  if (config.width <= 0 || config.height <= 0 || config.fps == 0 || config.seconds <= 0) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  PrintHeader();
+  return matrix ? RunMatrix(config) : RunOne(config);
+}
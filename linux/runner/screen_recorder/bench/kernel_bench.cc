@@ -0,0 +1,630 @@
+// Microbenchmarks of the per-frame capture kernels: row copy with stride
+// resolution, colour conversion, NV12 plane copy and scaling. Every kernel
+// variant the CPU supports runs over the common frame sizes and source
+// layouts, is checked against a scalar reference, and is reported as JSON:
+//
+//   kernel_bench --min-time 0.2 --output kernels.json
+//
+// gbps counts the bytes read plus the bytes written per frame;
+// cycles_per_pixel is per source pixel.
+
+#include "color_convert.h"
+#include "frame_copy.h"
+#include "frame_scaler.h"
+#include "recording_options.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <getopt.h>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+struct Geometry {
+  const char* name;
+  int width;
+  int height;
+};
+
+constexpr Geometry kGeometries[] = {
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"2160p", 3840, 2160},
+};
+
+// How the source rows sit in memory, as compositors hand them over.
+struct SourceShape {
+  const char* name;
+  // Rows padded to a 256-byte pitch plus one extra cache line.
+  bool padded = false;
+  bool bottom_up = false;
+  // The chunk carries no stride, so it is inferred from the payload size.
+  bool inferred = false;
+  // Bytes the first row is moved off 64-byte alignment.
+  int misalignment = 0;
+};
+
+constexpr SourceShape kPackedShapes[] = {
+    {"packed", false, false, false, 0},
+    {"padded", true, false, false, 0},
+    {"bottom_up", false, true, false, 0},
+    {"inferred", true, false, true, 0},
+    {"unaligned", false, false, false, 4},
+};
+
+// NV12 sources are never bottom-up and never have their stride inferred.
+constexpr SourceShape kNv12Shapes[] = {
+    {"packed", false, false, false, 0},
+    {"padded", true, false, false, 0},
+    {"unaligned", false, false, false, 4},
+};
+
+struct ScaleCase {
+  const char* name;
+  Geometry src;
+  Geometry dst;
+};
+
+// Each method from every source size it applies to; box3 needs an exact 3:1
+// ratio, which 2560 columns do not have.
+constexpr ScaleCase kScaleCases[] = {
+    {"box2", {"1080p", 1920, 1080}, {"540p", 960, 540}},
+    {"box2", {"1440p", 2560, 1440}, {"720p", 1280, 720}},
+    {"box2", {"2160p", 3840, 2160}, {"1080p", 1920, 1080}},
+    {"box3", {"1080p", 1920, 1080}, {"360p", 640, 360}},
+    {"box3", {"2160p", 3840, 2160}, {"720p", 1280, 720}},
+    {"bilinear", {"1080p", 1920, 1080}, {"720p", 1280, 720}},
+    {"bilinear", {"1440p", 2560, 1440}, {"1080p", 1920, 1080}},
+    {"bilinear", {"2160p", 3840, 2160}, {"1440p", 2560, 1440}},
+};
+
+struct Options {
+  double min_time = 0.1;
+  std::string filter;
+  std::string output_path;
+};
+
+struct Result {
+  std::string kernel;
+  std::string impl;
+  std::string geometry;
+  std::string shape;
+  int width = 0;
+  int height = 0;
+  int src_stride = 0;
+  uint64_t iterations = 0;
+  double ns_median = 0;
+  double ns_min = 0;
+  double gbps = 0;
+  // Negative when no cycle counter is available.
+  double cycles_per_pixel = -1;
+  bool correct = false;
+};
+
+// Reads CPU cycles from perf events, falling back to the TSC (reference
+// cycles) where that is all there is.
+class CycleCounter {
+ public:
+  CycleCounter() {
+    struct perf_event_attr attr {};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  ~CycleCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  CycleCounter(const CycleCounter&) = delete;
+  CycleCounter& operator=(const CycleCounter&) = delete;
+
+  const char* source() const {
+    if (fd_ >= 0) {
+      return "perf";
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    return "tsc";
+#else
+    return "none";
+#endif
+  }
+
+  bool Read(uint64_t* cycles) const {
+    if (fd_ >= 0) {
+      return read(fd_, cycles, sizeof(*cycles)) == static_cast<ssize_t>(sizeof(*cycles));
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    *cycles = __rdtsc();
+    return true;
+#else
+    return false;
+#endif
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+// Heap block whose usable start is 64-byte aligned plus |misalignment|.
+class Buffer {
+ public:
+  Buffer(size_t size, int misalignment) : storage_(size + 128) {
+    const uintptr_t base = reinterpret_cast<uintptr_t>(storage_.data());
+    const uintptr_t aligned = (base + 63) & ~static_cast<uintptr_t>(63);
+    data_ = storage_.data() + (aligned - base) + misalignment;
+    size_ = size;
+  }
+
+  uint8_t* data() { return data_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  std::vector<uint8_t> storage_;
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+void FillPattern(uint8_t* data, size_t size, uint32_t seed) {
+  uint32_t state = seed * 2654435761u + 1;
+  for (size_t i = 0; i < size; ++i) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    data[i] = static_cast<uint8_t>(state);
+  }
+}
+
+int RowPitch(int row_bytes, bool padded) {
+  return padded ? ((row_bytes + 255) & ~255) + 64 : row_bytes;
+}
+
+// A source frame laid out per |shape|, with the chunk metadata a compositor
+// would report for it.
+struct Source {
+  Source(int width, int height, int bytes_per_pixel, int extra_rows, const SourceShape& shape)
+      : pitch(RowPitch(width * bytes_per_pixel, shape.padded)),
+        rows(height + extra_rows),
+        block(static_cast<size_t>(pitch) * static_cast<size_t>(height + extra_rows),
+              shape.misalignment) {
+    FillPattern(block.data(), block.size(), static_cast<uint32_t>(width * 31 + height));
+    chunk_stride = shape.inferred ? 0 : (shape.bottom_up ? -pitch : pitch);
+  }
+
+  int pitch;
+  int rows;
+  Buffer block;
+  int32_t chunk_stride = 0;
+};
+
+bool Matches(const std::string& name, const Options& options) {
+  return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// Times |run| until |min_time| has passed (and at least five times) and
+// fills in the per-frame figures of |result|.
+void Measure(const std::function<void()>& run,
+             uint64_t pixels,
+             uint64_t bytes,
+             const Options& options,
+             const CycleCounter& counter,
+             Result* result) {
+  run();
+  std::vector<double> samples;
+  uint64_t cycles_before = 0;
+  uint64_t cycles_after = 0;
+  const bool have_cycles = counter.Read(&cycles_before);
+  const auto start = std::chrono::steady_clock::now();
+  auto now = start;
+  while (samples.size() < 5 || std::chrono::duration<double>(now - start).count() < options.min_time) {
+    const auto before = std::chrono::steady_clock::now();
+    run();
+    now = std::chrono::steady_clock::now();
+    samples.push_back(std::chrono::duration<double, std::nano>(now - before).count());
+  }
+  const bool cycles_ok = have_cycles && counter.Read(&cycles_after);
+
+  result->iterations = samples.size();
+  std::sort(samples.begin(), samples.end());
+  result->ns_median = samples[samples.size() / 2];
+  result->ns_min = samples.front();
+  result->gbps = static_cast<double>(bytes) / result->ns_median;
+  if (cycles_ok && cycles_after > cycles_before) {
+    result->cycles_per_pixel = static_cast<double>(cycles_after - cycles_before) /
+                               static_cast<double>(samples.size()) / static_cast<double>(pixels);
+  }
+}
+
+// What OnProcess does before copying: resolve the pitch and find the first row.
+const uint8_t* ResolveFirstRow(const Source& source, int width, int height, bool nv12, int* stride) {
+  const uint32_t size = static_cast<uint32_t>(static_cast<size_t>(source.pitch) * source.rows);
+  *stride = ResolveSourceStride(source.chunk_stride, 0, size, width, height, nv12);
+  return SourceFirstRow(source.block.data(), *stride, height);
+}
+
+void ReferenceCopy(const uint8_t* first_row, int stride, int width, int height, uint8_t* dst) {
+  const size_t row_bytes = static_cast<size_t>(width) * 4;
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* src = first_row + static_cast<ptrdiff_t>(y) * stride;
+    for (size_t i = 0; i < row_bytes; ++i) {
+      dst[static_cast<size_t>(y) * row_bytes + i] = src[i];
+    }
+  }
+}
+
+void BenchCopyRows(const Options& options, const CycleCounter& counter, std::vector<Result>* results) {
+  if (!Matches("copy_rows", options)) {
+    return;
+  }
+  for (const Geometry& geometry : kGeometries) {
+    for (const SourceShape& shape : kPackedShapes) {
+      Source source(geometry.width, geometry.height, 4, 0, shape);
+      const size_t frame_bytes = static_cast<size_t>(geometry.width) * geometry.height * 4;
+      Buffer dst(frame_bytes, 0);
+      std::vector<uint8_t> expected(frame_bytes);
+      int stride = 0;
+      const uint8_t* first_row =
+          ResolveFirstRow(source, geometry.width, geometry.height, false, &stride);
+      ReferenceCopy(first_row, stride, geometry.width, geometry.height, expected.data());
+
+      Result result;
+      result.kernel = "copy_rows";
+      result.impl = "memcpy";
+      result.geometry = geometry.name;
+      result.shape = shape.name;
+      result.width = geometry.width;
+      result.height = geometry.height;
+      const size_t row_bytes = static_cast<size_t>(geometry.width) * 4;
+      auto run = [&] {
+        int run_stride = 0;
+        const uint8_t* first_row =
+            ResolveFirstRow(source, geometry.width, geometry.height, false, &run_stride);
+        CopyRows(first_row, run_stride, dst.data(), row_bytes, geometry.height, row_bytes);
+      };
+      run();
+      result.src_stride = stride;
+      result.correct = std::memcmp(dst.data(), expected.data(), frame_bytes) == 0;
+      Measure(run, static_cast<uint64_t>(geometry.width) * geometry.height, frame_bytes * 2,
+              options, counter, &result);
+      results->push_back(result);
+    }
+  }
+}
+
+std::vector<ConvertKernel> ConvertKernels() {
+  std::vector<ConvertKernel> kernels;
+  const ConvertKernel active = ActiveConvertKernel();
+  for (ConvertKernel kernel : {ConvertKernel::kScalar, ConvertKernel::kSse41, ConvertKernel::kAvx2,
+                               ConvertKernel::kAvx512, ConvertKernel::kNeon}) {
+    if (SetConvertKernel(kernel)) {
+      kernels.push_back(kernel);
+    }
+  }
+  SetConvertKernel(active);
+  return kernels;
+}
+
+// Conversions from a packed 4-byte source: BGRx reordering and both 4:2:0
+// targets. Each kernel's output must equal the scalar kernel's byte for byte.
+void BenchConvert(const Options& options, const CycleCounter& counter, std::vector<Result>* results) {
+  struct Target {
+    const char* kernel;
+    FrameFormat format;
+    PixelLayout layout;
+  };
+  // BGRx sources are copied as is, so the reordering case starts from RGBx.
+  static const Target kTargets[] = {
+      {"convert_bgrx", FrameFormat::kBgr0, PixelLayout::kRGBx},
+      {"convert_i420", FrameFormat::kI420, PixelLayout::kBGRx},
+      {"convert_nv12", FrameFormat::kNv12, PixelLayout::kBGRx},
+  };
+  const ConvertKernel active = ActiveConvertKernel();
+  const std::vector<ConvertKernel> kernels = ConvertKernels();
+  for (const Target& target : kTargets) {
+    if (!Matches(target.kernel, options)) {
+      continue;
+    }
+    for (const Geometry& geometry : kGeometries) {
+      for (const SourceShape& shape : kPackedShapes) {
+        Source source(geometry.width, geometry.height, 4, 0, shape);
+        const size_t frame_bytes = FrameFormatBytes(target.format, geometry.width, geometry.height);
+        Buffer dst(frame_bytes, 0);
+        std::vector<uint8_t> expected;
+        int stride = 0;
+        ResolveFirstRow(source, geometry.width, geometry.height, false, &stride);
+        auto run = [&] {
+          int run_stride = 0;
+          const uint8_t* first_row =
+              ResolveFirstRow(source, geometry.width, geometry.height, false, &run_stride);
+          if (target.format == FrameFormat::kBgr0) {
+            ConvertToBgrx(first_row, run_stride, target.layout, geometry.width, geometry.height,
+                          dst.data(), static_cast<size_t>(geometry.width) * 4);
+          } else {
+            ConvertToYuv420(first_row, run_stride, target.layout, geometry.width, geometry.height,
+                            MapYuv420Planes(target.format, dst.data(), geometry.width,
+                                            geometry.height));
+          }
+        };
+        for (ConvertKernel kernel : kernels) {
+          SetConvertKernel(kernel);
+          Result result;
+          result.kernel = target.kernel;
+          result.impl = ConvertKernelName(kernel);
+          result.geometry = geometry.name;
+          result.shape = shape.name;
+          result.width = geometry.width;
+          result.height = geometry.height;
+          result.src_stride = stride;
+          run();
+          if (kernel == ConvertKernel::kScalar) {
+            expected.assign(dst.data(), dst.data() + frame_bytes);
+          }
+          result.correct = std::memcmp(dst.data(), expected.data(), frame_bytes) == 0;
+          const uint64_t pixels = static_cast<uint64_t>(geometry.width) * geometry.height;
+          Measure(run, pixels, pixels * 4 + frame_bytes, options, counter, &result);
+          results->push_back(result);
+        }
+      }
+    }
+  }
+  SetConvertKernel(active);
+}
+
+// NV12 sources copied into I420, which splits the chroma plane.
+void BenchNv12(const Options& options, const CycleCounter& counter, std::vector<Result>* results) {
+  if (!Matches("nv12_to_i420", options)) {
+    return;
+  }
+  const ConvertKernel active = ActiveConvertKernel();
+  const std::vector<ConvertKernel> kernels = ConvertKernels();
+  for (const Geometry& geometry : kGeometries) {
+    for (const SourceShape& shape : kNv12Shapes) {
+      const int chroma_rows = (geometry.height + 1) / 2;
+      Source source(geometry.width, geometry.height, 1, chroma_rows, shape);
+      const size_t frame_bytes =
+          FrameFormatBytes(FrameFormat::kI420, geometry.width, geometry.height);
+      Buffer dst(frame_bytes, 0);
+      std::vector<uint8_t> expected;
+      auto run = [&] {
+        int stride = 0;
+        const uint8_t* luma = ResolveFirstRow(source, geometry.width, geometry.height, true, &stride);
+        const uint8_t* chroma = luma + static_cast<size_t>(stride) * geometry.height;
+        CopyNv12ToYuv420(luma, stride, chroma, stride, geometry.width, geometry.height,
+                         MapYuv420Planes(FrameFormat::kI420, dst.data(), geometry.width,
+                                         geometry.height));
+      };
+      for (ConvertKernel kernel : kernels) {
+        SetConvertKernel(kernel);
+        Result result;
+        result.kernel = "nv12_to_i420";
+        result.impl = ConvertKernelName(kernel);
+        result.geometry = geometry.name;
+        result.shape = shape.name;
+        result.width = geometry.width;
+        result.height = geometry.height;
+        result.src_stride = source.pitch;
+        run();
+        if (kernel == ConvertKernel::kScalar) {
+          expected.assign(dst.data(), dst.data() + frame_bytes);
+        }
+        result.correct = std::memcmp(dst.data(), expected.data(), frame_bytes) == 0;
+        const uint64_t pixels = static_cast<uint64_t>(geometry.width) * geometry.height;
+        Measure(run, pixels, frame_bytes * 2, options, counter, &result);
+        results->push_back(result);
+      }
+    }
+  }
+  SetConvertKernel(active);
+}
+
+void BenchScale(const Options& options, const CycleCounter& counter, std::vector<Result>* results) {
+  if (!Matches("scale", options)) {
+    return;
+  }
+  const ScaleKernel active = ActiveScaleKernel();
+  std::vector<ScaleKernel> kernels;
+  for (ScaleKernel kernel : {ScaleKernel::kScalar, ScaleKernel::kAvx2, ScaleKernel::kNeon}) {
+    if (SetScaleKernel(kernel)) {
+      kernels.push_back(kernel);
+    }
+  }
+  for (const ScaleCase& scale : kScaleCases) {
+    const FrameFormat format = FrameFormat::kI420;
+    const size_t src_bytes = FrameFormatBytes(format, scale.src.width, scale.src.height);
+    const size_t dst_bytes = FrameFormatBytes(format, scale.dst.width, scale.dst.height);
+    Buffer src(src_bytes, 0);
+    FillPattern(src.data(), src_bytes, 7);
+    Buffer dst(dst_bytes, 0);
+    std::vector<uint8_t> expected;
+    for (ScaleKernel kernel : kernels) {
+      SetScaleKernel(kernel);
+      FrameScaler scaler;
+      scaler.Configure(format, scale.src.width, scale.src.height, scale.dst.width,
+                       scale.dst.height);
+      auto run = [&] { scaler.Scale(src.data(), dst.data()); };
+      Result result;
+      result.kernel = std::string("scale_") + scale.name;
+      result.impl = ScaleKernelName(kernel);
+      result.geometry = std::string(scale.src.name) + "_to_" + scale.dst.name;
+      result.shape = "i420";
+      result.width = scale.src.width;
+      result.height = scale.src.height;
+      result.src_stride = scale.src.width;
+      run();
+      if (kernel == ScaleKernel::kScalar) {
+        expected.assign(dst.data(), dst.data() + dst_bytes);
+      }
+      result.correct = std::memcmp(dst.data(), expected.data(), dst_bytes) == 0;
+      Measure(run, static_cast<uint64_t>(scale.src.width) * scale.src.height,
+              src_bytes + dst_bytes, options, counter, &result);
+      results->push_back(result);
+    }
+  }
+  SetScaleKernel(active);
+}
+
+std::string CpuModel() {
+  FILE* file = fopen("/proc/cpuinfo", "r");
+  if (!file) {
+    return "unknown";
+  }
+  char line[512];
+  std::string model = "unknown";
+  while (fgets(line, sizeof(line), file)) {
+    if (std::strncmp(line, "model name", 10) == 0) {
+      const char* value = std::strchr(line, ':');
+      if (value) {
+        model = value + 1;
+        model.erase(0, model.find_first_not_of(" \t"));
+        model.erase(model.find_last_not_of(" \t\n") + 1);
+      }
+      break;
+    }
+  }
+  fclose(file);
+  return model;
+}
+
+std::string JsonString(const std::string& value) {
+  std::string out = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+void WriteJson(FILE* out,
+               const Options& options,
+               const CycleCounter& counter,
+               const std::vector<Result>& results) {
+  std::fprintf(out, "{\n  \"machine\": {\n");
+  std::fprintf(out, "    \"cpu\": %s,\n", JsonString(CpuModel()).c_str());
+  std::fprintf(out, "    \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+  std::fprintf(out, "    \"convert_kernel\": %s,\n",
+               JsonString(ConvertKernelName(ActiveConvertKernel())).c_str());
+  std::fprintf(out, "    \"scale_kernel\": %s,\n",
+               JsonString(ScaleKernelName(ActiveScaleKernel())).c_str());
+  std::fprintf(out, "    \"cycle_source\": %s\n  },\n", JsonString(counter.source()).c_str());
+  std::fprintf(out, "  \"min_time_s\": %g,\n  \"results\": [\n", options.min_time);
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::fprintf(out,
+                 "    {\"kernel\": %s, \"impl\": %s, \"geometry\": %s, \"shape\": %s, "
+                 "\"width\": %d, \"height\": %d, \"src_stride\": %d, \"iterations\": %llu, "
+                 "\"ns_median\": %.0f, \"ns_min\": %.0f, \"gbps\": %.3f, ",
+                 JsonString(r.kernel).c_str(), JsonString(r.impl).c_str(),
+                 JsonString(r.geometry).c_str(), JsonString(r.shape).c_str(), r.width, r.height,
+                 r.src_stride, static_cast<unsigned long long>(r.iterations), r.ns_median,
+                 r.ns_min, r.gbps);
+    if (r.cycles_per_pixel >= 0) {
+      std::fprintf(out, "\"cycles_per_pixel\": %.3f, ", r.cycles_per_pixel);
+    } else {
+      std::fprintf(out, "\"cycles_per_pixel\": null, ");
+    }
+    std::fprintf(out, "\"correct\": %s}%s\n", r.correct ? "true" : "false",
+                 i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "  ]\n}\n");
+}
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(stderr, "usage: %s [--min-time SECONDS] [--filter KERNEL] [--output PATH]\n",
+               argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kMinTime = 1,
+    kFilter,
+    kOutput,
+  };
+  static const struct option kOptions[] = {
+      {"min-time", required_argument, nullptr, kMinTime},
+      {"filter", required_argument, nullptr, kFilter},
+      {"output", required_argument, nullptr, kOutput},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  Options options;
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+    switch (option) {
+      case kMinTime:
+        options.min_time = std::max(std::atof(optarg), 0.0);
+        break;
+      case kFilter:
+        options.filter = optarg;
+        break;
+      case kOutput:
+        options.output_path = optarg;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 2;
+    }
+  }
+
+  const CycleCounter counter;
+  std::vector<Result> results;
+  BenchCopyRows(options, counter, &results);
+  BenchConvert(options, counter, &results);
+  BenchNv12(options, counter, &results);
+  BenchScale(options, counter, &results);
+
+  FILE* out = stdout;
+  if (!options.output_path.empty()) {
+    out = fopen(options.output_path.c_str(), "w");
+    if (!out) {
+      std::perror(options.output_path.c_str());
+      return 1;
+    }
+  }
+  WriteJson(out, options, counter, results);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  int failures = 0;
+  for (const Result& result : results) {
+    if (!result.correct) {
+      std::fprintf(stderr, "kernel_bench: %s/%s %s %s differs from the reference\n",
+                   result.kernel.c_str(), result.impl.c_str(), result.geometry.c_str(),
+                   result.shape.c_str());
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
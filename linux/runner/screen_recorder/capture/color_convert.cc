@@ -0,0 +1,368 @@
+#include "color_convert.h"
+
+#include "color_convert_kernels.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace color_convert_internal {
+
+namespace {
+
+// BT.601 limited range in 8-bit fixed point. Every kernel uses exactly this
+// arithmetic so that all of them produce identical output.
+inline uint8_t Luma(int r, int g, int b) {
+  return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t ChromaU(int r, int g, int b) {
+  return static_cast<uint8_t>(((112 * b - 74 * g - 38 * r + 128) >> 8) + 128);
+}
+
+inline uint8_t ChromaV(int r, int g, int b) {
+  return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+}  // namespace
+
+void RowPairScalar(const uint8_t* src0,
+                   const uint8_t* src1,
+                   int x_begin,
+                   int width,
+                   uint8_t* y0,
+                   uint8_t* y1,
+                   uint8_t* u,
+                   uint8_t* v,
+                   bool interleaved_uv,
+                   const ChannelOffsets& offsets) {
+  for (int x = x_begin; x < width; x += 2) {
+    const bool has_right = x + 1 < width;
+    const uint8_t* p00 = src0 + static_cast<size_t>(x) * 4;
+    const uint8_t* p01 = has_right ? p00 + 4 : p00;
+    const uint8_t* p10 = src1 + static_cast<size_t>(x) * 4;
+    const uint8_t* p11 = has_right ? p10 + 4 : p10;
+
+    y0[x] = Luma(p00[offsets.r], p00[offsets.g], p00[offsets.b]);
+    if (has_right) {
+      y0[x + 1] = Luma(p01[offsets.r], p01[offsets.g], p01[offsets.b]);
+    }
+    if (y1) {
+      y1[x] = Luma(p10[offsets.r], p10[offsets.g], p10[offsets.b]);
+      if (has_right) {
+        y1[x + 1] = Luma(p11[offsets.r], p11[offsets.g], p11[offsets.b]);
+      }
+    }
+
+    const int r = (p00[offsets.r] + p01[offsets.r] + p10[offsets.r] + p11[offsets.r] + 2) >> 2;
+    const int g = (p00[offsets.g] + p01[offsets.g] + p10[offsets.g] + p11[offsets.g] + 2) >> 2;
+    const int b = (p00[offsets.b] + p01[offsets.b] + p10[offsets.b] + p11[offsets.b] + 2) >> 2;
+    const int cx = x / 2;
+    if (interleaved_uv) {
+      u[cx * 2] = ChromaU(r, g, b);
+      u[cx * 2 + 1] = ChromaV(r, g, b);
+    } else {
+      u[cx] = ChromaU(r, g, b);
+      v[cx] = ChromaV(r, g, b);
+    }
+  }
+}
+
+}  // namespace color_convert_internal
+
+using color_convert_internal::ChannelOffsets;
+using color_convert_internal::RowPairKernel;
+
+namespace {
+
+constexpr uint8_t kBlackLuma = 16;
+constexpr uint8_t kNeutralChroma = 128;
+
+int RowPairScalarKernel(const uint8_t* src0,
+                        const uint8_t* src1,
+                        int width,
+                        uint8_t* y0,
+                        uint8_t* y1,
+                        uint8_t* u,
+                        uint8_t* v,
+                        bool interleaved_uv,
+                        const ChannelOffsets& offsets) {
+  color_convert_internal::RowPairScalar(src0, src1, 0, width, y0, y1, u, v, interleaved_uv,
+                                        offsets);
+  return width;
+}
+
+bool CpuSupports(ConvertKernel kernel) {
+  switch (kernel) {
+    case ConvertKernel::kScalar:
+      return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case ConvertKernel::kSse41:
+      return __builtin_cpu_supports("sse4.1");
+    case ConvertKernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+    case ConvertKernel::kAvx512:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+             __builtin_cpu_supports("avx512vl");
+#endif
+#if defined(__aarch64__)
+    case ConvertKernel::kNeon:
+      // Advanced SIMD is part of the AArch64 baseline.
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+RowPairKernel KernelFunction(ConvertKernel kernel) {
+  switch (kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    case ConvertKernel::kSse41:
+      return color_convert_internal::RowPairSse41;
+    case ConvertKernel::kAvx2:
+      return color_convert_internal::RowPairAvx2;
+    case ConvertKernel::kAvx512:
+      return color_convert_internal::RowPairAvx512;
+#endif
+#if defined(__aarch64__)
+    case ConvertKernel::kNeon:
+      return color_convert_internal::RowPairNeon;
+#endif
+    default:
+      return RowPairScalarKernel;
+  }
+}
+
+ConvertKernel DetectKernel() {
+  for (ConvertKernel kernel : {ConvertKernel::kAvx512, ConvertKernel::kAvx2, ConvertKernel::kSse41,
+                               ConvertKernel::kNeon}) {
+    if (CpuSupports(kernel)) {
+      return kernel;
+    }
+  }
+  return ConvertKernel::kScalar;
+}
+
+std::atomic<ConvertKernel>& ActiveKernelSlot() {
+  static std::atomic<ConvertKernel> active {DetectKernel()};
+  return active;
+}
+
+ChannelOffsets OffsetsFor(PixelLayout layout) {
+  ChannelOffsets offsets;
+  switch (layout) {
+    case PixelLayout::kBGRx:
+      offsets = {0, 1, 2};
+      break;
+    case PixelLayout::kRGBx:
+      offsets = {2, 1, 0};
+      break;
+    case PixelLayout::kxRGB:
+      offsets = {3, 2, 1};
+      break;
+    case PixelLayout::kxBGR:
+      offsets = {1, 2, 3};
+      break;
+  }
+  return offsets;
+}
+
+void FillRect(uint8_t* plane, size_t stride, size_t x, size_t y, size_t width, size_t height,
+              uint8_t value) {
+  if (width == 0) {
+    return;
+  }
+  for (size_t row = y; row < y + height; ++row) {
+    std::memset(plane + row * stride + x, value, width);
+  }
+}
+
+}  // namespace
+
+size_t FrameFormatBytes(FrameFormat format, int width, int height) {
+  const size_t pixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+  return format == FrameFormat::kBgr0 ? pixels * 4 : pixels + pixels / 2;
+}
+
+Yuv420Planes MapYuv420Planes(FrameFormat format, uint8_t* data, int width, int height) {
+  const size_t luma_bytes = static_cast<size_t>(width) * static_cast<size_t>(height);
+  Yuv420Planes planes;
+  planes.y = data;
+  planes.y_stride = static_cast<size_t>(width);
+  planes.u = data + luma_bytes;
+  if (format == FrameFormat::kNv12) {
+    planes.uv_stride = static_cast<size_t>(width);
+    planes.interleaved_uv = true;
+  } else {
+    planes.uv_stride = static_cast<size_t>(width / 2);
+    planes.v = planes.u + luma_bytes / 4;
+  }
+  return planes;
+}
+
+Yuv420Planes OffsetYuv420Planes(const Yuv420Planes& planes, int x, int y) {
+  Yuv420Planes out = planes;
+  const size_t chroma_row = static_cast<size_t>(y / 2) * planes.uv_stride;
+  out.y = planes.y + static_cast<size_t>(y) * planes.y_stride + static_cast<size_t>(x);
+  if (planes.interleaved_uv) {
+    out.u = planes.u + chroma_row + static_cast<size_t>(x);
+  } else {
+    out.u = planes.u + chroma_row + static_cast<size_t>(x / 2);
+    out.v = planes.v + chroma_row + static_cast<size_t>(x / 2);
+  }
+  return out;
+}
+
+void ConvertToYuv420(const uint8_t* src_first_row,
+                     int src_stride,
+                     PixelLayout layout,
+                     int width,
+                     int height,
+                     const Yuv420Planes& dst) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  const ChannelOffsets offsets = OffsetsFor(layout);
+  const RowPairKernel kernel = KernelFunction(ActiveKernelSlot().load(std::memory_order_relaxed));
+  const ptrdiff_t step = static_cast<ptrdiff_t>(src_stride);
+
+  int row = 0;
+  for (; row + 1 < height; row += 2) {
+    const uint8_t* src0 = src_first_row + static_cast<ptrdiff_t>(row) * step;
+    const uint8_t* src1 = src0 + step;
+    uint8_t* y0 = dst.y + static_cast<size_t>(row) * dst.y_stride;
+    uint8_t* y1 = y0 + dst.y_stride;
+    const size_t chroma_offset = static_cast<size_t>(row / 2) * dst.uv_stride;
+    uint8_t* u = dst.u + chroma_offset;
+    uint8_t* v = dst.interleaved_uv ? nullptr : dst.v + chroma_offset;
+    const int done = kernel(src0, src1, width, y0, y1, u, v, dst.interleaved_uv, offsets);
+    if (done < width) {
+      color_convert_internal::RowPairScalar(src0, src1, done, width, y0, y1, u, v,
+                                            dst.interleaved_uv, offsets);
+    }
+  }
+  if (row < height) {
+    const uint8_t* src0 = src_first_row + static_cast<ptrdiff_t>(row) * step;
+    const size_t chroma_offset = static_cast<size_t>(row / 2) * dst.uv_stride;
+    color_convert_internal::RowPairScalar(src0, src0, 0, width,
+                                          dst.y + static_cast<size_t>(row) * dst.y_stride, nullptr,
+                                          dst.u + chroma_offset,
+                                          dst.interleaved_uv ? nullptr : dst.v + chroma_offset,
+                                          dst.interleaved_uv, offsets);
+  }
+}
+
+void CopyNv12ToYuv420(const uint8_t* src_y,
+                      int src_y_stride,
+                      const uint8_t* src_uv,
+                      int src_uv_stride,
+                      int width,
+                      int height,
+                      const Yuv420Planes& dst) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  const size_t row_bytes = static_cast<size_t>(width);
+  for (int row = 0; row < height; ++row) {
+    std::memcpy(dst.y + static_cast<size_t>(row) * dst.y_stride,
+                src_y + static_cast<ptrdiff_t>(row) * src_y_stride, row_bytes);
+  }
+  const int chroma_width = (width + 1) / 2;
+  const int chroma_height = (height + 1) / 2;
+  for (int row = 0; row < chroma_height; ++row) {
+    const uint8_t* uv = src_uv + static_cast<ptrdiff_t>(row) * src_uv_stride;
+    const size_t offset = static_cast<size_t>(row) * dst.uv_stride;
+    if (dst.interleaved_uv) {
+      std::memcpy(dst.u + offset, uv, static_cast<size_t>(chroma_width) * 2);
+      continue;
+    }
+    uint8_t* u = dst.u + offset;
+    uint8_t* v = dst.v + offset;
+    for (int x = 0; x < chroma_width; ++x) {
+      u[x] = uv[x * 2];
+      v[x] = uv[x * 2 + 1];
+    }
+  }
+}
+
+void ConvertToBgrx(const uint8_t* src_first_row,
+                   int src_stride,
+                   PixelLayout layout,
+                   int width,
+                   int height,
+                   uint8_t* dst,
+                   size_t dst_stride) {
+  const ChannelOffsets offsets = OffsetsFor(layout);
+  for (int row = 0; row < height; ++row) {
+    const uint8_t* src = src_first_row + static_cast<ptrdiff_t>(row) * src_stride;
+    uint8_t* out = dst + static_cast<size_t>(row) * dst_stride;
+    for (int x = 0; x < width; ++x) {
+      out[0] = src[offsets.b];
+      out[1] = src[offsets.g];
+      out[2] = src[offsets.r];
+      out[3] = 0;
+      src += 4;
+      out += 4;
+    }
+  }
+}
+
+void FillYuv420Uncovered(const Yuv420Planes& dst,
+                         int dst_width,
+                         int dst_height,
+                         int covered_width,
+                         int covered_height) {
+  const size_t width = static_cast<size_t>(dst_width);
+  const size_t height = static_cast<size_t>(dst_height);
+  const size_t covered_cols = static_cast<size_t>(covered_width);
+  const size_t covered_rows = static_cast<size_t>(covered_height);
+  const size_t chroma_width = width / 2;
+  const size_t chroma_height = height / 2;
+  // Chroma of an odd covered edge was written together with its neighbour.
+  const size_t covered_chroma_cols = (covered_cols + 1) / 2;
+  const size_t covered_chroma_rows = (covered_rows + 1) / 2;
+
+  FillRect(dst.y, dst.y_stride, covered_cols, 0, width - covered_cols, covered_rows, kBlackLuma);
+  FillRect(dst.y, dst.y_stride, 0, covered_rows, width, height - covered_rows, kBlackLuma);
+  if (dst.interleaved_uv) {
+    FillRect(dst.u, dst.uv_stride, covered_chroma_cols * 2, 0,
+             (chroma_width - covered_chroma_cols) * 2, covered_chroma_rows, kNeutralChroma);
+    FillRect(dst.u, dst.uv_stride, 0, covered_chroma_rows, chroma_width * 2,
+             chroma_height - covered_chroma_rows, kNeutralChroma);
+    return;
+  }
+  for (uint8_t* plane : {dst.u, dst.v}) {
+    FillRect(plane, dst.uv_stride, covered_chroma_cols, 0, chroma_width - covered_chroma_cols,
+             covered_chroma_rows, kNeutralChroma);
+    FillRect(plane, dst.uv_stride, 0, covered_chroma_rows, chroma_width,
+             chroma_height - covered_chroma_rows, kNeutralChroma);
+  }
+}
+
+ConvertKernel ActiveConvertKernel() {
+  return ActiveKernelSlot().load(std::memory_order_relaxed);
+}
+
+bool SetConvertKernel(ConvertKernel kernel) {
+  if (!CpuSupports(kernel)) {
+    return false;
+  }
+  ActiveKernelSlot().store(kernel, std::memory_order_relaxed);
+  return true;
+}
+
+const char* ConvertKernelName(ConvertKernel kernel) {
+  switch (kernel) {
+    case ConvertKernel::kScalar:
+      return "scalar";
+    case ConvertKernel::kSse41:
+      return "sse4.1";
+    case ConvertKernel::kAvx2:
+      return "avx2";
+    case ConvertKernel::kAvx512:
+      return "avx512";
+    case ConvertKernel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
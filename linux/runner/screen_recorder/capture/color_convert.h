@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "recording_options.h"
+
+// Byte order of a 4-byte source pixel in memory; the padding byte is ignored.
+enum class PixelLayout {
+  kBGRx,
+  kRGBx,
+  kxRGB,
+  kxBGR,
+};
+
+enum class ConvertKernel {
+  kScalar,
+  kSse41,
+  kAvx2,
+  kAvx512,
+  kNeon,
+};
+
+// Destination of a 4:2:0 frame. For interleaved (NV12) chroma |u| points at
+// the UV plane and |v| is unused.
+struct Yuv420Planes {
+  uint8_t* y = nullptr;
+  uint8_t* u = nullptr;
+  uint8_t* v = nullptr;
+  size_t y_stride = 0;
+  size_t uv_stride = 0;
+  bool interleaved_uv = false;
+};
+
+// Bytes of a tightly packed |width| x |height| frame (both even) in |format|.
+size_t FrameFormatBytes(FrameFormat format, int width, int height);
+
+// Plane pointers into a tightly packed I420 or NV12 frame at |data|.
+Yuv420Planes MapYuv420Planes(FrameFormat format, uint8_t* data, int width, int height);
+
+// Returns a view of |planes| starting at pixel (x, y); both must be even.
+Yuv420Planes OffsetYuv420Planes(const Yuv420Planes& planes, int x, int y);
+
+// Converts |width| x |height| pixels to BT.601 limited range 4:2:0 while
+// copying out of the source, so every source pixel is read exactly once.
+// A negative |src_stride| walks the source bottom-up from |src_first_row|. An
+// odd trailing column or row shares chroma with its neighbour.
+void ConvertToYuv420(const uint8_t* src_first_row,
+                     int src_stride,
+                     PixelLayout layout,
+                     int width,
+                     int height,
+                     const Yuv420Planes& dst);
+
+// Copies an NV12 source into a 4:2:0 frame, splitting the chroma plane when
+// |dst| is planar. Source pointers address the first luma and chroma rows; an
+// odd trailing column or row keeps the chroma sample it shares.
+void CopyNv12ToYuv420(const uint8_t* src_y,
+                      int src_y_stride,
+                      const uint8_t* src_uv,
+                      int src_uv_stride,
+                      int width,
+                      int height,
+                      const Yuv420Planes& dst);
+
+// Reorders |width| x |height| pixels of any layout into BGRx rows of |dst|.
+// A negative |src_stride| walks the source bottom-up from |src_first_row|.
+void ConvertToBgrx(const uint8_t* src_first_row,
+                   int src_stride,
+                   PixelLayout layout,
+                   int width,
+                   int height,
+                   uint8_t* dst,
+                   size_t dst_stride);
+
+// Paints black over everything of a |dst_width| x |dst_height| frame outside
+// the top-left |covered_width| x |covered_height| area.
+void FillYuv420Uncovered(const Yuv420Planes& dst,
+                         int dst_width,
+                         int dst_height,
+                         int covered_width,
+                         int covered_height);
+
+// Fastest kernel the CPU supports; picked once on first use.
+ConvertKernel ActiveConvertKernel();
+// Forces |kernel| for benchmarking. Returns false when the CPU lacks it.
+bool SetConvertKernel(ConvertKernel kernel);
+const char* ConvertKernelName(ConvertKernel kernel);
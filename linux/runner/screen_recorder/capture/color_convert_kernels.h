@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Row-pair kernels behind ConvertToYuv420. Not part of the public interface.
+namespace color_convert_internal {
+
+// Byte offset of each colour channel inside a 4-byte pixel.
+struct ChannelOffsets {
+  int b = 0;
+  int g = 1;
+  int r = 2;
+};
+
+// Converts columns [0, n) of two source rows into two luma rows and one
+// chroma row and returns n. SIMD kernels stop at their last whole block and
+// leave the rest to RowPairScalar.
+using RowPairKernel = int (*)(const uint8_t* src0,
+                              const uint8_t* src1,
+                              int width,
+                              uint8_t* y0,
+                              uint8_t* y1,
+                              uint8_t* u,
+                              uint8_t* v,
+                              bool interleaved_uv,
+                              const ChannelOffsets& offsets);
+
+// Reference implementation for columns [x_begin, width). |y1| may be null for
+// a trailing odd row, in which case |src1| should equal |src0|.
+void RowPairScalar(const uint8_t* src0,
+                   const uint8_t* src1,
+                   int x_begin,
+                   int width,
+                   uint8_t* y0,
+                   uint8_t* y1,
+                   uint8_t* u,
+                   uint8_t* v,
+                   bool interleaved_uv,
+                   const ChannelOffsets& offsets);
+
+#if defined(__x86_64__) || defined(__i386__)
+int RowPairSse41(const uint8_t* src0, const uint8_t* src1, int width, uint8_t* y0, uint8_t* y1,
+                 uint8_t* u, uint8_t* v, bool interleaved_uv, const ChannelOffsets& offsets);
+int RowPairAvx2(const uint8_t* src0, const uint8_t* src1, int width, uint8_t* y0, uint8_t* y1,
+                uint8_t* u, uint8_t* v, bool interleaved_uv, const ChannelOffsets& offsets);
+int RowPairAvx512(const uint8_t* src0, const uint8_t* src1, int width, uint8_t* y0, uint8_t* y1,
+                  uint8_t* u, uint8_t* v, bool interleaved_uv, const ChannelOffsets& offsets);
+#endif
+
+#if defined(__aarch64__)
+int RowPairNeon(const uint8_t* src0, const uint8_t* src1, int width, uint8_t* y0, uint8_t* y1,
+                uint8_t* u, uint8_t* v, bool interleaved_uv, const ChannelOffsets& offsets);
+#endif
+
+}  // namespace color_convert_internal
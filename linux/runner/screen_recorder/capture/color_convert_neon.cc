@@ -0,0 +1,80 @@
+#include "color_convert_kernels.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+namespace color_convert_internal {
+
+namespace {
+
+inline uint8x8_t NeonLuma(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  uint16x8_t sum = vmull_u8(r, vdup_n_u8(66));
+  sum = vmlal_u8(sum, g, vdup_n_u8(129));
+  sum = vmlal_u8(sum, b, vdup_n_u8(25));
+  // Rounding narrow shift is (sum + 128) >> 8.
+  return vadd_u8(vrshrn_n_u16(sum, 8), vdup_n_u8(16));
+}
+
+inline uint8x8_t NeonChroma(int16x8_t a,
+                            int16x8_t b,
+                            int16x8_t c,
+                            int16_t ca,
+                            int16_t cb,
+                            int16_t cc) {
+  int16x8_t sum = vmulq_n_s16(a, ca);
+  sum = vmlaq_n_s16(sum, b, cb);
+  sum = vmlaq_n_s16(sum, c, cc);
+  return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, 8), vdupq_n_s16(128)));
+}
+
+}  // namespace
+
+// 16 pixels per iteration; vld4 splits the channels without any shuffles.
+int RowPairNeon(const uint8_t* src0,
+                const uint8_t* src1,
+                int width,
+                uint8_t* y0,
+                uint8_t* y1,
+                uint8_t* u,
+                uint8_t* v,
+                bool interleaved_uv,
+                const ChannelOffsets& offsets) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const uint8x16x4_t row0 = vld4q_u8(src0 + static_cast<size_t>(x) * 4);
+    const uint8x16x4_t row1 = vld4q_u8(src1 + static_cast<size_t>(x) * 4);
+    const uint8x16_t b0 = row0.val[offsets.b];
+    const uint8x16_t g0 = row0.val[offsets.g];
+    const uint8x16_t r0 = row0.val[offsets.r];
+    const uint8x16_t b1 = row1.val[offsets.b];
+    const uint8x16_t g1 = row1.val[offsets.g];
+    const uint8x16_t r1 = row1.val[offsets.r];
+
+    vst1q_u8(y0 + x, vcombine_u8(NeonLuma(vget_low_u8(r0), vget_low_u8(g0), vget_low_u8(b0)),
+                                 NeonLuma(vget_high_u8(r0), vget_high_u8(g0), vget_high_u8(b0))));
+    vst1q_u8(y1 + x, vcombine_u8(NeonLuma(vget_low_u8(r1), vget_low_u8(g1), vget_low_u8(b1)),
+                                 NeonLuma(vget_high_u8(r1), vget_high_u8(g1), vget_high_u8(b1))));
+
+    // Pairwise widening adds give the 2x2 sums; rounding shift is (sum + 2) >> 2.
+    const int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(b0), b1), 2));
+    const int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(g0), g1), 2));
+    const int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(r0), r1), 2));
+    const uint8x8_t cu = NeonChroma(b, g, r, 112, -74, -38);
+    const uint8x8_t cv = NeonChroma(r, g, b, 112, -94, -18);
+    if (interleaved_uv) {
+      uint8x8x2_t uv;
+      uv.val[0] = cu;
+      uv.val[1] = cv;
+      vst2_u8(u + x, uv);
+    } else {
+      vst1_u8(u + x / 2, cu);
+      vst1_u8(v + x / 2, cv);
+    }
+  }
+  return x;
+}
+
+}  // namespace color_convert_internal
+
+#endif  // defined(__aarch64__)
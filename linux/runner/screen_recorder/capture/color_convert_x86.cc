@@ -0,0 +1,367 @@
+#include "color_convert_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Each kernel is compiled for its own instruction set through target
+// attributes, so the rest of the binary keeps the baseline ISA and the
+// dispatcher in color_convert.cc picks one at runtime.
+//
+// Channels are widened to 16-bit lanes and combined with the same fixed
+// point arithmetic as RowPairScalar, so every kernel is bit-exact with it.
+
+namespace color_convert_internal {
+
+namespace {
+
+// pshufb control that moves channel byte |offset| of four consecutive pixels
+// into 16-bit lanes [lane_base, lane_base + 4) and zeroes everything else.
+struct alignas(16) ShuffleMask {
+  int8_t bytes[16];
+};
+
+ShuffleMask ChannelMask(int offset, int lane_base) {
+  ShuffleMask mask;
+  for (int i = 0; i < 16; ++i) {
+    mask.bytes[i] = -128;
+  }
+  for (int pixel = 0; pixel < 4; ++pixel) {
+    mask.bytes[(lane_base + pixel) * 2] = static_cast<int8_t>(pixel * 4 + offset);
+  }
+  return mask;
+}
+
+struct ChannelMasks {
+  // Indexed by channel: 0 = b, 1 = g, 2 = r.
+  ShuffleMask low[3];
+  ShuffleMask high[3];
+};
+
+ChannelMasks BuildMasks(const ChannelOffsets& offsets) {
+  const int channel_offsets[3] = {offsets.b, offsets.g, offsets.r};
+  ChannelMasks masks;
+  for (int c = 0; c < 3; ++c) {
+    masks.low[c] = ChannelMask(channel_offsets[c], 0);
+    masks.high[c] = ChannelMask(channel_offsets[c], 4);
+  }
+  return masks;
+}
+
+// ---- SSE4.1: 16 pixels per iteration ----
+
+struct Sse41Masks {
+  __m128i low[3];
+  __m128i high[3];
+};
+
+__attribute__((target("sse4.1"))) inline __m128i Sse41Channel(__m128i first4,
+                                                               __m128i next4,
+                                                               __m128i low_mask,
+                                                               __m128i high_mask) {
+  return _mm_or_si128(_mm_shuffle_epi8(first4, low_mask), _mm_shuffle_epi8(next4, high_mask));
+}
+
+__attribute__((target("sse4.1"))) inline __m128i Sse41Luma(__m128i r, __m128i g, __m128i b) {
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+  sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+  return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// (c0 * a + c1 * b + c2 * c + 128) >> 8, + 128 with signed coefficients.
+__attribute__((target("sse4.1"))) inline __m128i Sse41Chroma(__m128i a,
+                                                              __m128i b,
+                                                              __m128i c,
+                                                              int16_t ca,
+                                                              int16_t cb,
+                                                              int16_t cc) {
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, _mm_set1_epi16(ca)), _mm_set1_epi16(128));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(c, _mm_set1_epi16(cc)));
+  return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// Loads 8 pixels and returns the three channels as 16-bit lanes.
+__attribute__((target("sse4.1"))) inline void Sse41Load8(const uint8_t* src,
+                                                         const Sse41Masks& masks,
+                                                         __m128i* channels) {
+  const __m128i first4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  const __m128i next4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+  for (int c = 0; c < 3; ++c) {
+    channels[c] = Sse41Channel(first4, next4, masks.low[c], masks.high[c]);
+  }
+}
+
+}  // namespace
+
+__attribute__((target("sse4.1"))) int RowPairSse41(const uint8_t* src0,
+                                                    const uint8_t* src1,
+                                                    int width,
+                                                    uint8_t* y0,
+                                                    uint8_t* y1,
+                                                    uint8_t* u,
+                                                    uint8_t* v,
+                                                    bool interleaved_uv,
+                                                    const ChannelOffsets& offsets) {
+  const ChannelMasks raw = BuildMasks(offsets);
+  Sse41Masks masks;
+  for (int c = 0; c < 3; ++c) {
+    masks.low[c] = _mm_load_si128(reinterpret_cast<const __m128i*>(raw.low[c].bytes));
+    masks.high[c] = _mm_load_si128(reinterpret_cast<const __m128i*>(raw.high[c].bytes));
+  }
+  const __m128i two = _mm_set1_epi16(2);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    // [row][half][channel]
+    __m128i px[2][2][3];
+    const uint8_t* rows[2] = {src0, src1};
+    for (int row = 0; row < 2; ++row) {
+      Sse41Load8(rows[row] + static_cast<size_t>(x) * 4, masks, px[row][0]);
+      Sse41Load8(rows[row] + static_cast<size_t>(x) * 4 + 32, masks, px[row][1]);
+    }
+
+    uint8_t* luma_rows[2] = {y0, y1};
+    for (int row = 0; row < 2; ++row) {
+      const __m128i luma_low = Sse41Luma(px[row][0][2], px[row][0][1], px[row][0][0]);
+      const __m128i luma_high = Sse41Luma(px[row][1][2], px[row][1][1], px[row][1][0]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(luma_rows[row] + x),
+                       _mm_packus_epi16(luma_low, luma_high));
+    }
+
+    // 2x2 averages: add the rows, then neighbouring columns.
+    __m128i avg[3];
+    for (int c = 0; c < 3; ++c) {
+      const __m128i low = _mm_add_epi16(px[0][0][c], px[1][0][c]);
+      const __m128i high = _mm_add_epi16(px[0][1][c], px[1][1][c]);
+      avg[c] = _mm_srli_epi16(_mm_add_epi16(_mm_hadd_epi16(low, high), two), 2);
+    }
+    const __m128i cu = Sse41Chroma(avg[0], avg[1], avg[2], 112, -74, -38);
+    const __m128i cv = Sse41Chroma(avg[2], avg[1], avg[0], 112, -94, -18);
+    const __m128i packed = _mm_packus_epi16(cu, cv);
+    if (interleaved_uv) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x),
+                       _mm_unpacklo_epi8(packed, _mm_srli_si128(packed, 8)));
+    } else {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), packed);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_srli_si128(packed, 8));
+    }
+  }
+  return x;
+}
+
+// ---- AVX2: 32 pixels per iteration ----
+
+namespace {
+
+struct Avx2Masks {
+  __m256i low[3];
+  __m256i high[3];
+};
+
+__attribute__((target("avx2"))) inline __m256i Avx2Luma(__m256i r, __m256i g, __m256i b) {
+  __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+  sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+  sum = _mm256_add_epi16(sum, _mm256_set1_epi16(128));
+  return _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+}
+
+__attribute__((target("avx2"))) inline __m256i Avx2Chroma(__m256i a,
+                                                          __m256i b,
+                                                          __m256i c,
+                                                          int16_t ca,
+                                                          int16_t cb,
+                                                          int16_t cc) {
+  __m256i sum =
+      _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_set1_epi16(ca)), _mm256_set1_epi16(128));
+  sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(b, _mm256_set1_epi16(cb)));
+  sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(c, _mm256_set1_epi16(cc)));
+  return _mm256_add_epi16(_mm256_srai_epi16(sum, 8), _mm256_set1_epi16(128));
+}
+
+// Loads 16 pixels and returns the three channels as 16-bit lanes in pixel
+// order. pshufb cannot cross 128-bit lanes, so the halves are regrouped first:
+// the low lane gathers pixels 0-7 and the high lane pixels 8-15.
+__attribute__((target("avx2"))) inline void Avx2Load16(const uint8_t* src,
+                                                       const Avx2Masks& masks,
+                                                       __m256i* channels) {
+  const __m256i p0_7 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+  const __m256i p8_15 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+  const __m256i first4 = _mm256_permute2x128_si256(p0_7, p8_15, 0x20);
+  const __m256i next4 = _mm256_permute2x128_si256(p0_7, p8_15, 0x31);
+  for (int c = 0; c < 3; ++c) {
+    channels[c] = _mm256_or_si256(_mm256_shuffle_epi8(first4, masks.low[c]),
+                                  _mm256_shuffle_epi8(next4, masks.high[c]));
+  }
+}
+
+}  // namespace
+
+__attribute__((target("avx2"))) int RowPairAvx2(const uint8_t* src0,
+                                                 const uint8_t* src1,
+                                                 int width,
+                                                 uint8_t* y0,
+                                                 uint8_t* y1,
+                                                 uint8_t* u,
+                                                 uint8_t* v,
+                                                 bool interleaved_uv,
+                                                 const ChannelOffsets& offsets) {
+  const ChannelMasks raw = BuildMasks(offsets);
+  Avx2Masks masks;
+  for (int c = 0; c < 3; ++c) {
+    masks.low[c] = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(raw.low[c].bytes)));
+    masks.high[c] = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(raw.high[c].bytes)));
+  }
+  const __m256i two = _mm256_set1_epi16(2);
+  // Undoes the in-lane interleave of packus/hadd: U then V, each in order.
+  const __m256i chroma_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i px[2][2][3];
+    const uint8_t* rows[2] = {src0, src1};
+    for (int row = 0; row < 2; ++row) {
+      Avx2Load16(rows[row] + static_cast<size_t>(x) * 4, masks, px[row][0]);
+      Avx2Load16(rows[row] + static_cast<size_t>(x) * 4 + 64, masks, px[row][1]);
+    }
+
+    uint8_t* luma_rows[2] = {y0, y1};
+    for (int row = 0; row < 2; ++row) {
+      const __m256i luma_low = Avx2Luma(px[row][0][2], px[row][0][1], px[row][0][0]);
+      const __m256i luma_high = Avx2Luma(px[row][1][2], px[row][1][1], px[row][1][0]);
+      const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(luma_low, luma_high),
+                                                      0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(luma_rows[row] + x), packed);
+    }
+
+    __m256i avg[3];
+    for (int c = 0; c < 3; ++c) {
+      const __m256i low = _mm256_add_epi16(px[0][0][c], px[1][0][c]);
+      const __m256i high = _mm256_add_epi16(px[0][1][c], px[1][1][c]);
+      avg[c] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_hadd_epi16(low, high), two), 2);
+    }
+    const __m256i cu = Avx2Chroma(avg[0], avg[1], avg[2], 112, -74, -38);
+    const __m256i cv = Avx2Chroma(avg[2], avg[1], avg[0], 112, -94, -18);
+    const __m256i packed =
+        _mm256_permutevar8x32_epi32(_mm256_packus_epi16(cu, cv), chroma_order);
+    const __m128i u16 = _mm256_castsi256_si128(packed);
+    const __m128i v16 = _mm256_extracti128_si256(packed, 1);
+    if (interleaved_uv) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(u16, v16));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x + 16), _mm_unpackhi_epi8(u16, v16));
+    } else {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), u16);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), v16);
+    }
+  }
+  return x;
+}
+
+// ---- AVX-512 (F/BW/VL): 32 pixels per iteration ----
+
+namespace {
+
+struct Avx512Masks {
+  __m512i low[3];
+  __m512i high[3];
+};
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) inline __m512i Avx512Luma(__m512i r,
+                                                                                 __m512i g,
+                                                                                 __m512i b) {
+  __m512i sum = _mm512_add_epi16(_mm512_mullo_epi16(r, _mm512_set1_epi16(66)),
+                                 _mm512_mullo_epi16(g, _mm512_set1_epi16(129)));
+  sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(b, _mm512_set1_epi16(25)));
+  sum = _mm512_add_epi16(sum, _mm512_set1_epi16(128));
+  return _mm512_add_epi16(_mm512_srli_epi16(sum, 8), _mm512_set1_epi16(16));
+}
+
+// The zero-masked forms of the narrowing moves and this broadcast compile to
+// the same instructions as the plain intrinsics but avoid GCC's
+// -Wmaybe-uninitialized false positive on their "undefined" operand.
+__attribute__((target("avx512f,avx512bw,avx512vl"))) inline __m512i Avx512Broadcast(
+    const ShuffleMask& mask) {
+  return _mm512_maskz_broadcast_i32x4(
+      0xFFFF, _mm_load_si128(reinterpret_cast<const __m128i*>(mask.bytes)));
+}
+
+// Loads 32 pixels and returns the three channels as 16-bit lanes in pixel
+// order; 128-bit lane k ends up holding pixels 8k to 8k + 7.
+__attribute__((target("avx512f,avx512bw,avx512vl"))) inline void Avx512Load32(
+    const uint8_t* src, const Avx512Masks& masks, __m512i* channels) {
+  const __m512i p0_15 = _mm512_loadu_si512(src);
+  const __m512i p16_31 = _mm512_loadu_si512(src + 64);
+  const __m512i first4 =
+      _mm512_permutex2var_epi64(p0_15, _mm512_setr_epi64(0, 1, 4, 5, 8, 9, 12, 13), p16_31);
+  const __m512i next4 =
+      _mm512_permutex2var_epi64(p0_15, _mm512_setr_epi64(2, 3, 6, 7, 10, 11, 14, 15), p16_31);
+  for (int c = 0; c < 3; ++c) {
+    channels[c] = _mm512_or_si512(_mm512_shuffle_epi8(first4, masks.low[c]),
+                                  _mm512_shuffle_epi8(next4, masks.high[c]));
+  }
+}
+
+}  // namespace
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) int RowPairAvx512(
+    const uint8_t* src0,
+    const uint8_t* src1,
+    int width,
+    uint8_t* y0,
+    uint8_t* y1,
+    uint8_t* u,
+    uint8_t* v,
+    bool interleaved_uv,
+    const ChannelOffsets& offsets) {
+  const ChannelMasks raw = BuildMasks(offsets);
+  Avx512Masks masks;
+  for (int c = 0; c < 3; ++c) {
+    masks.low[c] = Avx512Broadcast(raw.low[c]);
+    masks.high[c] = Avx512Broadcast(raw.high[c]);
+  }
+  const __m512i ones = _mm512_set1_epi16(1);
+  const __m256i two = _mm256_set1_epi16(2);
+
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m512i px[2][3];
+    Avx512Load32(src0 + static_cast<size_t>(x) * 4, masks, px[0]);
+    Avx512Load32(src1 + static_cast<size_t>(x) * 4, masks, px[1]);
+
+    uint8_t* luma_rows[2] = {y0, y1};
+    for (int row = 0; row < 2; ++row) {
+      const __m512i luma = Avx512Luma(px[row][2], px[row][1], px[row][0]);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(luma_rows[row] + x),
+                          _mm512_maskz_cvtepi16_epi8(0xFFFFFFFF, luma));
+    }
+
+    // Row sums, then madd against ones adds neighbouring columns in place.
+    __m256i avg[3];
+    for (int c = 0; c < 3; ++c) {
+      const __m512i pairs = _mm512_madd_epi16(_mm512_add_epi16(px[0][c], px[1][c]), ones);
+      const __m256i sums = _mm512_maskz_cvtepi32_epi16(0xFFFF, pairs);
+      avg[c] = _mm256_srli_epi16(_mm256_add_epi16(sums, two), 2);
+    }
+    const __m256i cu = Avx2Chroma(avg[0], avg[1], avg[2], 112, -74, -38);
+    const __m256i cv = Avx2Chroma(avg[2], avg[1], avg[0], 112, -94, -18);
+    const __m128i u16 = _mm256_maskz_cvtepi16_epi8(0xFFFF, cu);
+    const __m128i v16 = _mm256_maskz_cvtepi16_epi8(0xFFFF, cv);
+    if (interleaved_uv) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(u16, v16));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x + 16), _mm_unpackhi_epi8(u16, v16));
+    } else {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), u16);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), v16);
+    }
+  }
+  return x;
+}
+
+}  // namespace color_convert_internal
+
+#endif  // defined(__x86_64__) || defined(__i386__)
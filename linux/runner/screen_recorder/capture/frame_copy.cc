@@ -0,0 +1,64 @@
+#include "frame_copy.h"
+
+#include <cstring>
+
+void CopyRows(const uint8_t* src_first_row,
+              int src_stride,
+              uint8_t* dst,
+              size_t dst_stride,
+              int rows,
+              size_t row_bytes) {
+  if (src_stride > 0 && static_cast<size_t>(src_stride) == dst_stride && row_bytes == dst_stride) {
+    std::memcpy(dst, src_first_row, static_cast<size_t>(rows) * dst_stride);
+    return;
+  }
+  const ptrdiff_t step = static_cast<ptrdiff_t>(src_stride);
+  const uint8_t* src_row = src_first_row;
+  for (int row = 0; row < rows; ++row) {
+    std::memcpy(dst + static_cast<size_t>(row) * dst_stride, src_row, row_bytes);
+    src_row += step;
+  }
+}
+
+void CopyRect(const uint8_t* src_first_row,
+              int src_stride,
+              uint8_t* dst,
+              size_t dst_stride,
+              int x,
+              int y,
+              int width,
+              int height) {
+  const size_t column_offset = static_cast<size_t>(x) * 4;
+  const size_t row_bytes = static_cast<size_t>(width) * 4;
+  const ptrdiff_t step = static_cast<ptrdiff_t>(src_stride);
+  const uint8_t* src_row = src_first_row + static_cast<ptrdiff_t>(y) * step + column_offset;
+  uint8_t* dst_row = dst + static_cast<size_t>(y) * dst_stride + column_offset;
+  for (int row = 0; row < height; ++row) {
+    std::memcpy(dst_row, src_row, row_bytes);
+    src_row += step;
+    dst_row += dst_stride;
+  }
+}
+
+int ResolveSourceStride(int32_t chunk_stride,
+                        int previous_stride,
+                        uint32_t chunk_size,
+                        int width,
+                        int height,
+                        bool nv12) {
+  if (chunk_stride != 0) {
+    return static_cast<int>(chunk_stride);
+  }
+  if (previous_stride != 0) {
+    return previous_stride;
+  }
+  // Some PipeWire buffers omit chunk stride; infer from payload when possible.
+  const int min_row_bytes = width * (nv12 ? 1 : 4);
+  if (height > 0 && !nv12) {
+    const int inferred = static_cast<int>(chunk_size / static_cast<uint32_t>(height));
+    if (inferred >= min_row_bytes) {
+      return inferred;
+    }
+  }
+  return min_row_bytes;
+}
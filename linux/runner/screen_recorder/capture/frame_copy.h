@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Copies |rows| rows of |row_bytes| each into a tightly packed destination.
+// A negative |src_stride| walks the source bottom-up starting at |src_first_row|.
+void CopyRows(const uint8_t* src_first_row,
+              int src_stride,
+              uint8_t* dst,
+              size_t dst_stride,
+              int rows,
+              size_t row_bytes);
+
+// Copies the |width| x |height| pixel rectangle at (x, y) of a 4-byte-per-pixel
+// source into the same position of a tightly packed destination.
+void CopyRect(const uint8_t* src_first_row,
+              int src_stride,
+              uint8_t* dst,
+              size_t dst_stride,
+              int x,
+              int y,
+              int width,
+              int height);
+
+// Row pitch of a |width| x |height| source buffer of |chunk_size| bytes. The
+// chunk's own stride wins, then |previous_stride| from earlier buffers of the
+// same format; otherwise it is inferred from the payload size, or assumed
+// tight. NV12 strides count luma bytes, one per pixel.
+int ResolveSourceStride(int32_t chunk_stride,
+                        int previous_stride,
+                        uint32_t chunk_size,
+                        int width,
+                        int height,
+                        bool nv12);
+
+// First image row of a data block holding |rows| rows: the block start, or
+// its last row when |stride| is negative.
+inline const uint8_t* SourceFirstRow(const uint8_t* block, int stride, int rows) {
+  if (stride >= 0 || rows <= 0) {
+    return block;
+  }
+  return block + static_cast<size_t>(rows - 1) * static_cast<size_t>(-static_cast<int64_t>(stride));
+}
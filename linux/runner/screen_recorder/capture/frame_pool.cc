@@ -0,0 +1,115 @@
+#include "frame_pool.h"
+
+#include <cstdlib>
+#include <utility>
+
+#include <unistd.h>
+
+namespace {
+
+size_t PageSize() {
+  static const size_t page_size = [] {
+    const long value = sysconf(_SC_PAGESIZE);
+    return value > 0 ? static_cast<size_t>(value) : static_cast<size_t>(4096);
+  }();
+  return page_size;
+}
+
+}  // namespace
+
+FrameHandle::FrameHandle(const FrameHandle& other) : slot_(other.slot_) {
+  if (slot_) {
+    slot_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+FrameHandle::FrameHandle(FrameHandle&& other) noexcept : slot_(other.slot_) {
+  other.slot_ = nullptr;
+}
+
+FrameHandle& FrameHandle::operator=(const FrameHandle& other) {
+  if (this != &other) {
+    FrameHandle copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    slot_ = other.slot_;
+    other.slot_ = nullptr;
+  }
+  return *this;
+}
+
+FrameHandle::~FrameHandle() {
+  Reset();
+}
+
+void FrameHandle::Reset() {
+  if (slot_) {
+    slot_->refs.fetch_sub(1, std::memory_order_acq_rel);
+    slot_ = nullptr;
+  }
+}
+
+FramePool::FramePool(size_t slot_count) {
+  slots_.reserve(slot_count);
+  for (size_t i = 0; i < slot_count; ++i) {
+    slots_.push_back(std::make_unique<FrameSlot>());
+  }
+}
+
+FramePool::~FramePool() {
+  for (auto& slot : slots_) {
+    std::free(slot->data);
+  }
+}
+
+bool FramePool::Grow(FrameSlot* slot, size_t size) {
+  if (slot->capacity >= size) {
+    return true;
+  }
+  const size_t page_size = PageSize();
+  const size_t capacity = ((size + page_size - 1) / page_size) * page_size;
+  void* data = nullptr;
+  if (posix_memalign(&data, page_size, capacity) != 0) {
+    return false;
+  }
+  std::free(slot->data);
+  slot->data = static_cast<uint8_t*>(data);
+  slot->capacity = capacity;
+  return true;
+}
+
+FrameHandle FramePool::Acquire(size_t size) {
+  for (auto& slot : slots_) {
+    uint32_t expected = 0;
+    if (!slot->refs.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+      continue;
+    }
+    if (!Grow(slot.get(), size)) {
+      slot->refs.store(0, std::memory_order_release);
+      return FrameHandle();
+    }
+    slot->size = size;
+    return FrameHandle(slot.get());
+  }
+  exhausted_count_.fetch_add(1, std::memory_order_relaxed);
+  return FrameHandle();
+}
+
+void FramePool::Reserve(size_t size) {
+  for (auto& slot : slots_) {
+    uint32_t expected = 0;
+    if (!slot->refs.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+      continue;
+    }
+    Grow(slot.get(), size);
+    slot->refs.store(0, std::memory_order_release);
+  }
+}
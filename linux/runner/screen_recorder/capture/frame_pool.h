@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct FrameSlot {
+  uint8_t* data = nullptr;
+  size_t capacity = 0;
+  size_t size = 0;
+  std::atomic<uint32_t> refs {0};
+};
+
+// Shared, reference-counted view of one pooled frame slot. Copying a handle
+// shares the slot; the slot becomes reusable once the last handle is released.
+class FrameHandle {
+ public:
+  FrameHandle() = default;
+  FrameHandle(const FrameHandle& other);
+  FrameHandle(FrameHandle&& other) noexcept;
+  FrameHandle& operator=(const FrameHandle& other);
+  FrameHandle& operator=(FrameHandle&& other) noexcept;
+  ~FrameHandle();
+
+  explicit operator bool() const { return slot_ != nullptr; }
+  uint8_t* data() const { return slot_ ? slot_->data : nullptr; }
+  size_t size() const { return slot_ ? slot_->size : 0; }
+  bool unique() const { return slot_ && slot_->refs.load(std::memory_order_acquire) == 1; }
+  void Reset();
+
+ private:
+  friend class FramePool;
+  explicit FrameHandle(FrameSlot* slot) : slot_(slot) {}
+
+  FrameSlot* slot_ = nullptr;
+};
+
+// Fixed set of page-aligned frame slots. Acquire is lock-free and never blocks;
+// when every slot is still referenced it returns an empty handle. The pool must
+// outlive every handle it has produced.
+class FramePool {
+ public:
+  explicit FramePool(size_t slot_count);
+  ~FramePool();
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  FrameHandle Acquire(size_t size);
+  // Grows every currently unused slot to at least |size| bytes so that the
+  // capture callback does not allocate after a format change.
+  void Reserve(size_t size);
+
+  size_t slot_count() const { return slots_.size(); }
+  uint64_t exhausted_count() const { return exhausted_count_.load(std::memory_order_relaxed); }
+
+ private:
+  static bool Grow(FrameSlot* slot, size_t size);
+
+  std::vector<std::unique_ptr<FrameSlot>> slots_;
+  std::atomic<uint64_t> exhausted_count_ {0};
+};
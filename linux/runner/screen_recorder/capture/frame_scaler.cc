@@ -0,0 +1,442 @@
+#include "frame_scaler.h"
+
+#include "frame_scaler_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+using frame_scaler_internal::BlendRowsKernel;
+using frame_scaler_internal::Box2RowKernel;
+using frame_scaler_internal::Sum3RowsKernel;
+
+namespace {
+
+// Fractions are 7-bit so that (b - a) * weight still fits in a signed 16-bit lane.
+constexpr int kWeightBits = 7;
+constexpr int kWeightOne = 1 << kWeightBits;
+// ((sum + 4) * kDivideBy9) >> 16 equals (sum + 4) / 9 for every 3x3 sum of bytes.
+constexpr uint32_t kDivideBy9 = 7282;
+
+int Box2RowScalar(const uint8_t* src0,
+                  const uint8_t* src1,
+                  uint8_t* dst,
+                  int dst_bytes,
+                  int bytes_per_pixel) {
+  for (int i = 0; i < dst_bytes; ++i) {
+    const int pixel = i / bytes_per_pixel;
+    const int left = pixel * 2 * bytes_per_pixel + i % bytes_per_pixel;
+    const int right = left + bytes_per_pixel;
+    dst[i] = static_cast<uint8_t>((src0[left] + src0[right] + src1[left] + src1[right] + 2) >> 2);
+  }
+  return dst_bytes;
+}
+
+int Sum3RowsScalar(const uint8_t* src0,
+                   const uint8_t* src1,
+                   const uint8_t* src2,
+                   uint16_t* dst,
+                   int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    dst[i] = static_cast<uint16_t>(src0[i] + src1[i] + src2[i]);
+  }
+  return bytes;
+}
+
+int BlendRowsScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int bytes, int weight) {
+  for (int i = 0; i < bytes; ++i) {
+    const int a = row0[i];
+    dst[i] = static_cast<uint8_t>(a + (((row1[i] - a) * weight + kWeightOne / 2) >> kWeightBits));
+  }
+  return bytes;
+}
+
+// Horizontal 3:1 step of the box filter over 16-bit column sums.
+template <int kBytesPerPixel>
+void Box3Columns(const uint16_t* sums, uint8_t* dst, int dst_width) {
+  for (int x = 0; x < dst_width; ++x) {
+    const uint16_t* in = sums + x * 3 * kBytesPerPixel;
+    for (int c = 0; c < kBytesPerPixel; ++c) {
+      const uint32_t sum = in[c] + in[c + kBytesPerPixel] + in[c + 2 * kBytesPerPixel];
+      dst[x * kBytesPerPixel + c] = static_cast<uint8_t>(((sum + 4) * kDivideBy9) >> 16);
+    }
+  }
+}
+
+// Horizontal bilinear pass of one source row.
+template <int kBytesPerPixel>
+void FilterColumns(const uint8_t* src,
+                   const std::vector<int>& index,
+                   const std::vector<uint8_t>& weight,
+                   uint8_t* dst) {
+  const size_t width = index.size();
+  for (size_t x = 0; x < width; ++x) {
+    const int w = weight[x];
+    const uint8_t* left = src + index[x] * kBytesPerPixel;
+    // A zero weight may sit on the last column, so never read past it.
+    const uint8_t* right = w ? left + kBytesPerPixel : left;
+    for (int c = 0; c < kBytesPerPixel; ++c) {
+      const int a = left[c];
+      dst[x * kBytesPerPixel + c] =
+          static_cast<uint8_t>(a + (((right[c] - a) * w + kWeightOne / 2) >> kWeightBits));
+    }
+  }
+}
+
+struct Kernels {
+  Box2RowKernel box2 = Box2RowScalar;
+  Sum3RowsKernel sum3 = Sum3RowsScalar;
+  BlendRowsKernel blend = BlendRowsScalar;
+};
+
+bool CpuSupports(ScaleKernel kernel) {
+  switch (kernel) {
+    case ScaleKernel::kScalar:
+      return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case ScaleKernel::kAvx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__aarch64__)
+    case ScaleKernel::kNeon:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+Kernels KernelsFor(ScaleKernel kernel) {
+  Kernels kernels;
+  switch (kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    case ScaleKernel::kAvx2:
+      kernels.box2 = frame_scaler_internal::Box2RowAvx2;
+      kernels.sum3 = frame_scaler_internal::Sum3RowsAvx2;
+      kernels.blend = frame_scaler_internal::BlendRowsAvx2;
+      break;
+#endif
+#if defined(__aarch64__)
+    case ScaleKernel::kNeon:
+      kernels.box2 = frame_scaler_internal::Box2RowNeon;
+      kernels.sum3 = frame_scaler_internal::Sum3RowsNeon;
+      kernels.blend = frame_scaler_internal::BlendRowsNeon;
+      break;
+#endif
+    default:
+      break;
+  }
+  return kernels;
+}
+
+ScaleKernel DetectKernel() {
+  for (ScaleKernel kernel : {ScaleKernel::kAvx2, ScaleKernel::kNeon}) {
+    if (CpuSupports(kernel)) {
+      return kernel;
+    }
+  }
+  return ScaleKernel::kScalar;
+}
+
+std::atomic<ScaleKernel>& ActiveKernelSlot() {
+  static std::atomic<ScaleKernel> active {DetectKernel()};
+  return active;
+}
+
+// Centre-aligned sample positions: output |i| reads source (i + 0.5) * src / dst - 0.5.
+void BuildTaps(int src_size, int dst_size, std::vector<int>* index, std::vector<uint8_t>* weight) {
+  index->resize(static_cast<size_t>(dst_size));
+  weight->resize(static_cast<size_t>(dst_size));
+  const int64_t step = (static_cast<int64_t>(src_size) << 16) / dst_size;
+  for (int i = 0; i < dst_size; ++i) {
+    const int64_t position = std::max<int64_t>(0, step / 2 - 0x8000 + i * step);
+    int left = static_cast<int>(position >> 16);
+    int fraction = static_cast<int>(((position & 0xFFFF) + (1 << 8)) >> 9);
+    if (left >= src_size - 1) {
+      left = src_size - 1;
+      fraction = 0;
+    }
+    (*index)[static_cast<size_t>(i)] = left;
+    (*weight)[static_cast<size_t>(i)] = static_cast<uint8_t>(fraction);
+  }
+}
+
+}  // namespace
+
+void FrameScaler::Configure(FrameFormat format,
+                            int src_width,
+                            int src_height,
+                            int dst_width,
+                            int dst_height) {
+  Reset();
+  if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) {
+    return;
+  }
+  src_width_ = src_width;
+  src_height_ = src_height;
+
+  const size_t src_luma = static_cast<size_t>(src_width) * static_cast<size_t>(src_height);
+  const size_t dst_luma = static_cast<size_t>(dst_width) * static_cast<size_t>(dst_height);
+  if (format == FrameFormat::kBgr0) {
+    Plane plane;
+    plane.bytes_per_pixel = 4;
+    planes_.push_back(std::move(plane));
+  } else {
+    planes_.resize(format == FrameFormat::kNv12 ? 2 : 3);
+    planes_[1].src_offset = src_luma;
+    planes_[1].dst_offset = dst_luma;
+    planes_[1].rows_per_two = 1;
+    if (format == FrameFormat::kNv12) {
+      planes_[1].bytes_per_pixel = 2;
+    } else {
+      planes_[2] = planes_[1];
+      planes_[2].src_offset += src_luma / 4;
+      planes_[2].dst_offset += dst_luma / 4;
+    }
+  }
+
+  size_t widest_row = 0;
+  size_t widest_sums = 0;
+  for (Plane& plane : planes_) {
+    const int divisor = plane.rows_per_two == 1 ? 2 : 1;
+    ConfigurePlane(&plane, src_width / divisor, src_height / divisor, dst_width / divisor,
+                   dst_height / divisor);
+    for (const Stage& stage : plane.stages) {
+      const size_t bytes_per_pixel = static_cast<size_t>(plane.bytes_per_pixel);
+      widest_row = std::max(widest_row, static_cast<size_t>(stage.dst_width) * bytes_per_pixel);
+      if (stage.method == Method::kBox3) {
+        widest_sums =
+            std::max(widest_sums, static_cast<size_t>(stage.dst_width) * 3 * bytes_per_pixel);
+      }
+    }
+  }
+  row_cache_[0].resize(widest_row);
+  row_cache_[1].resize(widest_row);
+  row_sums_.resize(widest_sums);
+}
+
+void FrameScaler::Reset() {
+  planes_.clear();
+  src_width_ = 0;
+  src_height_ = 0;
+}
+
+void FrameScaler::ConfigurePlane(Plane* plane,
+                                 int src_width,
+                                 int src_height,
+                                 int dst_width,
+                                 int dst_height) {
+  const size_t bytes_per_pixel = static_cast<size_t>(plane->bytes_per_pixel);
+  int width = src_width;
+  int height = src_height;
+  for (;;) {
+    Stage stage;
+    stage.src_width = width;
+    stage.src_height = height;
+    stage.dst_width = dst_width;
+    stage.dst_height = dst_height;
+    if (width == dst_width * 2 && height == dst_height * 2) {
+      stage.method = Method::kBox2;
+    } else if (width == dst_width * 3 && height == dst_height * 3) {
+      stage.method = Method::kBox3;
+    } else if (width >= dst_width * 2 && height >= dst_height * 2) {
+      // Two bilinear taps alias badly past 2:1, so halve first like a mip chain.
+      stage.method = Method::kBox2;
+      stage.dst_width = width / 2;
+      stage.dst_height = height / 2;
+      stage.buffer.resize(static_cast<size_t>(stage.dst_width) *
+                          static_cast<size_t>(stage.dst_height) * bytes_per_pixel);
+      width = stage.dst_width;
+      height = stage.dst_height;
+      plane->stages.push_back(std::move(stage));
+      continue;
+    } else {
+      stage.method = Method::kBilinear;
+      BuildTaps(width, dst_width, &stage.x_index, &stage.x_weight);
+      BuildTaps(height, dst_height, &stage.y_index, &stage.y_weight);
+    }
+    plane->stages.push_back(std::move(stage));
+    return;
+  }
+}
+
+void FrameScaler::Scale(const uint8_t* src, uint8_t* dst) {
+  ScaleRows(src, dst, 0, src_height_);
+}
+
+void FrameScaler::ScaleRows(const uint8_t* src, uint8_t* dst, int src_row_begin, int src_row_end) {
+  src_row_begin = std::max(src_row_begin, 0);
+  src_row_end = std::min(src_row_end, src_height_);
+  if (src_row_begin >= src_row_end) {
+    return;
+  }
+  for (Plane& plane : planes_) {
+    int begin = src_row_begin;
+    int end = src_row_end;
+    if (plane.rows_per_two == 1) {
+      begin /= 2;
+      end = (end + 1) / 2;
+    }
+    const uint8_t* input = src + plane.src_offset;
+    for (size_t i = 0; i < plane.stages.size(); ++i) {
+      Stage& stage = plane.stages[i];
+      int out_begin = 0;
+      int out_end = 0;
+      MapRows(stage, begin, end, &out_begin, &out_end);
+      if (out_begin >= out_end) {
+        break;
+      }
+      uint8_t* output = i + 1 == plane.stages.size() ? dst + plane.dst_offset : stage.buffer.data();
+      RunStage(plane, &stage, input, output, out_begin, out_end);
+      input = output;
+      begin = out_begin;
+      end = out_end;
+    }
+  }
+}
+
+void FrameScaler::MapRows(const Stage& stage, int begin, int end, int* out_begin, int* out_end) {
+  switch (stage.method) {
+    case Method::kBox2:
+      *out_begin = begin / 2;
+      *out_end = std::min((end + 1) / 2, stage.dst_height);
+      return;
+    case Method::kBox3:
+      *out_begin = begin / 3;
+      *out_end = std::min((end + 2) / 3, stage.dst_height);
+      return;
+    case Method::kBilinear:
+      // Rows are monotonic in y_index and read y_index and y_index + 1.
+      *out_begin = static_cast<int>(
+          std::lower_bound(stage.y_index.begin(), stage.y_index.end(), begin - 1) -
+          stage.y_index.begin());
+      *out_end = static_cast<int>(
+          std::upper_bound(stage.y_index.begin(), stage.y_index.end(), end - 1) -
+          stage.y_index.begin());
+      return;
+  }
+}
+
+void FrameScaler::RunStage(const Plane& plane,
+                           Stage* stage,
+                           const uint8_t* src,
+                           uint8_t* dst,
+                           int dst_row_begin,
+                           int dst_row_end) {
+  const Kernels kernels = KernelsFor(ActiveKernelSlot().load(std::memory_order_relaxed));
+  const int bytes_per_pixel = plane.bytes_per_pixel;
+  const size_t src_stride = static_cast<size_t>(stage->src_width) * bytes_per_pixel;
+  const int dst_bytes = stage->dst_width * bytes_per_pixel;
+  const size_t dst_stride = static_cast<size_t>(dst_bytes);
+
+  switch (stage->method) {
+    case Method::kBox2:
+      for (int y = dst_row_begin; y < dst_row_end; ++y) {
+        const uint8_t* src0 = src + static_cast<size_t>(y) * 2 * src_stride;
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_stride;
+        const int done = kernels.box2(src0, src0 + src_stride, out, dst_bytes, bytes_per_pixel);
+        if (done < dst_bytes) {
+          const int pixel = done / bytes_per_pixel;
+          Box2RowScalar(src0 + pixel * 2 * bytes_per_pixel,
+                        src0 + src_stride + pixel * 2 * bytes_per_pixel, out + done,
+                        dst_bytes - done, bytes_per_pixel);
+        }
+      }
+      return;
+
+    case Method::kBox3:
+      for (int y = dst_row_begin; y < dst_row_end; ++y) {
+        const uint8_t* src0 = src + static_cast<size_t>(y) * 3 * src_stride;
+        const int sum_bytes = dst_bytes * 3;
+        uint16_t* sums = row_sums_.data();
+        const int done =
+            kernels.sum3(src0, src0 + src_stride, src0 + 2 * src_stride, sums, sum_bytes);
+        if (done < sum_bytes) {
+          Sum3RowsScalar(src0 + done, src0 + src_stride + done, src0 + 2 * src_stride + done,
+                         sums + done, sum_bytes - done);
+        }
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_stride;
+        switch (bytes_per_pixel) {
+          case 1:
+            Box3Columns<1>(sums, out, stage->dst_width);
+            break;
+          case 2:
+            Box3Columns<2>(sums, out, stage->dst_width);
+            break;
+          default:
+            Box3Columns<4>(sums, out, stage->dst_width);
+            break;
+        }
+      }
+      return;
+
+    case Method::kBilinear: {
+      row_cache_source_[0] = -1;
+      row_cache_source_[1] = -1;
+      // Horizontal pass of source row |row|, cached by row parity so that the
+      // two taps of an output row never evict each other.
+      auto filtered_row = [&](int row) -> const uint8_t* {
+        const int slot = row & 1;
+        uint8_t* cache = row_cache_[slot].data();
+        if (row_cache_source_[slot] == row) {
+          return cache;
+        }
+        const uint8_t* in = src + static_cast<size_t>(row) * src_stride;
+        switch (bytes_per_pixel) {
+          case 1:
+            FilterColumns<1>(in, stage->x_index, stage->x_weight, cache);
+            break;
+          case 2:
+            FilterColumns<2>(in, stage->x_index, stage->x_weight, cache);
+            break;
+          default:
+            FilterColumns<4>(in, stage->x_index, stage->x_weight, cache);
+            break;
+        }
+        row_cache_source_[slot] = row;
+        return cache;
+      };
+
+      for (int y = dst_row_begin; y < dst_row_end; ++y) {
+        const int top = stage->y_index[static_cast<size_t>(y)];
+        const int weight = stage->y_weight[static_cast<size_t>(y)];
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_stride;
+        const uint8_t* row0 = filtered_row(top);
+        if (weight == 0) {
+          std::memcpy(out, row0, dst_stride);
+          continue;
+        }
+        const uint8_t* row1 = filtered_row(top + 1);
+        const int done = kernels.blend(row0, row1, out, dst_bytes, weight);
+        if (done < dst_bytes) {
+          BlendRowsScalar(row0 + done, row1 + done, out + done, dst_bytes - done, weight);
+        }
+      }
+      return;
+    }
+  }
+}
+
+ScaleKernel ActiveScaleKernel() {
+  return ActiveKernelSlot().load(std::memory_order_relaxed);
+}
+
+bool SetScaleKernel(ScaleKernel kernel) {
+  if (!CpuSupports(kernel)) {
+    return false;
+  }
+  ActiveKernelSlot().store(kernel, std::memory_order_relaxed);
+  return true;
+}
+
+const char* ScaleKernelName(ScaleKernel kernel) {
+  switch (kernel) {
+    case ScaleKernel::kScalar:
+      return "scalar";
+    case ScaleKernel::kAvx2:
+      return "avx2";
+    case ScaleKernel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "recording_options.h"
+
+enum class ScaleKernel {
+  kScalar,
+  kAvx2,
+  kNeon,
+};
+
+// Resizes whole frames in any FrameFormat, plane by plane. Exact 2:1 and 3:1
+// ratios use a box filter; anything else first halves with the box filter
+// while the ratio stays at 2 or more, then finishes with a bilinear pass.
+//
+// Intermediate planes persist between calls, so ScaleRows can refresh only
+// the output rows that a damaged band of source rows influences.
+class FrameScaler {
+ public:
+  FrameScaler() = default;
+
+  // Prepares filter tables and intermediate planes. Dimensions must be even
+  // for 4:2:0 formats.
+  void Configure(FrameFormat format, int src_width, int src_height, int dst_width, int dst_height);
+  void Reset();
+
+  bool configured() const { return !planes_.empty(); }
+  int src_width() const { return src_width_; }
+  int src_height() const { return src_height_; }
+
+  // Scales every row of the tightly packed |src| frame into |dst|.
+  void Scale(const uint8_t* src, uint8_t* dst);
+  // Rescales what source rows [src_row_begin, src_row_end) affect; the rest of
+  // |dst| must already hold the previous output.
+  void ScaleRows(const uint8_t* src, uint8_t* dst, int src_row_begin, int src_row_end);
+
+ private:
+  enum class Method {
+    kBox2,
+    kBox3,
+    kBilinear,
+  };
+
+  struct Stage {
+    Method method = Method::kBilinear;
+    int src_width = 0;
+    int src_height = 0;
+    int dst_width = 0;
+    int dst_height = 0;
+    // Output of every stage but the last one.
+    std::vector<uint8_t> buffer;
+    // Bilinear only: left source pixel and 7-bit weight of the right one.
+    std::vector<int> x_index;
+    std::vector<uint8_t> x_weight;
+    std::vector<int> y_index;
+    std::vector<uint8_t> y_weight;
+  };
+
+  struct Plane {
+    size_t src_offset = 0;
+    size_t dst_offset = 0;
+    int bytes_per_pixel = 1;
+    // Rows of this plane per luma row pair: 2 for luma, 1 for 4:2:0 chroma.
+    int rows_per_two = 2;
+    std::vector<Stage> stages;
+  };
+
+  void ConfigurePlane(Plane* plane, int src_width, int src_height, int dst_width, int dst_height);
+  void RunStage(const Plane& plane,
+                Stage* stage,
+                const uint8_t* src,
+                uint8_t* dst,
+                int dst_row_begin,
+                int dst_row_end);
+  // Output rows of |stage| that read any of source rows [begin, end).
+  static void MapRows(const Stage& stage, int begin, int end, int* out_begin, int* out_end);
+
+  int src_width_ = 0;
+  int src_height_ = 0;
+  std::vector<Plane> planes_;
+  // Scratch for the bilinear and 3:1 paths: two filtered rows and 16-bit sums.
+  std::vector<uint8_t> row_cache_[2];
+  int row_cache_source_[2] = {-1, -1};
+  std::vector<uint16_t> row_sums_;
+};
+
+// Fastest kernel the CPU supports; picked once on first use.
+ScaleKernel ActiveScaleKernel();
+// Forces |kernel| for benchmarking. Returns false when the CPU lacks it.
+bool SetScaleKernel(ScaleKernel kernel);
+const char* ScaleKernelName(ScaleKernel kernel);
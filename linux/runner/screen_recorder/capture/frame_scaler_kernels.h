@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Row kernels shared by frame_scaler.cc and the per-architecture files. Each
+// returns how many leading bytes it produced; the scalar code finishes the rest.
+namespace frame_scaler_internal {
+
+// 2x2 box average of two source rows: (a + b + c + d + 2) >> 2 per channel.
+using Box2RowKernel = int (*)(const uint8_t* src0,
+                              const uint8_t* src1,
+                              uint8_t* dst,
+                              int dst_bytes,
+                              int bytes_per_pixel);
+// Column sums of three source rows, widened to 16 bits.
+using Sum3RowsKernel = int (*)(const uint8_t* src0,
+                               const uint8_t* src1,
+                               const uint8_t* src2,
+                               uint16_t* dst,
+                               int bytes);
+// a + (((b - a) * weight + 64) >> 7) with a 7-bit |weight| in [0, 128].
+using BlendRowsKernel = int (*)(const uint8_t* row0,
+                                const uint8_t* row1,
+                                uint8_t* dst,
+                                int bytes,
+                                int weight);
+
+#if defined(__x86_64__) || defined(__i386__)
+int Box2RowAvx2(const uint8_t* src0,
+                const uint8_t* src1,
+                uint8_t* dst,
+                int dst_bytes,
+                int bytes_per_pixel);
+int Sum3RowsAvx2(const uint8_t* src0,
+                 const uint8_t* src1,
+                 const uint8_t* src2,
+                 uint16_t* dst,
+                 int bytes);
+int BlendRowsAvx2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int bytes, int weight);
+#endif
+
+#if defined(__aarch64__)
+int Box2RowNeon(const uint8_t* src0,
+                const uint8_t* src1,
+                uint8_t* dst,
+                int dst_bytes,
+                int bytes_per_pixel);
+int Sum3RowsNeon(const uint8_t* src0,
+                 const uint8_t* src1,
+                 const uint8_t* src2,
+                 uint16_t* dst,
+                 int bytes);
+int BlendRowsNeon(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int bytes, int weight);
+#endif
+
+}  // namespace frame_scaler_internal
@@ -0,0 +1,78 @@
+#include "frame_scaler_kernels.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+namespace frame_scaler_internal {
+
+namespace {
+
+// Same neighbour pairing as the x86 kernel, applied with a table lookup.
+inline uint8x16_t PairShuffle(int bytes_per_pixel) {
+  static const uint8_t kPairs2[16] = {0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15};
+  static const uint8_t kPairs4[16] = {0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15};
+  static const uint8_t kIdentity[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  switch (bytes_per_pixel) {
+    case 2:
+      return vld1q_u8(kPairs2);
+    case 4:
+      return vld1q_u8(kPairs4);
+    default:
+      return vld1q_u8(kIdentity);
+  }
+}
+
+// Rounded 2x2 averages of 16 source bytes from each row.
+inline uint8x8_t Box2Bytes(const uint8_t* src0, const uint8_t* src1, uint8x16_t shuffle) {
+  const uint16x8_t sum = vpadalq_u8(vpaddlq_u8(vqtbl1q_u8(vld1q_u8(src0), shuffle)),
+                                    vqtbl1q_u8(vld1q_u8(src1), shuffle));
+  return vrshrn_n_u16(sum, 2);
+}
+
+}  // namespace
+
+int Box2RowNeon(const uint8_t* src0,
+                const uint8_t* src1,
+                uint8_t* dst,
+                int dst_bytes,
+                int bytes_per_pixel) {
+  const uint8x16_t shuffle = PairShuffle(bytes_per_pixel);
+  int x = 0;
+  for (; x + 16 <= dst_bytes; x += 16) {
+    const uint8_t* p0 = src0 + static_cast<size_t>(x) * 2;
+    const uint8_t* p1 = src1 + static_cast<size_t>(x) * 2;
+    vst1q_u8(dst + x,
+             vcombine_u8(Box2Bytes(p0, p1, shuffle), Box2Bytes(p0 + 16, p1 + 16, shuffle)));
+  }
+  return x;
+}
+
+int Sum3RowsNeon(const uint8_t* src0,
+                 const uint8_t* src1,
+                 const uint8_t* src2,
+                 uint16_t* dst,
+                 int bytes) {
+  int x = 0;
+  for (; x + 8 <= bytes; x += 8) {
+    vst1q_u16(dst + x, vaddw_u8(vaddl_u8(vld1_u8(src0 + x), vld1_u8(src1 + x)), vld1_u8(src2 + x)));
+  }
+  return x;
+}
+
+int BlendRowsNeon(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int bytes, int weight) {
+  const int16_t factor = static_cast<int16_t>(weight);
+  int x = 0;
+  for (; x + 8 <= bytes; x += 8) {
+    const int16x8_t a = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row0 + x)));
+    const int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row1 + x)));
+    // Rounding shift is (delta + 64) >> 7, matching the scalar path.
+    const int16x8_t delta = vrshrq_n_s16(vmulq_n_s16(vsubq_s16(b, a), factor), 7);
+    vst1_u8(dst + x, vqmovun_s16(vaddq_s16(a, delta)));
+  }
+  return x;
+}
+
+}  // namespace frame_scaler_internal
+
+#endif  // defined(__aarch64__)
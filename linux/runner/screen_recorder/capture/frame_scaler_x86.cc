@@ -0,0 +1,112 @@
+#include "frame_scaler_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace frame_scaler_internal {
+
+namespace {
+
+// Moves the two horizontal neighbours of every channel next to each other so
+// that one maddubs against all-ones sums them.
+__attribute__((target("avx2"))) inline __m256i PairShuffle(int bytes_per_pixel) {
+  switch (bytes_per_pixel) {
+    case 2:
+      return _mm256_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15, 0, 2, 1, 3, 4,
+                              6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+    case 4:
+      return _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2,
+                              6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    default:
+      return _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4,
+                              5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  }
+}
+
+// Rounded 2x2 averages of 32 source bytes from each row, as 16 words.
+__attribute__((target("avx2"))) inline __m256i Box2Words(const uint8_t* src0,
+                                                         const uint8_t* src1,
+                                                         __m256i shuffle) {
+  const __m256i ones = _mm256_set1_epi8(1);
+  const __m256i row0 = _mm256_shuffle_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0)), shuffle);
+  const __m256i row1 = _mm256_shuffle_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1)), shuffle);
+  const __m256i sum =
+      _mm256_add_epi16(_mm256_maddubs_epi16(row0, ones), _mm256_maddubs_epi16(row1, ones));
+  return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+// Packs two registers of words back to 32 bytes in order.
+__attribute__((target("avx2"))) inline __m256i PackOrdered(__m256i lo, __m256i hi) {
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+// a + (((b - a) * weight + 64) >> 7) for 16 bytes, as words.
+__attribute__((target("avx2"))) inline __m256i BlendWords(const uint8_t* row0,
+                                                          const uint8_t* row1,
+                                                          __m256i factor) {
+  const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0)));
+  const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1)));
+  const __m256i delta = _mm256_mullo_epi16(_mm256_sub_epi16(b, a), factor);
+  return _mm256_add_epi16(a, _mm256_srai_epi16(_mm256_add_epi16(delta, _mm256_set1_epi16(64)), 7));
+}
+
+}  // namespace
+
+// 32 output bytes (64 source bytes per row) per iteration.
+__attribute__((target("avx2"))) int Box2RowAvx2(const uint8_t* src0,
+                                                const uint8_t* src1,
+                                                uint8_t* dst,
+                                                int dst_bytes,
+                                                int bytes_per_pixel) {
+  const __m256i shuffle = PairShuffle(bytes_per_pixel);
+  int x = 0;
+  for (; x + 32 <= dst_bytes; x += 32) {
+    const uint8_t* p0 = src0 + static_cast<size_t>(x) * 2;
+    const uint8_t* p1 = src1 + static_cast<size_t>(x) * 2;
+    const __m256i lo = Box2Words(p0, p1, shuffle);
+    const __m256i hi = Box2Words(p0 + 32, p1 + 32, shuffle);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), PackOrdered(lo, hi));
+  }
+  return x;
+}
+
+__attribute__((target("avx2"))) int Sum3RowsAvx2(const uint8_t* src0,
+                                                 const uint8_t* src1,
+                                                 const uint8_t* src2,
+                                                 uint16_t* dst,
+                                                 int bytes) {
+  int x = 0;
+  for (; x + 16 <= bytes; x += 16) {
+    const __m256i a =
+        _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x)));
+    const __m256i b =
+        _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x)));
+    const __m256i c =
+        _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src2 + x)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),
+                        _mm256_add_epi16(_mm256_add_epi16(a, b), c));
+  }
+  return x;
+}
+
+__attribute__((target("avx2"))) int BlendRowsAvx2(const uint8_t* row0,
+                                                  const uint8_t* row1,
+                                                  uint8_t* dst,
+                                                  int bytes,
+                                                  int weight) {
+  const __m256i factor = _mm256_set1_epi16(static_cast<int16_t>(weight));
+  int x = 0;
+  for (; x + 32 <= bytes; x += 32) {
+    const __m256i lo = BlendWords(row0 + x, row1 + x, factor);
+    const __m256i hi = BlendWords(row0 + x + 16, row1 + x + 16, factor);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), PackOrdered(lo, hi));
+  }
+  return x;
+}
+
+}  // namespace frame_scaler_internal
+
+#endif  // defined(__x86_64__) || defined(__i386__)
@@ -1,11 +1,18 @@
 #include "pipewire_capture.h"
 
-#include "ffmpeg_writer.h"
+#include "color_convert.h"
+#include "encoder_autotune.h"
+#include "encoder_worker.h"
+#include "frame_copy.h"
 #include "utils/dimensions.h"
+#include "utils/tracer.h"
 
 #include <pipewire/pipewire.h>
 
+#include <spa/buffer/meta.h>
+#include <spa/param/audio/format-utils.h>
 #include <spa/param/format-utils.h>
+#include <spa/param/param.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/pod/builder.h>
 
@@ -13,44 +20,324 @@
 #include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <map>
 #include <sstream>
 #include <tuple>
 
+#include <sys/mman.h>
+
+using screen_recorder::utils::ComputeOutputDimensions;
 using screen_recorder::utils::MakeEvenDimensions;
 
+namespace {
+
+// Distinct frames that may wait for each encoder writer thread.
+constexpr size_t kMaxQueuedFrames = 4;
+// Audio blocks share the writer queue and arrive every few milliseconds, so
+// the queue is sized for them on top of the frames.
+constexpr size_t kEncoderQueueCapacity = 64;
+// Largest PipeWire quantum by default; audio slots are sized for it up front
+// so the audio callback does not allocate.
+constexpr size_t kMaxAudioBlockFrames = 8192;
+// How often the capture thread refreshes its published Metrics.
+constexpr auto kMetricsInterval = std::chrono::milliseconds(250);
+// PulseAudio-style monitor sources map to the sink node they listen to.
+constexpr char kMonitorSuffix[] = ".monitor";
+
+// Settings of every rendition, primary output first.
+std::vector<RecordingOptions> RenditionOptions(const RecordingOptions& options) {
+  std::vector<RecordingOptions> renditions = {options};
+  renditions.front().extra_outputs.clear();
+  for (const auto& output : options.extra_outputs) {
+    RecordingOptions rendition = renditions.front();
+    rendition.output_path = output.output_path;
+    rendition.output_height = output.output_height;
+    rendition.encoder_profile = output.encoder_profile;
+    rendition.replay_buffer_bytes = 0;
+    renditions.push_back(std::move(rendition));
+  }
+  return renditions;
+}
+
+// Frames are captured once at the largest rendition size; encoders that
+// want less scale on their own thread.
+int CaptureOutputHeight(const RecordingOptions& options) {
+  int height = options.output_height;
+  for (const auto& output : options.extra_outputs) {
+    if (height == 0 || output.output_height == 0) {
+      height = 0;
+    } else {
+      height = std::max(height, output.output_height);
+    }
+  }
+  return height;
+}
+
+// Every frame each writer may have queued, plus the last emitted frame and
+// the one being filled.
+size_t FramePoolSlots(const RecordingOptions& options) {
+  return (options.extra_outputs.size() + 1) * kMaxQueuedFrames + 2;
+}
+// Damage regions requested per buffer; compositors merge anything beyond this.
+constexpr int kMaxDamageRegions = 16;
+// Largest stream size offered during format negotiation.
+constexpr uint32_t kMaxStreamDimension = 8192;
+// Buffers the stream may allocate; the default keeps one in flight per queued frame.
+constexpr int kStreamBuffers = 8;
+constexpr int kMinStreamBuffers = 2;
+constexpr int kMaxStreamBuffers = 16;
+
+// Clips a damage region to the copyable area. Returns false when nothing is left.
+bool ClipRegion(const struct spa_region& region, int max_width, int max_height, int* x, int* y,
+                int* width, int* height) {
+  const int64_t left = std::max<int64_t>(0, region.position.x);
+  const int64_t top = std::max<int64_t>(0, region.position.y);
+  const int64_t right =
+      std::min<int64_t>(max_width, static_cast<int64_t>(region.position.x) + region.size.width);
+  const int64_t bottom =
+      std::min<int64_t>(max_height, static_cast<int64_t>(region.position.y) + region.size.height);
+  if (right <= left || bottom <= top) {
+    return false;
+  }
+  *x = static_cast<int>(left);
+  *y = static_cast<int>(top);
+  *width = static_cast<int>(right - left);
+  *height = static_cast<int>(bottom - top);
+  return true;
+}
+
+// Sums the clipped area of every valid damage region. Overlaps are counted
+// twice, which only makes the estimate more conservative.
+uint64_t DamagedPixels(struct spa_meta* damage, int max_width, int max_height) {
+  uint64_t pixels = 0;
+  struct spa_meta_region* region = nullptr;
+  spa_meta_for_each(region, damage) {
+    if (!spa_meta_region_is_valid(region)) {
+      break;
+    }
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    if (ClipRegion(region->region, max_width, max_height, &x, &y, &width, &height)) {
+      pixels += static_cast<uint64_t>(width) * static_cast<uint64_t>(height);
+    }
+  }
+  return pixels;
+}
+
+// Clears the destination area that a smaller source did not cover: the right
+// margin of every copied row and every row below the copied ones.
+void ZeroUncovered(uint8_t* dst, size_t dst_stride, int dst_rows, int copied_rows, size_t row_bytes) {
+  if (row_bytes < dst_stride) {
+    for (int row = 0; row < copied_rows; ++row) {
+      std::memset(dst + static_cast<size_t>(row) * dst_stride + row_bytes, 0, dst_stride - row_bytes);
+    }
+  }
+  if (copied_rows < dst_rows) {
+    std::memset(dst + static_cast<size_t>(copied_rows) * dst_stride,
+                0,
+                static_cast<size_t>(dst_rows - copied_rows) * dst_stride);
+  }
+}
+
+PixelLayout SourceLayout(uint32_t format) {
+  switch (format) {
+    case SPA_VIDEO_FORMAT_RGBx:
+    case SPA_VIDEO_FORMAT_RGBA:
+      return PixelLayout::kRGBx;
+    case SPA_VIDEO_FORMAT_xRGB:
+    case SPA_VIDEO_FORMAT_ARGB:
+      return PixelLayout::kxRGB;
+    case SPA_VIDEO_FORMAT_xBGR:
+    case SPA_VIDEO_FORMAT_ABGR:
+      return PixelLayout::kxBGR;
+    default:
+      return PixelLayout::kBGRx;
+  }
+}
+
+// One dequeued buffer as the copy paths see it. |first_row| is the packed
+// RGB plane or the NV12 luma plane; a negative stride walks it bottom-up.
+struct SourceFrame {
+  const uint8_t* first_row = nullptr;
+  int stride = 0;
+  // Interleaved UV plane of an NV12 source.
+  const uint8_t* chroma = nullptr;
+  int chroma_stride = 0;
+  bool nv12 = false;
+  PixelLayout layout = PixelLayout::kBGRx;
+};
+
+// Finds the UV plane of an NV12 buffer: its own data block (|chroma_data|,
+// readable at |chroma_base|) when the producer splits planes, otherwise right
+// after |height| luma rows of the same block.
+bool FindNv12Chroma(const struct spa_data* chroma_data,
+                    const uint8_t* chroma_base,
+                    const uint8_t* luma,
+                    uint32_t luma_size,
+                    int luma_stride,
+                    int height,
+                    SourceFrame* source) {
+  const uint64_t chroma_rows = static_cast<uint64_t>((height + 1) / 2);
+  if (chroma_data && chroma_base && chroma_data->chunk && chroma_data->chunk->size > 0) {
+    const struct spa_chunk* chunk = chroma_data->chunk;
+    const int stride = chunk->stride > 0 ? chunk->stride : luma_stride;
+    if (chunk->size < static_cast<uint64_t>(stride) * chroma_rows ||
+        static_cast<uint64_t>(chunk->offset) + chunk->size > chroma_data->maxsize) {
+      return false;
+    }
+    source->chroma = chroma_base + chunk->offset;
+    source->chroma_stride = stride;
+    return true;
+  }
+  const uint64_t luma_bytes = static_cast<uint64_t>(luma_stride) * static_cast<uint64_t>(height);
+  if (luma_size < luma_bytes + static_cast<uint64_t>(luma_stride) * chroma_rows) {
+    return false;
+  }
+  source->chroma = luma + luma_bytes;
+  source->chroma_stride = luma_stride;
+  return true;
+}
+
+// Writes the |width| x |height| rectangle at (x, y) of |src| into the same
+// position of a |canvas_width| x |canvas_height| frame. 4:2:0 targets widen it
+// to even coordinates, clamped to |max_width| x |max_height|, so that every
+// chroma sample it touches is recomputed from its whole 2x2 block.
+void CopySourceRect(const SourceFrame& src,
+                    FrameFormat format,
+                    uint8_t* canvas,
+                    int canvas_width,
+                    int canvas_height,
+                    int max_width,
+                    int max_height,
+                    int x,
+                    int y,
+                    int width,
+                    int height) {
+  if (format == FrameFormat::kBgr0) {
+    const size_t canvas_stride = static_cast<size_t>(canvas_width) * 4;
+    if (src.layout == PixelLayout::kBGRx) {
+      CopyRect(src.first_row, src.stride, canvas, canvas_stride, x, y, width, height);
+      return;
+    }
+    ConvertToBgrx(src.first_row + static_cast<ptrdiff_t>(y) * src.stride +
+                      static_cast<ptrdiff_t>(x) * 4,
+                  src.stride, src.layout, width, height,
+                  canvas + static_cast<size_t>(y) * canvas_stride + static_cast<size_t>(x) * 4,
+                  canvas_stride);
+    return;
+  }
+
+  const int left = x & ~1;
+  const int top = y & ~1;
+  const int right = std::min(max_width, (x + width + 1) & ~1);
+  const int bottom = std::min(max_height, (y + height + 1) & ~1);
+  const Yuv420Planes dst = OffsetYuv420Planes(
+      MapYuv420Planes(format, canvas, canvas_width, canvas_height), left, top);
+  if (src.nv12) {
+    CopyNv12ToYuv420(src.first_row + static_cast<ptrdiff_t>(top) * src.stride + left, src.stride,
+                     src.chroma + static_cast<ptrdiff_t>(top / 2) * src.chroma_stride + left,
+                     src.chroma_stride, right - left, bottom - top, dst);
+    return;
+  }
+  ConvertToYuv420(src.first_row + static_cast<ptrdiff_t>(top) * src.stride +
+                      static_cast<ptrdiff_t>(left) * 4,
+                  src.stride, src.layout, right - left, bottom - top, dst);
+}
+
+// Writes the top-left |width| x |height| pixels of |src| into a whole frame
+// and paints whatever they do not cover black.
+void CopySourceFrame(const SourceFrame& src,
+                     FrameFormat format,
+                     uint8_t* canvas,
+                     int canvas_width,
+                     int canvas_height,
+                     int width,
+                     int height) {
+  if (format == FrameFormat::kBgr0) {
+    const size_t canvas_stride = static_cast<size_t>(canvas_width) * 4;
+    const size_t row_bytes = static_cast<size_t>(width) * 4;
+    if (src.layout == PixelLayout::kBGRx) {
+      CopyRows(src.first_row, src.stride, canvas, canvas_stride, height, row_bytes);
+    } else {
+      ConvertToBgrx(src.first_row, src.stride, src.layout, width, height, canvas, canvas_stride);
+    }
+    ZeroUncovered(canvas, canvas_stride, canvas_height, height, row_bytes);
+    return;
+  }
+
+  // Colour conversion doubles as the stride-normalising copy.
+  const Yuv420Planes planes = MapYuv420Planes(format, canvas, canvas_width, canvas_height);
+  if (src.nv12) {
+    CopyNv12ToYuv420(src.first_row, src.stride, src.chroma, src.chroma_stride, width, height,
+                     planes);
+  } else {
+    ConvertToYuv420(src.first_row, src.stride, src.layout, width, height, planes);
+  }
+  FillYuv420Uncovered(planes, canvas_width, canvas_height, width, height);
+}
+
+int64_t NanosecondsBetween(std::chrono::steady_clock::time_point from,
+                           std::chrono::steady_clock::time_point to) {
+  return std::max<int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count(), 0);
+}
+
+int64_t SteadyNs(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+// When the compositor finished the buffer. Its pts is only trusted when it
+// is on our monotonic clock, i.e. shortly before the buffer arrived.
+std::chrono::steady_clock::time_point ReadyTime(const struct spa_meta_header* header,
+                                                std::chrono::steady_clock::time_point arrival) {
+  if (!header || header->pts <= 0) {
+    return arrival;
+  }
+  const auto pts = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(header->pts));
+  return pts <= arrival && arrival - pts < std::chrono::seconds(1) ? pts : arrival;
+}
+
+}  // namespace
+
 PipeWireCapture::PipeWireCapture(uint32_t node_id,
                                  int pipewire_fd,
                                  int width,
                                  int height,
-                                 uint32_t fps,
-                                 std::string output_path,
+                                 RecordingOptions options,
                                  uint32_t max_frames,
-                                 bool encode_mp4,
-                                 bool capture_audio,
-                                 std::string audio_device,
-                                 int output_height)
+                                 bool encode_mp4)
     : node_id_(node_id),
       pipewire_fd_(pipewire_fd),
       width_(width),
       height_(height),
-      fps_(fps),
-      output_path_(std::move(output_path)),
+      options_(std::move(options)),
       max_frames_(max_frames),
       encode_mp4_(encode_mp4),
-      capture_audio_(capture_audio),
-      audio_device_(std::move(audio_device)),
-      output_height_(output_height) {
+      frame_pool_(FramePoolSlots(options_)),
+      // A block stays pinned until every queue has written it, and no queue
+      // holds more than its capacity.
+      audio_pool_(options_.capture_audio ? kEncoderQueueCapacity : 0) {
   std::tie(width_, height_) = MakeEvenDimensions(width_, height_);
+  std::tie(output_width_, output_height_) =
+      ComputeOutputDimensions(width_, height_, CaptureOutputHeight(options_));
   stream_width_ = width_;
   stream_height_ = height_;
   stream_stride_ = stream_width_ * 4;
-  frame_size_bytes_ = static_cast<size_t>(width_) * static_cast<size_t>(height_) * 4;
-  frame_buffer_.resize(frame_size_bytes_);
-  last_frame_buffer_.resize(frame_size_bytes_);
+  if (encode_mp4_) {
+    ConfigureFrames();
+    audio_pool_.Reserve(kMaxAudioBlockFrames * sizeof(float) * kCaptureAudioChannels);
+  }
   stream_events_.version = PW_VERSION_STREAM_EVENTS;
   stream_events_.state_changed = OnStreamStateChanged;
   stream_events_.param_changed = OnStreamParamChanged;
+  stream_events_.add_buffer = OnAddBuffer;
+  stream_events_.remove_buffer = OnRemoveBuffer;
   stream_events_.process = OnProcess;
+  audio_events_.version = PW_VERSION_STREAM_EVENTS;
+  audio_events_.state_changed = OnStreamStateChanged;
+  audio_events_.process = OnAudioProcess;
 }
 
 PipeWireCapture::~PipeWireCapture() {
@@ -76,151 +363,408 @@ void PipeWireCapture::OnStreamParamChanged(void* data, uint32_t id, const struct
   if (id != SPA_PARAM_Format || !param) {
     return;
   }
-  spa_format_video_raw_parse(param, &self->video_info_);
-  if (self->encode_mp4_) {
-    const int stream_width = self->video_info_.size.width > 0 ? static_cast<int>(self->video_info_.size.width)
-                                                               : self->width_;
+  struct spa_video_info_raw info {};
+  spa_format_video_raw_parse(param, &info);
+  self->ApplyFormat(info);
+
+  uint8_t buffer[512];
+  struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+  const struct spa_pod* params[3];
+  // Shared memory only: memfds are mapped once in OnAddBuffer and read in place.
+  params[0] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+      &builder,
+      SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+      SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(
+          kStreamBuffers, kMinStreamBuffers, kMaxStreamBuffers),
+      SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(
+          (1 << SPA_DATA_MemFd) | (1 << SPA_DATA_MemPtr))));
+  params[1] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+      &builder,
+      SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+      SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+      SPA_PARAM_META_size, SPA_POD_Int(static_cast<int>(sizeof(struct spa_meta_header)))));
+  params[2] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+      &builder,
+      SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+      SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+      SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+          static_cast<int>(sizeof(struct spa_meta_region)) * kMaxDamageRegions,
+          static_cast<int>(sizeof(struct spa_meta_region)),
+          static_cast<int>(sizeof(struct spa_meta_region)) * kMaxDamageRegions)));
+  pw_stream_update_params(self->stream_, params, 3);
+}
+
+void PipeWireCapture::ApplyFormat(const struct spa_video_info_raw& info) {
+  video_info_ = info;
+  source_layout_ = SourceLayout(video_info_.format);
+  source_nv12_ = video_info_.format == SPA_VIDEO_FORMAT_NV12;
+  // The stride of the previous format no longer applies.
+  stream_stride_ = 0;
+  if (encode_mp4_) {
+    const int stream_width =
+        video_info_.size.width > 0 ? static_cast<int>(video_info_.size.width) : width_;
     const int stream_height =
-        self->video_info_.size.height > 0 ? static_cast<int>(self->video_info_.size.height)
-                                          : self->height_;
-    self->stream_width_ = stream_width;
-    self->stream_height_ = stream_height;
-    std::tie(self->width_, self->height_) = MakeEvenDimensions(stream_width, stream_height);
-    self->frame_size_bytes_ =
-        static_cast<size_t>(self->width_) * static_cast<size_t>(self->height_) * 4;
-    self->frame_buffer_.assign(self->frame_size_bytes_, 0);
-    self->last_frame_buffer_.assign(self->frame_size_bytes_, 0);
+        video_info_.size.height > 0 ? static_cast<int>(video_info_.size.height) : height_;
+    stream_width_ = stream_width;
+    stream_height_ = stream_height;
+    std::tie(width_, height_) = MakeEvenDimensions(stream_width, stream_height);
+    last_frame_.Reset();
+    damage_base_valid_ = false;
+    ConfigureFrames();
   }
 }
 
+PipeWireCapture::BufferMapping::~BufferMapping() {
+  for (const Region& region : regions) {
+    munmap(region.base, region.length);
+  }
+}
+
+void PipeWireCapture::OnAddBuffer(void* data, struct pw_buffer* buffer) {
+  auto* self = static_cast<PipeWireCapture*>(data);
+  const struct spa_buffer* spa_buffer = buffer->buffer;
+  auto mapping = std::make_unique<BufferMapping>();
+  mapping->planes.assign(spa_buffer->n_datas, nullptr);
+  for (uint32_t i = 0; i < spa_buffer->n_datas; ++i) {
+    const struct spa_data* d = &spa_buffer->datas[i];
+    if (d->type == SPA_DATA_MemPtr) {
+      mapping->planes[i] = static_cast<const uint8_t*>(d->data);
+      continue;
+    }
+    if (d->type != SPA_DATA_MemFd || d->fd < 0) {
+      continue;
+    }
+    const size_t length = static_cast<size_t>(d->mapoffset) + d->maxsize;
+    // Planes of one buffer usually share a memfd; map it once for all of them.
+    const auto shared = std::find_if(
+        mapping->regions.begin(), mapping->regions.end(),
+        [&](const BufferMapping::Region& region) {
+          return region.fd == d->fd && region.length >= length;
+        });
+    if (shared != mapping->regions.end()) {
+      mapping->planes[i] = static_cast<const uint8_t*>(shared->base) + d->mapoffset;
+      continue;
+    }
+    void* base = mmap(nullptr, length, PROT_READ, MAP_SHARED, static_cast<int>(d->fd), 0);
+    if (base == MAP_FAILED) {
+      continue;
+    }
+    mapping->regions.push_back({d->fd, base, length});
+    mapping->planes[i] = static_cast<const uint8_t*>(base) + d->mapoffset;
+  }
+  buffer->user_data = mapping.get();
+  self->buffer_mappings_[buffer] = std::move(mapping);
+}
+
+void PipeWireCapture::OnRemoveBuffer(void* data, struct pw_buffer* buffer) {
+  auto* self = static_cast<PipeWireCapture*>(data);
+  buffer->user_data = nullptr;
+  self->buffer_mappings_.erase(buffer);
+}
+
+const uint8_t* PipeWireCapture::PlaneData(const struct pw_buffer* buffer, uint32_t index) {
+  const auto* mapping = static_cast<const BufferMapping*>(buffer->user_data);
+  if (mapping) {
+    return index < mapping->planes.size() ? mapping->planes[index] : nullptr;
+  }
+  return static_cast<const uint8_t*>(buffer->buffer->datas[index].data);
+}
+
 void PipeWireCapture::OnProcess(void* data) {
   auto* self = static_cast<PipeWireCapture*>(data);
+  TraceScope trace("capture", "OnProcess");
   struct pw_buffer* buffer = pw_stream_dequeue_buffer(self->stream_);
   if (!buffer) {
     return;
   }
 
+  self->ProcessVideoBuffer(buffer);
+  pw_stream_queue_buffer(self->stream_, buffer);
+
+  if (self->stream_failed_ && self->loop_) {
+    pw_main_loop_quit(self->loop_);
+  }
+  if (self->stop_requested_ && self->loop_) {
+    pw_main_loop_quit(self->loop_);
+  }
+}
+
+void PipeWireCapture::ProcessVideoBuffer(struct pw_buffer* buffer) {
+  const auto arrival = std::chrono::steady_clock::now();
+  AdvanceTiming(arrival);
+  if (last_callback_ != std::chrono::steady_clock::time_point {}) {
+    const int64_t interval_ns = NanosecondsBetween(last_callback_, arrival);
+    callback_interval_ns_.Record(static_cast<uint64_t>(interval_ns));
+    const auto gap_us = static_cast<uint32_t>(std::min<int64_t>(interval_ns / 1000, UINT32_MAX));
+    timing_.max_gap_us = std::max(timing_.max_gap_us, gap_us);
+  }
+  last_callback_ = arrival;
+  ++timing_.received;
   const struct spa_buffer* spa_buffer = buffer->buffer;
+  const auto* header = static_cast<const struct spa_meta_header*>(
+      spa_buffer_find_meta_data(spa_buffer, SPA_META_Header, sizeof(struct spa_meta_header)));
+  if (header) {
+    // Damage is relative to the previous buffer; after a gap it no longer
+    // describes what changed in the persistent frame.
+    if (has_last_seq_ && header->seq != last_seq_ + 1) {
+      damage_base_valid_ = false;
+      if (header->seq > last_seq_) {
+        compositor_drops_ += header->seq - last_seq_ - 1;
+      }
+    }
+    has_last_seq_ = true;
+    last_seq_ = header->seq;
+    if ((header->flags & SPA_META_HEADER_FLAG_CORRUPTED) != 0) {
+      ++frames_corrupted_;
+      damage_base_valid_ = false;
+      return;
+    }
+  }
+  struct spa_meta* damage = spa_buffer_find_meta(spa_buffer, SPA_META_VideoDamage);
+
   uint64_t frame_bytes = 0;
   bool frame_written = false;
   for (uint32_t i = 0; i < spa_buffer->n_datas; ++i) {
     const struct spa_data* d = &spa_buffer->datas[i];
-    if (!d->data || !d->chunk) {
+    const uint8_t* base = PlaneData(buffer, i);
+    if (!base || !d->chunk) {
       continue;
     }
+    if ((d->chunk->flags & SPA_CHUNK_FLAG_CORRUPTED) != 0 ||
+        static_cast<uint64_t>(d->chunk->offset) + d->chunk->size > d->maxsize) {
+      ++frames_corrupted_;
+      damage_base_valid_ = false;
+      break;
+    }
     const uint32_t size = d->chunk->size;
     if (size == 0) {
       continue;
     }
 
-    const uint8_t* bytes = static_cast<const uint8_t*>(d->data) + d->chunk->offset;
-    if (self->encode_mp4_) {
-      if (self->frame_size_bytes_ == 0 || self->frame_buffer_.size() != self->frame_size_bytes_) {
-        self->frame_size_bytes_ = static_cast<size_t>(self->width_) * static_cast<size_t>(self->height_) * 4;
-        self->frame_buffer_.assign(self->frame_size_bytes_, 0);
+    const uint8_t* bytes = base + d->chunk->offset;
+    if (encode_mp4_) {
+      const FrameFormat format = options_.frame_format;
+      if (frame_size_bytes_ == 0) {
+        ConfigureFrames();
       }
 
-      const int src_width = self->stream_width_ > 0 ? self->stream_width_ : self->width_;
-      const int src_height = self->stream_height_ > 0 ? self->stream_height_ : self->height_;
-      const int32_t chunk_stride = d->chunk->stride;
-      int src_stride = chunk_stride != 0 ? static_cast<int>(chunk_stride) : self->stream_stride_;
-      if (src_stride == 0) {
-        // Some PipeWire buffers omit chunk stride; infer from payload when possible.
-        const int min_row_bytes = src_width * 4;
-        if (src_height > 0) {
-          const int inferred = static_cast<int>(size / static_cast<uint32_t>(src_height));
-          if (inferred >= min_row_bytes) {
-            src_stride = inferred;
-          }
-        }
-        if (src_stride == 0) {
-          src_stride = min_row_bytes;
-        }
-      }
-      self->stream_stride_ = src_stride;
+      const int src_width = stream_width_ > 0 ? stream_width_ : width_;
+      const int src_height = stream_height_ > 0 ? stream_height_ : height_;
+      const bool nv12 = source_nv12_;
+      const int src_stride = ResolveSourceStride(d->chunk->stride, stream_stride_, size, src_width,
+                                                 src_height, nv12);
+      stream_stride_ = src_stride;
 
       const int abs_src_stride = std::abs(src_stride);
       if (abs_src_stride <= 0) {
-        self->stream_failed_ = true;
-        self->stream_error_ = "Invalid source stride from PipeWire buffer";
-        if (self->loop_) {
-          pw_main_loop_quit(self->loop_);
+        stream_failed_ = true;
+        stream_error_ = "Invalid source stride from PipeWire buffer";
+        if (loop_) {
+          pw_main_loop_quit(loop_);
         }
         break;
       }
 
-      std::fill(self->frame_buffer_.begin(), self->frame_buffer_.end(), 0);
-      const int dst_stride = self->width_ * 4;
       const int max_rows_from_chunk = static_cast<int>(size / static_cast<uint32_t>(abs_src_stride));
-      const int copy_rows = std::max(0, std::min({self->height_, src_height, max_rows_from_chunk}));
-      const int bytes_per_row = std::max(0, std::min(dst_stride, src_width * 4));
+      const int copy_rows = std::max(0, std::min({height_, src_height, max_rows_from_chunk}));
+      const int copy_cols = std::max(0, std::min(width_, src_width));
 
-      if (copy_rows == 0 || bytes_per_row == 0) {
+      if (copy_rows == 0 || copy_cols == 0) {
         continue;
       }
 
-      const uint8_t* src_first_row = bytes;
-      if (src_stride < 0) {
-        src_first_row = bytes + static_cast<size_t>(copy_rows - 1) * static_cast<size_t>(abs_src_stride);
+      SourceFrame source;
+      source.first_row = bytes;
+      source.stride = src_stride;
+      source.layout = source_layout_;
+      source.nv12 = nv12;
+      if (nv12) {
+        const bool split = i + 1 < spa_buffer->n_datas;
+        if (src_stride < 0 ||
+            !FindNv12Chroma(split ? &spa_buffer->datas[i + 1] : nullptr,
+                            split ? PlaneData(buffer, i + 1) : nullptr, bytes, size, src_stride,
+                            src_height, &source)) {
+          ++frames_corrupted_;
+          damage_base_valid_ = false;
+          break;
+        }
+      } else {
+        source.first_row = SourceFirstRow(bytes, src_stride, copy_rows);
       }
+      const uint64_t copy_pixels = static_cast<uint64_t>(copy_cols) * static_cast<uint64_t>(copy_rows);
+      const uint64_t src_bits_per_pixel = nv12 ? 12 : 32;
+      // Buffers land in the frame itself, or at stream size in |scale_source_|
+      // when the output is smaller.
+      const bool scaling = scaler_.configured();
+
+      const bool use_damage = damage && damage_base_valid_ && last_frame_ &&
+                              last_frame_.size() == frame_size_bytes_;
+      const uint64_t damaged_pixels = use_damage ? DamagedPixels(damage, copy_cols, copy_rows) : 0;
 
-      for (int row = 0; row < copy_rows; ++row) {
-        const uint8_t* src_row = src_stride > 0
-                                     ? src_first_row + static_cast<size_t>(row) * static_cast<size_t>(abs_src_stride)
-                                     : src_first_row - static_cast<size_t>(row) * static_cast<size_t>(abs_src_stride);
-        uint8_t* dst_row = self->frame_buffer_.data() + static_cast<size_t>(row) * static_cast<size_t>(dst_stride);
-        std::memcpy(dst_row, src_row, static_cast<size_t>(bytes_per_row));
+      const auto copy_start = std::chrono::steady_clock::now();
+      bool frame_updated = false;
+      if (use_damage && damaged_pixels == 0) {
+        ++frames_unchanged_;
+      } else if (use_damage && damaged_pixels * 2 < copy_pixels) {
+        // Patch the damaged rectangles into the persistent frame, in place when
+        // the writer no longer references it.
+        FrameHandle frame;
+        if (last_frame_.unique()) {
+          frame = last_frame_;
+        } else {
+          frame = frame_pool_.Acquire(frame_size_bytes_);
+          if (frame) {
+            std::memcpy(frame.data(), last_frame_.data(), frame_size_bytes_);
+            bytes_copied_ += frame_size_bytes_;
+          }
+        }
+        if (frame) {
+          uint8_t* canvas = scaling ? scale_source_.data() : frame.data();
+          int dirty_top = copy_rows;
+          int dirty_bottom = 0;
+          struct spa_meta_region* region = nullptr;
+          spa_meta_for_each(region, damage) {
+            if (!spa_meta_region_is_valid(region)) {
+              break;
+            }
+            int x = 0;
+            int y = 0;
+            int rect_width = 0;
+            int rect_height = 0;
+            if (!ClipRegion(region->region, copy_cols, copy_rows, &x, &y, &rect_width,
+                            &rect_height)) {
+              continue;
+            }
+            CopySourceRect(source, format, canvas, width_, height_, copy_cols,
+                           copy_rows, x, y, rect_width, rect_height);
+            // Rounded out to the row pairs a 4:2:0 target rewrites.
+            dirty_top = std::min(dirty_top, y & ~1);
+            dirty_bottom = std::max(dirty_bottom, (y + rect_height + 1) & ~1);
+          }
+          if (scaling) {
+            scaler_.ScaleRows(canvas, frame.data(), dirty_top, dirty_bottom);
+          }
+          bytes_copied_ += damaged_pixels * src_bits_per_pixel / 8;
+          last_frame_ = std::move(frame);
+          frame_updated = true;
+          ++frames_partial_;
+        } else {
+          ++frames_dropped_;
+          damage_base_valid_ = false;
+        }
+      } else {
+        FrameHandle frame = frame_pool_.Acquire(frame_size_bytes_);
+        if (frame) {
+          uint8_t* canvas = scaling ? scale_source_.data() : frame.data();
+          CopySourceFrame(source, format, canvas, width_, height_, copy_cols,
+                          copy_rows);
+          if (scaling) {
+            scaler_.Scale(canvas, frame.data());
+          }
+          bytes_copied_ += copy_pixels * src_bits_per_pixel / 8;
+          last_frame_ = std::move(frame);
+          damage_base_valid_ = true;
+          frame_updated = true;
+          ++frames_full_;
+        } else {
+          ++frames_dropped_;
+          damage_base_valid_ = false;
+        }
+      }
+      if (frame_updated) {
+        const int64_t copy_ns =
+            NanosecondsBetween(copy_start, std::chrono::steady_clock::now());
+        copy_ns_.Record(static_cast<uint64_t>(copy_ns));
+        Tracer::Complete("capture", "copy", SteadyNs(copy_start), copy_ns, "pixels",
+                         static_cast<int64_t>(use_damage ? damaged_pixels : copy_pixels));
+        dequeue_to_copy_ns_.Record(
+            static_cast<uint64_t>(NanosecondsBetween(ReadyTime(header, arrival), copy_start)));
+      }
+      // With every slot still queued for the writer, keep pacing on the last frame.
+      if (!last_frame_) {
+        break;
+      }
+      if (std::any_of(outputs_.begin(), outputs_.end(),
+                      [](const Output& output) { return output.worker->failed(); })) {
+        stream_failed_ = true;
+        break;
       }
 
-      self->last_frame_buffer_ = self->frame_buffer_;
+      if (options_.variable_frame_rate) {
+        // Each distinct frame is sent once with its own timestamp; repeats of
+        // an unchanged screen cost nothing.
+        if (!frame_updated) {
+          break;
+        }
+        const int64_t timestamp_us = VideoTimestampUs(header, arrival);
+        // A full queue drops the frame for that rendition only.
+        for (auto& output : outputs_) {
+          output.worker->Enqueue(last_frame_, 1, timestamp_us);
+        }
+        frame_bytes += last_frame_.size();
+        frame_written = true;
+        break;
+      }
 
       // Pace emission against monotonic time so output duration tracks real time
       // even when capture callbacks jitter or frames are dropped under load.
       const auto now = std::chrono::steady_clock::now();
-      if (!self->video_clock_started_) {
-        self->video_clock_started_ = true;
-        self->video_start_time_ = now;
+      if (!video_clock_started_) {
+        video_clock_started_ = true;
+        video_start_time_ = now;
       }
       const double elapsed_sec =
-          std::chrono::duration<double>(now - self->video_start_time_).count();
-      const double target_frames_f = elapsed_sec * static_cast<double>(self->fps_) + 1.0;
+          std::chrono::duration<double>(now - video_start_time_).count();
+      const double target_frames_f = elapsed_sec * static_cast<double>(options_.fps) + 1.0;
       uint64_t target_frame_count = static_cast<uint64_t>(std::floor(target_frames_f));
-      if (target_frame_count <= self->emitted_frame_count_) {
-        target_frame_count = self->emitted_frame_count_ + 1;
+      if (target_frame_count <= emitted_frame_count_) {
+        target_frame_count = emitted_frame_count_ + 1;
       }
 
       // Allow meaningful catch-up so output frame count tracks wallclock time.
-      const uint64_t max_burst = std::max<uint64_t>(self->fps_, 8);
-      uint64_t frames_to_emit = target_frame_count - self->emitted_frame_count_;
+      const uint64_t max_burst = std::max<uint64_t>(options_.fps, 8);
+      uint64_t frames_to_emit = target_frame_count - emitted_frame_count_;
       frames_to_emit = std::min(frames_to_emit, max_burst);
 
-      std::string write_error;
-      for (uint64_t n = 0; n < frames_to_emit; ++n) {
-        if (!self->ffmpeg_writer_->WriteFrame(
-                self->last_frame_buffer_.data(), self->frame_size_bytes_, &write_error)) {
-          self->stream_failed_ = true;
-          self->stream_error_ = write_error;
-          if (self->loop_) {
-            pw_main_loop_quit(self->loop_);
-          }
-          break;
+      // Duplicates travel as a repeat count on one queue entry. If a queue is
+      // full, the missed repeats are carried over to that rendition's next
+      // frame so its timeline still tracks wallclock time. At most one burst
+      // is carried: a writer that is already behind would only fall further
+      // back paying off more, so older slots are dropped instead.
+      const uint64_t fps = std::max<uint32_t>(options_.fps, 1);
+      for (auto& output : outputs_) {
+        const uint64_t repeat = frames_to_emit + output.pending_repeats;
+        // Carried-over repeats keep the slots they were due in.
+        const uint64_t first_index = emitted_frame_count_ - output.pending_repeats;
+        const int64_t timestamp_us = static_cast<int64_t>(first_index * 1000000 / fps);
+        if (output.worker->Enqueue(last_frame_,
+                                   static_cast<uint32_t>(repeat),
+                                   timestamp_us,
+                                   static_cast<int64_t>(1000000 / fps))) {
+          output.pending_repeats = 0;
+        } else if (repeat > max_burst) {
+          output.worker->DropFrames(repeat - max_burst);
+          output.pending_repeats = max_burst;
+        } else {
+          output.pending_repeats = repeat;
         }
-        ++self->emitted_frame_count_;
-        frame_bytes += self->frame_size_bytes_;
-        frame_written = true;
       }
-      if (self->stream_failed_) {
-        break;
-      }
-
+      emitted_frame_count_ += frames_to_emit;
+      frames_duplicated_ += frame_updated ? frames_to_emit - 1 : frames_to_emit;
+      // The newest slot against elapsed time, which is what audio is stamped with.
+      timing_.av_offset_us =
+          static_cast<int64_t>((emitted_frame_count_ - 1) * 1000000 / fps) -
+          std::chrono::duration_cast<std::chrono::microseconds>(now - video_start_time_).count();
+      frame_bytes += frames_to_emit * last_frame_.size();
+      frame_written = true;
       break;
     } else {
-      const size_t written = fwrite(bytes, 1, size, self->output_file_);
+      const size_t written = fwrite(bytes, 1, size, output_file_);
       if (written != size) {
-        self->stream_failed_ = true;
-        self->stream_error_ = "Failed writing raw frame data";
-        if (self->loop_) {
-          pw_main_loop_quit(self->loop_);
+        stream_failed_ = true;
+        stream_error_ = "Failed writing raw frame data";
+        if (loop_) {
+          pw_main_loop_quit(loop_);
         }
         break;
       }
@@ -230,39 +774,351 @@ void PipeWireCapture::OnProcess(void* data) {
     }
   }
 
-  pw_stream_queue_buffer(self->stream_, buffer);
-
   if (frame_written && frame_bytes > 0) {
-    self->bytes_written_ += frame_bytes;
-    const uint32_t frame = ++self->frame_count_;
-    if (self->max_frames_ > 0 && frame >= self->max_frames_ && self->loop_) {
-      pw_main_loop_quit(self->loop_);
+    bytes_written_ += frame_bytes;
+    const uint32_t frame = ++frame_count_;
+    if (max_frames_ > 0 && frame >= max_frames_ && loop_) {
+      pw_main_loop_quit(loop_);
     }
   }
 
-  if (self->stream_failed_ && self->loop_) {
-    pw_main_loop_quit(self->loop_);
+  if (metrics_sink_ && arrival - last_metrics_ >= kMetricsInterval) {
+    PublishMetrics(arrival);
   }
-  if (self->stop_requested_ && self->loop_) {
-    pw_main_loop_quit(self->loop_);
+
+  if (stream_failed_ && loop_) {
+    pw_main_loop_quit(loop_);
+  }
+  if (stop_requested_ && loop_) {
+    pw_main_loop_quit(loop_);
   }
 }
 
-bool PipeWireCapture::Init(std::string* error_out) {
-  if (encode_mp4_) {
-    ffmpeg_writer_ = new FfmpegWriter();
-    if (!ffmpeg_writer_->Start(width_, height_, fps_, output_path_, capture_audio_, audio_device_,
-                               output_height_,
-                               error_out)) {
+void PipeWireCapture::OnAudioProcess(void* data) {
+  auto* self = static_cast<PipeWireCapture*>(data);
+  struct pw_buffer* buffer = pw_stream_dequeue_buffer(self->audio_stream_);
+  if (!buffer) {
+    return;
+  }
+  const struct spa_data& block = buffer->buffer->datas[0];
+  const size_t frame_bytes = sizeof(float) * kCaptureAudioChannels;
+  const uint8_t* bytes = static_cast<const uint8_t*>(block.data);
+  size_t frames = 0;
+  if (bytes && block.chunk) {
+    const uint32_t offset = std::min(block.chunk->offset, block.maxsize);
+    bytes += offset;
+    frames = std::min(block.chunk->size, block.maxsize - offset) / frame_bytes;
+  }
+
+  int64_t origin_ns = 0;
+  if (frames > 0 && !self->outputs_.empty() && self->VideoOriginNs(&origin_ns)) {
+    // The newest sample was captured |delay| before |now|, so the block
+    // started that much plus its own length earlier.
+    struct pw_time time {};
+    int64_t now_ns = 0;
+    int64_t delay_ns = 0;
+    if (pw_stream_get_time_n(self->audio_stream_, &time, sizeof(time)) == 0 && time.now > 0) {
+      now_ns = time.now;
+      if (time.rate.denom > 0) {
+        delay_ns = time.delay * 1000000000LL * time.rate.num / time.rate.denom;
+      }
+    } else {
+      struct timespec ts {};
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      now_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+    const int64_t start_ns = now_ns - delay_ns -
+                             static_cast<int64_t>(frames) * 1000000000LL / kCaptureAudioRate;
+    int64_t timestamp_us = (start_ns - origin_ns) / 1000;
+    const float* samples = reinterpret_cast<const float*>(bytes);
+    if (timestamp_us < 0) {
+      // Only what was heard from the first frame on belongs in the file.
+      const size_t skip = std::min<size_t>(
+          frames, static_cast<size_t>(-timestamp_us) * kCaptureAudioRate / 1000000);
+      samples += skip * kCaptureAudioChannels;
+      frames -= skip;
+      timestamp_us = 0;
+    }
+    // With every slot pinned some queue is full and would drop the block anyway.
+    FrameHandle block =
+        frames > 0 ? self->audio_pool_.Acquire(frames * frame_bytes) : FrameHandle();
+    if (block) {
+      std::memcpy(block.data(), samples, frames * frame_bytes);
+      for (auto& output : self->outputs_) {
+        output.worker->EnqueueAudio(block, timestamp_us);
+      }
+    }
+  }
+  pw_stream_queue_buffer(self->audio_stream_, buffer);
+}
+
+bool PipeWireCapture::VideoOriginNs(int64_t* origin_ns) const {
+  if (options_.variable_frame_rate) {
+    if (!timeline_started_) {
       return false;
     }
+    // Compositor pts and steady_clock arrival times are both CLOCK_MONOTONIC.
+    *origin_ns = timeline_base_ns_;
+    return true;
+  }
+  if (!video_clock_started_) {
+    return false;
+  }
+  *origin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   video_start_time_.time_since_epoch())
+                   .count();
+  return true;
+}
+
+void PipeWireCapture::ConfigureFrames() {
+  const FrameFormat format = options_.frame_format;
+  frame_size_bytes_ = FrameFormatBytes(format, output_width_, output_height_);
+  if (width_ != output_width_ || height_ != output_height_) {
+    scale_source_.assign(FrameFormatBytes(format, width_, height_), 0);
+    scaler_.Configure(format, width_, height_, output_width_, output_height_);
   } else {
-    output_file_ = fopen(output_path_.c_str(), "wb");
+    scale_source_.clear();
+    scale_source_.shrink_to_fit();
+    scaler_.Reset();
+  }
+  frame_pool_.Reserve(frame_size_bytes_);
+}
+
+void PipeWireCapture::PublishMetrics(std::chrono::steady_clock::time_point now) {
+  last_metrics_ = now;
+  Metrics metrics;
+  metrics.published_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+  metrics.frames_captured = frames_full_.load(std::memory_order_relaxed) +
+                            frames_partial_.load(std::memory_order_relaxed);
+  metrics.frames_unchanged = frames_unchanged_.load(std::memory_order_relaxed);
+  metrics.frames_duplicated = frames_duplicated_.load(std::memory_order_relaxed);
+  metrics.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  metrics.compositor_drops = compositor_drops_.load(std::memory_order_relaxed);
+  // Only this thread changes the outputs, so they are read without the lock.
+  for (size_t i = 0; i < outputs_.size(); ++i) {
+    const EncoderWorker::Stats worker = outputs_[i].worker->GetStats();
+    metrics.frames_dropped += worker.enqueue_failures;
+    metrics.queue_depth = std::max<uint64_t>(metrics.queue_depth, worker.queue_depth);
+    if (i == 0) {
+      metrics.frames_encoded = worker.frames_written;
+      metrics.frame_write_p99_ns = outputs_[i].encoder->GetTransportStats().frame_write_ns.p99;
+      const EncoderProgress progress = outputs_[i].encoder->GetProgress();
+      metrics.encoder_progress = progress.reported;
+      metrics.encoder_speed = progress.speed;
+      metrics.encoder_fps = progress.fps;
+      metrics.encoder_bitrate_kbps = progress.bitrate_kbps;
+      metrics.encoder_out_time_us = progress.out_time_us;
+      metrics.encoder_dup_frames = progress.dup_frames;
+      metrics.encoder_drop_frames = progress.drop_frames;
+    }
+  }
+  const LatencyHistogram::Summary copy = copy_ns_.Summarize();
+  metrics.copy_p50_ns = copy.p50;
+  metrics.copy_p99_ns = copy.p99;
+  const LatencyHistogram::Summary interval = callback_interval_ns_.Summarize();
+  metrics.callback_interval_p50_ns = interval.p50;
+  metrics.callback_interval_p99_ns = interval.p99;
+  metrics_sink_->Store(metrics);
+}
+
+PipeWireCapture::TimingCounters PipeWireCapture::ReadTimingCounters(const Output& output) const {
+  TimingCounters counters;
+  counters.unique = frames_full_.load(std::memory_order_relaxed) +
+                    frames_partial_.load(std::memory_order_relaxed);
+  counters.duplicated = frames_duplicated_.load(std::memory_order_relaxed);
+  counters.dropped = frames_dropped_.load(std::memory_order_relaxed);
+  counters.compositor_drops = compositor_drops_.load(std::memory_order_relaxed);
+  const EncoderWorker::Stats worker = output.worker->GetStats();
+  counters.dropped += worker.enqueue_failures;
+  counters.writer_block_ns = worker.writer_stall_ns;
+  return counters;
+}
+
+void PipeWireCapture::AdvanceTiming(std::chrono::steady_clock::time_point now) {
+  if (!timing_enabled_) {
+    return;
+  }
+  // Only this thread changes the outputs, so they are read without the lock.
+  if (timing_start_ == std::chrono::steady_clock::time_point {}) {
+    timing_start_ = now;
+    for (auto& output : outputs_) {
+      if (output.timing_sidecar) {
+        output.timing_base = ReadTimingCounters(output);
+      }
+    }
+    return;
+  }
+  const auto second = static_cast<uint32_t>((now - timing_start_) / std::chrono::seconds(1));
+  if (second == timing_.second) {
+    return;
+  }
+  WriteTimingSecond(1000);
+  // Seconds in which not a single buffer arrived.
+  const int64_t av_offset_us = timing_.av_offset_us;
+  for (uint32_t idle = timing_.second + 1; idle < second; ++idle) {
+    TimingSecond empty;
+    empty.second = idle;
+    empty.av_offset_us = av_offset_us;
+    for (auto& output : outputs_) {
+      if (output.timing_sidecar) {
+        output.timing_sidecar->Write(empty);
+      }
+    }
+  }
+  timing_ = TimingSecond {};
+  timing_.second = second;
+  timing_.av_offset_us = av_offset_us;
+}
+
+void PipeWireCapture::WriteTimingSecond(uint32_t duration_ms) {
+  timing_.duration_ms = duration_ms;
+  for (auto& output : outputs_) {
+    if (!output.timing_sidecar) {
+      continue;
+    }
+    const TimingCounters counters = ReadTimingCounters(output);
+    const TimingCounters& base = output.timing_base;
+    TimingSecond line = timing_;
+    line.unique = static_cast<uint32_t>(counters.unique - base.unique);
+    line.duplicated = static_cast<uint32_t>(counters.duplicated - base.duplicated);
+    line.dropped = static_cast<uint32_t>(counters.dropped - base.dropped);
+    line.compositor_drops =
+        static_cast<uint32_t>(counters.compositor_drops - base.compositor_drops);
+    line.writer_block_us = (counters.writer_block_ns - base.writer_block_ns) / 1000;
+    output.timing_sidecar->Write(line);
+    output.timing_base = counters;
+  }
+}
+
+void PipeWireCapture::FinishTiming(std::chrono::steady_clock::time_point now) {
+  if (!timing_enabled_) {
+    return;
+  }
+  if (timing_start_ != std::chrono::steady_clock::time_point {}) {
+    AdvanceTiming(now);
+    const auto into_second = (now - timing_start_) % std::chrono::seconds(1);
+    WriteTimingSecond(static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(into_second).count()));
+  }
+  for (auto& output : outputs_) {
+    output.timing_sidecar.reset();
+  }
+  timing_enabled_ = false;
+}
+
+int64_t PipeWireCapture::VideoTimestampUs(const struct spa_meta_header* header,
+                                          std::chrono::steady_clock::time_point arrival) {
+  // Prefer the compositor's presentation time and fall back to arrival time
+  // for producers that leave the header pts unset.
+  const bool has_pts = header && header->pts > 0;
+  const bool first_frame = !timeline_started_;
+  int64_t timestamp_us = 0;
+  if (first_frame) {
+    timeline_started_ = true;
+    timeline_uses_pts_ = has_pts;
+    timeline_base_ns_ = has_pts ? header->pts
+                                : std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      arrival.time_since_epoch())
+                                      .count();
+  } else if (timeline_uses_pts_ && has_pts) {
+    timestamp_us = (header->pts - timeline_base_ns_) / 1000;
+  } else if (timeline_uses_pts_) {
+    timestamp_us = last_timestamp_us_ +
+                   std::chrono::duration_cast<std::chrono::microseconds>(arrival - last_arrival_)
+                       .count();
+  } else {
+    timestamp_us = (std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        arrival.time_since_epoch())
+                        .count() -
+                    timeline_base_ns_) /
+                   1000;
+  }
+  if (!first_frame && timestamp_us <= last_timestamp_us_) {
+    timestamp_us = last_timestamp_us_ + 1;
+  }
+  last_timestamp_us_ = timestamp_us;
+  last_arrival_ = arrival;
+  return timestamp_us;
+}
+
+bool PipeWireCapture::StartOutputs(std::string* error_out) {
+  if (encode_mp4_) {
+    ResolveEncoderProfiles();
+    for (const RecordingOptions& rendition : RenditionOptions(options_)) {
+      Output output;
+      output.encoder = CreateEncoder(rendition.encoder_backend, error_out);
+      if (!output.encoder ||
+          !output.encoder->Start(output_width_, output_height_, rendition, error_out)) {
+        return false;
+      }
+      output.worker = std::make_unique<EncoderWorker>(kEncoderQueueCapacity, kMaxQueuedFrames);
+      if (!output.worker->Start(output.encoder.get(), error_out)) {
+        return false;
+      }
+      if (rendition.timing_sidecar && !rendition.output_path.empty()) {
+        TimingSidecarHeader header;
+        header.fps = rendition.fps;
+        std::tie(header.width, header.height) =
+            ComputeOutputDimensions(output_width_, output_height_, rendition.output_height);
+        header.variable_frame_rate = rendition.variable_frame_rate;
+        header.encoder = output.encoder->name();
+        // Diagnostics only: the recording goes ahead without its sidecar.
+        auto sidecar = std::make_unique<TimingSidecarWriter>();
+        std::string sidecar_error;
+        if (sidecar->Open(TimingSidecarPath(rendition.output_path), header, &sidecar_error)) {
+          output.timing_sidecar = std::move(sidecar);
+          timing_enabled_ = true;
+        }
+      }
+      std::lock_guard<std::mutex> lock(encoder_mutex_);
+      outputs_.push_back(std::move(output));
+    }
+  } else {
+    output_file_ = fopen(options_.output_path.c_str(), "wb");
     if (!output_file_) {
       *error_out = "Failed to open output file: " + std::string(std::strerror(errno));
       return false;
     }
   }
+  return true;
+}
+
+void PipeWireCapture::ResolveEncoderProfiles() {
+  if (profiles_resolved_) {
+    return;
+  }
+  profiles_resolved_ = true;
+  if (!encode_mp4_ || !options_.autotune_encoder) {
+    return;
+  }
+  std::vector<EncoderProfile*> profiles = {&options_.encoder_profile};
+  std::vector<int> heights = {options_.output_height};
+  for (auto& output : options_.extra_outputs) {
+    profiles.push_back(&output.encoder_profile);
+    heights.push_back(output.output_height);
+  }
+  // Renditions sharing a codec and size share one measurement.
+  std::map<std::tuple<std::string, int, int>, std::string> tuned;
+  for (size_t i = 0; i < profiles.size(); ++i) {
+    const auto size = ComputeOutputDimensions(output_width_, output_height_, heights[i]);
+    const auto key = std::make_tuple(profiles[i]->codec, size.first, size.second);
+    const auto found = tuned.find(key);
+    if (found != tuned.end()) {
+      profiles[i]->preset = found->second;
+      continue;
+    }
+    // Without a measurement the requested preset is still a valid choice.
+    std::string autotune_error;
+    AutotuneEncoderProfile(size.first, size.second, options_.fps, profiles[i], &autotune_error);
+    tuned.emplace(key, profiles[i]->preset);
+  }
+}
+
+bool PipeWireCapture::Init(std::string* error_out) {
+  if (!StartOutputs(error_out)) {
+    return false;
+  }
 
   pw_init(nullptr, nullptr);
 
@@ -308,23 +1164,70 @@ bool PipeWireCapture::ConnectStream(std::string* error_out) {
 
   pw_stream_add_listener(stream_, &stream_listener_, &stream_events_, this);
 
-  uint8_t buffer[256];
+  uint8_t buffer[1024];
   struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
-  const struct spa_pod* params[1];
-  params[0] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
-      &builder,
-      SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
-      SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
-      SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-      SPA_FORMAT_VIDEO_format, SPA_POD_Id(SPA_VIDEO_FORMAT_BGRx)));
+  const struct spa_pod* params[2];
+  uint32_t n_params = 0;
+  if (!encode_mp4_) {
+    // Raw dumps are written as delivered, so they stay BGRx at the source rate.
+    params[n_params++] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+        &builder,
+        SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+        SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+        SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+        SPA_FORMAT_VIDEO_format, SPA_POD_Id(SPA_VIDEO_FORMAT_BGRx)));
+  } else {
+    // Ask the compositor for frames at the output size and no faster than we
+    // encode; it can scale and throttle far more cheaply than we can.
+    struct spa_rectangle preferred_size =
+        SPA_RECTANGLE(static_cast<uint32_t>(std::max(output_width_, 1)),
+                      static_cast<uint32_t>(std::max(output_height_, 1)));
+    struct spa_rectangle min_size = SPA_RECTANGLE(1, 1);
+    struct spa_rectangle max_size = SPA_RECTANGLE(kMaxStreamDimension, kMaxStreamDimension);
+    struct spa_fraction variable_rate = SPA_FRACTION(0, 1);
+    struct spa_fraction max_rate = SPA_FRACTION(std::max<uint32_t>(options_.fps, 1), 1);
+    struct spa_fraction min_rate = SPA_FRACTION(0, 1);
+
+    // Packed RGB in any byte order; BGRx first since bgr0 output copies it as is.
+    params[n_params++] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+        &builder,
+        SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+        SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+        SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+        SPA_FORMAT_VIDEO_format, SPA_POD_CHOICE_ENUM_Id(9,
+            SPA_VIDEO_FORMAT_BGRx,
+            SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_BGRA,
+            SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_RGBA,
+            SPA_VIDEO_FORMAT_xRGB, SPA_VIDEO_FORMAT_ARGB,
+            SPA_VIDEO_FORMAT_xBGR, SPA_VIDEO_FORMAT_ABGR),
+        SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(
+            &preferred_size, &min_size, &max_size),
+        SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&variable_rate),
+        SPA_FORMAT_VIDEO_maxFramerate, SPA_POD_CHOICE_RANGE_Fraction(
+            &max_rate, &min_rate, &max_rate)));
+    if (options_.frame_format != FrameFormat::kBgr0) {
+      // NV12 only needs a plane copy for a 4:2:0 target.
+      params[n_params++] = static_cast<const spa_pod*>(spa_pod_builder_add_object(
+          &builder,
+          SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+          SPA_FORMAT_mediaType, SPA_POD_Id(SPA_MEDIA_TYPE_video),
+          SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+          SPA_FORMAT_VIDEO_format, SPA_POD_Id(SPA_VIDEO_FORMAT_NV12),
+          SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(
+              &preferred_size, &min_size, &max_size),
+          SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&variable_rate),
+          SPA_FORMAT_VIDEO_maxFramerate, SPA_POD_CHOICE_RANGE_Fraction(
+              &max_rate, &min_rate, &max_rate)));
+    }
+  }
 
   const int rv = pw_stream_connect(
       stream_,
       PW_DIRECTION_INPUT,
       node_id_,
-      static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS),
+      PW_STREAM_FLAG_AUTOCONNECT,
       params,
-      1);
+      n_params);
   if (rv != 0) {
     *error_out = "Failed to connect PipeWire stream";
     return false;
@@ -332,6 +1235,64 @@ bool PipeWireCapture::ConnectStream(std::string* error_out) {
   return true;
 }
 
+bool PipeWireCapture::ConnectAudioStream(std::string* error_out) {
+  audio_core_ = pw_context_connect(context_, nullptr, 0);
+  if (!audio_core_) {
+    *error_out = "Failed to connect PipeWire core for audio";
+    return false;
+  }
+
+  struct pw_properties* props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio",
+                                                  PW_KEY_MEDIA_CATEGORY, "Capture",
+                                                  PW_KEY_NODE_NAME, "screen-recorder-audio",
+                                                  nullptr);
+  std::string target = options_.audio_device;
+  if (target == "default") {
+    target.clear();
+  }
+  const size_t suffix_length = sizeof(kMonitorSuffix) - 1;
+  if (target.size() > suffix_length &&
+      target.compare(target.size() - suffix_length, suffix_length, kMonitorSuffix) == 0) {
+    target.resize(target.size() - suffix_length);
+    pw_properties_set(props, PW_KEY_STREAM_CAPTURE_SINK, "true");
+  }
+  if (!target.empty()) {
+    pw_properties_set(props, PW_KEY_TARGET_OBJECT, target.c_str());
+  }
+
+  audio_stream_ = pw_stream_new(audio_core_, "screen-recorder-audio", props);
+  if (!audio_stream_) {
+    *error_out = "Failed to create PipeWire audio stream";
+    return false;
+  }
+  pw_stream_add_listener(audio_stream_, &audio_listener_, &audio_events_, this);
+
+  uint8_t buffer[1024];
+  struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+  struct spa_audio_info_raw info {};
+  info.format = SPA_AUDIO_FORMAT_F32;
+  info.rate = kCaptureAudioRate;
+  info.channels = kCaptureAudioChannels;
+  info.position[0] = SPA_AUDIO_CHANNEL_FL;
+  info.position[1] = SPA_AUDIO_CHANNEL_FR;
+  const struct spa_pod* params[1] = {
+      spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info)};
+
+  const int rv = pw_stream_connect(
+      audio_stream_,
+      PW_DIRECTION_INPUT,
+      PW_ID_ANY,
+      static_cast<enum pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
+                                        PW_STREAM_FLAG_MAP_BUFFERS),
+      params,
+      1);
+  if (rv != 0) {
+    *error_out = "Failed to connect PipeWire audio stream";
+    return false;
+  }
+  return true;
+}
+
 bool PipeWireCapture::Run(std::string* error_out) {
   if (!Init(error_out)) {
     return false;
@@ -339,17 +1300,57 @@ bool PipeWireCapture::Run(std::string* error_out) {
   if (!ConnectStream(error_out)) {
     return false;
   }
+  if (encode_mp4_ && options_.capture_audio && !ConnectAudioStream(error_out)) {
+    return false;
+  }
 
   pw_main_loop_run(loop_);
+  return FinishOutputs(error_out);
+}
+
+bool PipeWireCapture::StartHeadless(const struct spa_video_info_raw& info,
+                                    std::string* error_out) {
+  if (!StartOutputs(error_out)) {
+    return false;
+  }
+  ApplyFormat(info);
+  return true;
+}
+
+bool PipeWireCapture::FinishOutputs(std::string* error_out) {
+  if (options_.variable_frame_rate && !outputs_.empty() && last_frame_ && timeline_started_) {
+    // Repeat the last frame at stop time so it keeps its on-screen duration.
+    const int64_t timestamp_us = VideoTimestampUs(nullptr, std::chrono::steady_clock::now());
+    for (auto& output : outputs_) {
+      output.worker->Enqueue(last_frame_, 1, timestamp_us);
+    }
+    ++frames_duplicated_;
+  }
 
   if (output_file_) {
     fflush(output_file_);
   }
-  if (ffmpeg_writer_) {
-    if (!ffmpeg_writer_->Stop(error_out)) {
-      return false;
+  // Every writer drains its own queue; the first error wins.
+  for (auto& output : outputs_) {
+    std::string worker_error;
+    if (!output.worker->Stop(&worker_error) && !stream_failed_) {
+      stream_failed_ = true;
+      stream_error_ = worker_error;
+    }
+  }
+  // After the writers drained, so their last blocked time is counted.
+  FinishTiming(std::chrono::steady_clock::now());
+  bool encoders_ok = true;
+  for (auto& output : outputs_) {
+    std::string encoder_error;
+    if (!output.encoder->Stop(&encoder_error) && encoders_ok) {
+      encoders_ok = false;
+      *error_out = encoder_error;
     }
   }
+  if (!encoders_ok) {
+    return false;
+  }
 
   if (stream_failed_) {
     *error_out = stream_error_.empty() ? "PipeWire stream failed" : stream_error_;
@@ -362,6 +1363,53 @@ bool PipeWireCapture::Run(std::string* error_out) {
   return true;
 }
 
+PipeWireCapture::Stats PipeWireCapture::GetStats() const {
+  Stats stats;
+  stats.frames_full = frames_full_.load(std::memory_order_relaxed);
+  stats.frames_partial = frames_partial_.load(std::memory_order_relaxed);
+  stats.frames_unchanged = frames_unchanged_.load(std::memory_order_relaxed);
+  stats.frames_dropped = frames_dropped_.load(std::memory_order_relaxed);
+  stats.frames_corrupted = frames_corrupted_.load(std::memory_order_relaxed);
+  stats.compositor_drops = compositor_drops_.load(std::memory_order_relaxed);
+  stats.bytes_copied = bytes_copied_.load(std::memory_order_relaxed);
+  stats.frames_duplicated = frames_duplicated_.load(std::memory_order_relaxed);
+  stats.dequeue_to_copy_ns = dequeue_to_copy_ns_.Summarize();
+  stats.copy_ns = copy_ns_.Summarize();
+  stats.callback_interval_ns = callback_interval_ns_.Summarize();
+  return stats;
+}
+
+size_t PipeWireCapture::output_count() const {
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  return outputs_.size();
+}
+
+EncoderWorker::Stats PipeWireCapture::GetEncoderStats(size_t output) const {
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  return output < outputs_.size() ? outputs_[output].worker->GetStats() : EncoderWorker::Stats {};
+}
+
+TransportStats PipeWireCapture::GetTransportStats(size_t output) const {
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  return output < outputs_.size() ? outputs_[output].encoder->GetTransportStats()
+                                  : TransportStats {};
+}
+
+EncoderProgress PipeWireCapture::GetEncoderProgress(size_t output) const {
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  return output < outputs_.size() ? outputs_[output].encoder->GetProgress() : EncoderProgress {};
+}
+
+std::unique_ptr<ReplayClip> PipeWireCapture::SnapshotReplay(double seconds,
+                                                            std::string* error_out) {
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  if (outputs_.empty()) {
+    *error_out = "Encoder is not running";
+    return nullptr;
+  }
+  return outputs_.front().encoder->SnapshotReplay(seconds, error_out);
+}
+
 void PipeWireCapture::RequestStop() {
   stop_requested_ = true;
   if (loop_) {
@@ -370,10 +1418,19 @@ void PipeWireCapture::RequestStop() {
 }
 
 void PipeWireCapture::Shutdown() {
+  if (audio_stream_) {
+    pw_stream_destroy(audio_stream_);
+    audio_stream_ = nullptr;
+  }
+  if (audio_core_) {
+    pw_core_disconnect(audio_core_);
+    audio_core_ = nullptr;
+  }
   if (stream_) {
     pw_stream_destroy(stream_);
     stream_ = nullptr;
   }
+  buffer_mappings_.clear();
   if (core_) {
     pw_core_disconnect(core_);
     core_ = nullptr;
@@ -390,10 +1447,17 @@ void PipeWireCapture::Shutdown() {
     fclose(output_file_);
     output_file_ = nullptr;
   }
-  if (ffmpeg_writer_) {
+  // Sidecars still open are closed along with their outputs below.
+  timing_enabled_ = false;
+  for (auto& output : outputs_) {
+    std::string ignored;
+    output.worker->Stop(&ignored);
+  }
+  last_frame_.Reset();
+  for (auto& output : outputs_) {
     std::string ignored;
-    ffmpeg_writer_->Stop(&ignored);
-    delete ffmpeg_writer_;
-    ffmpeg_writer_ = nullptr;
+    output.encoder->Stop(&ignored);
   }
+  std::lock_guard<std::mutex> lock(encoder_mutex_);
+  outputs_.clear();
 }
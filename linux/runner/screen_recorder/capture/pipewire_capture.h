@@ -6,56 +6,209 @@
 #include <cstdio>
 #include <pipewire/pipewire.h>
 #include <spa/param/video/raw.h>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "color_convert.h"
+#include "encoder.h"
+#include "encoder_worker.h"
+#include "frame_pool.h"
+#include "frame_scaler.h"
+#include "latency_histogram.h"
+#include "recording_options.h"
+#include "seqlock.h"
+#include "timing_sidecar.h"
+
 class PipeWireCapture {
  public:
+  struct Stats {
+    uint64_t frames_full = 0;
+    // Only the damaged rectangles were copied into the persistent frame.
+    uint64_t frames_partial = 0;
+    // Damage metadata reported no change, so nothing was copied.
+    uint64_t frames_unchanged = 0;
+    // Buffers skipped because every frame slot was still queued.
+    uint64_t frames_dropped = 0;
+    uint64_t frames_corrupted = 0;
+    // Sequence numbers the compositor skipped before we saw the buffer.
+    uint64_t compositor_drops = 0;
+    uint64_t bytes_copied = 0;
+    // Constant frame rate slots filled by repeating an earlier frame.
+    uint64_t frames_duplicated = 0;
+    // From the compositor's presentation time (dequeue time without one) to
+    // the start of the copy.
+    LatencyHistogram::Summary dequeue_to_copy_ns;
+    // Conversion and scaling of one buffer into a pooled frame.
+    LatencyHistogram::Summary copy_ns;
+    // Between consecutive video process callbacks; its spread is the jitter.
+    LatencyHistogram::Summary callback_interval_ns;
+  };
+
+  // Compact snapshot the capture thread publishes a few times a second, for
+  // readers that must not touch the capture itself. Durations are in ns.
+  struct Metrics {
+    // Monotonic time the snapshot was taken.
+    int64_t published_ns = 0;
+    uint64_t frames_captured = 0;
+    uint64_t frames_unchanged = 0;
+    uint64_t frames_duplicated = 0;
+    // Capture drops plus frames any writer queue refused.
+    uint64_t frames_dropped = 0;
+    uint64_t compositor_drops = 0;
+    // Frames the primary encoder has taken.
+    uint64_t frames_encoded = 0;
+    // Deepest writer queue across outputs.
+    uint64_t queue_depth = 0;
+    uint64_t copy_p50_ns = 0;
+    uint64_t copy_p99_ns = 0;
+    uint64_t callback_interval_p50_ns = 0;
+    uint64_t callback_interval_p99_ns = 0;
+    uint64_t frame_write_p99_ns = 0;
+    // The primary encoder's own progress report, when its backend sends one.
+    bool encoder_progress = false;
+    double encoder_speed = 0;
+    double encoder_fps = 0;
+    double encoder_bitrate_kbps = 0;
+    int64_t encoder_out_time_us = 0;
+    uint64_t encoder_dup_frames = 0;
+    uint64_t encoder_drop_frames = 0;
+  };
+
   PipeWireCapture(uint32_t node_id,
                   int pipewire_fd,
                   int width,
                   int height,
-                  uint32_t fps,
-                  std::string output_path,
+                  RecordingOptions options,
                   uint32_t max_frames,
-                  bool encode_mp4,
-                  bool capture_audio,
-                  std::string audio_device,
-                  int output_height);
+                  bool encode_mp4);
   ~PipeWireCapture();
 
+  // Swaps each rendition's preset for the autotuned one when
+  // RecordingOptions::autotune_encoder is set. A first measurement runs
+  // ffmpeg for seconds, so callers that report progress do this before Run,
+  // which otherwise does it itself.
+  void ResolveEncoderProfiles();
   bool Run(std::string* error_out);
   void RequestStop();
+  Stats GetStats() const;
+  // Publishes Metrics into |metrics| while running. Must be set before Run;
+  // |metrics| has to outlive the capture thread's use of it.
+  void PublishMetricsTo(Seqlock<Metrics>* metrics) { metrics_sink_ = metrics; }
+  // Renditions being encoded; index 0 is the primary output.
+  size_t output_count() const;
+  EncoderWorker::Stats GetEncoderStats(size_t output = 0) const;
+  TransportStats GetTransportStats(size_t output = 0) const;
+  EncoderProgress GetEncoderProgress(size_t output = 0) const;
+  // Snapshot of the primary encoder's replay ring; callable from any thread.
+  std::unique_ptr<ReplayClip> SnapshotReplay(double seconds, std::string* error_out);
+
+  // Drives the frame path without a PipeWire stream, for benchmarks: start the
+  // outputs as if the stream had negotiated |info|, hand over buffers the way
+  // OnProcess does, then drain and stop. Buffers without user_data are read
+  // through their spa_data pointers.
+  bool StartHeadless(const struct spa_video_info_raw& info, std::string* error_out);
+  void ProcessVideoBuffer(struct pw_buffer* buffer);
+  bool FinishOutputs(std::string* error_out);
 
   static void OnStreamStateChanged(void* data,
                                    enum pw_stream_state old_state,
                                    enum pw_stream_state state,
                                    const char* error);
   static void OnStreamParamChanged(void* data, uint32_t id, const struct spa_pod* param);
+  static void OnAddBuffer(void* data, struct pw_buffer* buffer);
+  static void OnRemoveBuffer(void* data, struct pw_buffer* buffer);
   static void OnProcess(void* data);
+  static void OnAudioProcess(void* data);
 
  private:
+  // Readable address of every data block of one stream buffer. MemFd blocks
+  // are mapped when the buffer is added and unmapped when it is removed.
+  struct BufferMapping {
+    struct Region {
+      int64_t fd = -1;
+      void* base = nullptr;
+      size_t length = 0;
+    };
+    ~BufferMapping();
+    std::vector<const uint8_t*> planes;
+    std::vector<Region> regions;
+  };
+
+  // Payload of data block |index|, or nullptr when it is not readable.
+  static const uint8_t* PlaneData(const struct pw_buffer* buffer, uint32_t index);
+
+  // Opens the encoders and their writer threads, or the raw output file.
+  bool StartOutputs(std::string* error_out);
   bool Init(std::string* error_out);
   bool ConnectStream(std::string* error_out);
+  // Records options_.audio_device on its own stream, stamped on the same
+  // CLOCK_MONOTONIC timeline as the video frames.
+  bool ConnectAudioStream(std::string* error_out);
+  // Session start on the monotonic clock, once the first frame has been sent.
+  bool VideoOriginNs(int64_t* origin_ns) const;
   void Shutdown();
+  // Sizes frames for the current stream and sets up scaling to the output size.
+  void ConfigureFrames();
+  void ApplyFormat(const struct spa_video_info_raw& info);
+  void PublishMetrics(std::chrono::steady_clock::time_point now);
+
+  // Running totals the timing sidecars report per-second differences of.
+  struct TimingCounters {
+    uint64_t unique = 0;
+    uint64_t duplicated = 0;
+    uint64_t dropped = 0;
+    uint64_t compositor_drops = 0;
+    uint64_t writer_block_ns = 0;
+  };
+  struct Output;
+  // Capture totals, which every rendition shares, plus |output|'s own drops
+  // and writer blocking.
+  TimingCounters ReadTimingCounters(const Output& output) const;
+  // Writes out every second of the sidecars that ended before |now|.
+  void AdvanceTiming(std::chrono::steady_clock::time_point now);
+  void WriteTimingSecond(uint32_t duration_ms);
+  // Writes the last, partial second and closes the sidecars.
+  void FinishTiming(std::chrono::steady_clock::time_point now);
+  int64_t VideoTimestampUs(const struct spa_meta_header* header,
+                           std::chrono::steady_clock::time_point arrival);
 
   uint32_t node_id_;
   int pipewire_fd_;
   int width_;
   int height_;
+  // Size of every frame handed to the encoder, fixed when recording starts.
+  int output_width_ = 0;
+  int output_height_ = 0;
   int stream_width_ = 0;
   int stream_height_ = 0;
   int stream_stride_ = 0;
-  uint32_t fps_;
-  std::string output_path_;
+  PixelLayout source_layout_ = PixelLayout::kBGRx;
+  bool source_nv12_ = false;
+  RecordingOptions options_;
   uint32_t max_frames_;
   bool encode_mp4_;
-  bool capture_audio_;
-  std::string audio_device_;
-  int output_height_;
+  bool profiles_resolved_ = false;
+
+  // One rendition: its encoder, the writer thread feeding it and the CFR
+  // repeats its queue could not take yet. Workers are independent, so a slow
+  // encoder only costs its own rendition frames.
+  struct Output {
+    std::unique_ptr<Encoder> encoder;
+    std::unique_ptr<EncoderWorker> worker;
+    uint64_t pending_repeats = 0;
+    // Null without a sidecar next to this rendition's file.
+    std::unique_ptr<TimingSidecarWriter> timing_sidecar;
+    TimingCounters timing_base;
+  };
 
   FILE* output_file_ = nullptr;
-  class FfmpegWriter* ffmpeg_writer_ = nullptr;
+  // Only the capture thread adds or clears outputs; other threads read them
+  // under this lock.
+  mutable std::mutex encoder_mutex_;
+  std::vector<Output> outputs_;
   struct pw_main_loop* loop_ = nullptr;
   struct pw_context* context_ = nullptr;
   struct pw_core* core_ = nullptr;
@@ -63,14 +216,53 @@ class PipeWireCapture {
   struct pw_stream_events stream_events_ {};
   struct spa_hook stream_listener_ {};
   struct spa_video_info_raw video_info_ {};
+  // The portal fd only exposes the screencast node, so audio goes through a
+  // second connection to the user's PipeWire daemon on the same loop.
+  struct pw_core* audio_core_ = nullptr;
+  struct pw_stream* audio_stream_ = nullptr;
+  struct pw_stream_events audio_events_ {};
+  struct spa_hook audio_listener_ {};
+  std::unordered_map<struct pw_buffer*, std::unique_ptr<BufferMapping>> buffer_mappings_;
   std::atomic<uint32_t> frame_count_ {0};
   std::atomic<uint64_t> bytes_written_ {0};
   size_t frame_size_bytes_ = 0;
-  std::vector<uint8_t> frame_buffer_;
-  std::vector<uint8_t> last_frame_buffer_;
+  FramePool frame_pool_;
+  // Audio blocks, each copied once and shared by every output's queue.
+  FramePool audio_pool_;
+  FrameHandle last_frame_;
+  // When the stream size differs from the output size, buffers are converted
+  // into |scale_source_| at stream size and scaled from there.
+  FrameScaler scaler_;
+  std::vector<uint8_t> scale_source_;
   bool video_clock_started_ = false;
   std::chrono::steady_clock::time_point video_start_time_ {};
   uint64_t emitted_frame_count_ = 0;
+  bool damage_base_valid_ = false;
+  bool has_last_seq_ = false;
+  uint64_t last_seq_ = 0;
+  bool timeline_started_ = false;
+  bool timeline_uses_pts_ = false;
+  int64_t timeline_base_ns_ = 0;
+  int64_t last_timestamp_us_ = 0;
+  std::chrono::steady_clock::time_point last_arrival_ {};
+  std::atomic<uint64_t> frames_full_ {0};
+  std::atomic<uint64_t> frames_partial_ {0};
+  std::atomic<uint64_t> frames_unchanged_ {0};
+  std::atomic<uint64_t> frames_dropped_ {0};
+  std::atomic<uint64_t> frames_corrupted_ {0};
+  std::atomic<uint64_t> compositor_drops_ {0};
+  std::atomic<uint64_t> bytes_copied_ {0};
+  std::atomic<uint64_t> frames_duplicated_ {0};
+  LatencyHistogram dequeue_to_copy_ns_;
+  LatencyHistogram copy_ns_;
+  LatencyHistogram callback_interval_ns_;
+  std::chrono::steady_clock::time_point last_callback_ {};
+  Seqlock<Metrics>* metrics_sink_ = nullptr;
+  std::chrono::steady_clock::time_point last_metrics_ {};
+  // The second being accumulated; each output keeps the counters at its start.
+  bool timing_enabled_ = false;
+  TimingSecond timing_;
+  std::chrono::steady_clock::time_point timing_start_ {};
   std::atomic<bool> stop_requested_ {false};
   bool stream_failed_ = false;
   std::string stream_error_;
@@ -0,0 +1,153 @@
+#include "timing_sidecar.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Finds the value of |key| in one flat JSON object line, as written below.
+const char* FindValue(const std::string& line, const char* key) {
+  const std::string needle = std::string("\"") + key + "\":";
+  const size_t pos = line.find(needle);
+  return pos == std::string::npos ? nullptr : line.c_str() + pos + needle.size();
+}
+
+template <typename T>
+bool ReadInt(const std::string& line, const char* key, T* value) {
+  const char* text = FindValue(line, key);
+  if (!text) {
+    return false;
+  }
+  char* end = nullptr;
+  const long long parsed = std::strtoll(text, &end, 10);
+  if (end == text) {
+    return false;
+  }
+  *value = static_cast<T>(parsed);
+  return true;
+}
+
+bool ReadSecond(const std::string& line, TimingSecond* second) {
+  if (!ReadInt(line, "t", &second->second)) {
+    return false;
+  }
+  // Fields are optional so that later versions can drop or add some.
+  ReadInt(line, "ms", &second->duration_ms);
+  ReadInt(line, "received", &second->received);
+  ReadInt(line, "unique", &second->unique);
+  ReadInt(line, "duplicated", &second->duplicated);
+  ReadInt(line, "dropped", &second->dropped);
+  ReadInt(line, "compositor_drops", &second->compositor_drops);
+  ReadInt(line, "max_gap_us", &second->max_gap_us);
+  ReadInt(line, "writer_block_us", &second->writer_block_us);
+  ReadInt(line, "av_offset_us", &second->av_offset_us);
+  return true;
+}
+
+void ReadHeader(const std::string& line, TimingSidecarHeader* header) {
+  ReadInt(line, "version", &header->version);
+  ReadInt(line, "fps", &header->fps);
+  ReadInt(line, "width", &header->width);
+  ReadInt(line, "height", &header->height);
+  if (const char* vfr = FindValue(line, "variable_frame_rate")) {
+    header->variable_frame_rate = std::strncmp(vfr, "true", 4) == 0;
+  }
+  if (const char* encoder = FindValue(line, "encoder"); encoder && *encoder == '"') {
+    const char* end = std::strchr(encoder + 1, '"');
+    if (end) {
+      header->encoder.assign(encoder + 1, end);
+    }
+  }
+}
+
+}  // namespace
+
+std::string TimingSidecarPath(const std::string& output_path) {
+  return output_path + ".timing.jsonl";
+}
+
+TimingSidecarWriter::~TimingSidecarWriter() {
+  Close();
+}
+
+bool TimingSidecarWriter::Open(const std::string& path,
+                               const TimingSidecarHeader& header,
+                               std::string* error_out) {
+  Close();
+  file_ = fopen(path.c_str(), "w");
+  if (!file_) {
+    *error_out = "Failed to open timing sidecar: " + std::string(std::strerror(errno));
+    return false;
+  }
+  // The encoder name is one of the backends' fixed identifiers, so it needs
+  // no escaping.
+  std::fprintf(file_,
+               "{\"version\":%d,\"fps\":%u,\"width\":%d,\"height\":%d,"
+               "\"variable_frame_rate\":%s,\"encoder\":\"%s\"}\n",
+               header.version, header.fps, header.width, header.height,
+               header.variable_frame_rate ? "true" : "false", header.encoder.c_str());
+  fflush(file_);
+  write_av_offset_ = !header.variable_frame_rate;
+  return true;
+}
+
+void TimingSidecarWriter::Write(const TimingSecond& second) {
+  if (!file_) {
+    return;
+  }
+  std::fprintf(file_,
+               "{\"t\":%u,\"ms\":%u,\"received\":%u,\"unique\":%u,\"duplicated\":%u,"
+               "\"dropped\":%u,\"compositor_drops\":%u,\"max_gap_us\":%u,"
+               "\"writer_block_us\":%" PRIu64,
+               second.second, second.duration_ms, second.received, second.unique,
+               second.duplicated, second.dropped, second.compositor_drops, second.max_gap_us,
+               second.writer_block_us);
+  if (write_av_offset_) {
+    std::fprintf(file_, ",\"av_offset_us\":%" PRId64, second.av_offset_us);
+  }
+  std::fputs("}\n", file_);
+  fflush(file_);
+}
+
+void TimingSidecarWriter::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+bool ReadTimingSidecar(const std::string& path,
+                       TimingSidecarHeader* header,
+                       std::vector<TimingSecond>* seconds,
+                       std::string* error_out) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file) {
+    *error_out = "Failed to open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  bool has_header = false;
+  std::string line;
+  char chunk[256];
+  while (std::fgets(chunk, sizeof(chunk), file)) {
+    line += chunk;
+    if (line.back() != '\n' && !std::feof(file)) {
+      continue;
+    }
+    TimingSecond second;
+    if (ReadSecond(line, &second)) {
+      seconds->push_back(second);
+    } else if (!has_header && FindValue(line, "version")) {
+      ReadHeader(line, header);
+      has_header = true;
+    }
+    line.clear();
+  }
+  fclose(file);
+  if (!has_header) {
+    *error_out = path + " is not a timing sidecar";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Per-second capture timing of one output file, kept next to it as JSON
+// lines: a header object, then one object per second of the recording. Every
+// rendition of a recording gets its own; capture counters are the same in
+// each, drops and writer blocking are the rendition's own.
+// Seconds without a single buffer still get a line, so stalls show up as
+// zeros rather than as missing data.
+
+struct TimingSidecarHeader {
+  int version = 1;
+  uint32_t fps = 0;
+  int width = 0;
+  int height = 0;
+  bool variable_frame_rate = false;
+  std::string encoder;
+};
+
+struct TimingSecond {
+  // Seconds since the first buffer; the line covers [second, second + 1).
+  uint32_t second = 0;
+  // Part of the second that was recorded, below 1000 only for the last line.
+  uint32_t duration_ms = 1000;
+  // Buffers dequeued from the PipeWire stream.
+  uint32_t received = 0;
+  // Distinct frames copied; the rest were unchanged, corrupted or dropped.
+  uint32_t unique = 0;
+  // Constant frame rate slots filled by repeating an earlier frame.
+  uint32_t duplicated = 0;
+  // Frames lost to a full frame pool or to this output's full writer queue.
+  uint32_t dropped = 0;
+  // Sequence numbers the compositor skipped before we saw the buffer.
+  uint32_t compositor_drops = 0;
+  // Longest interval between two process callbacks ending in this second.
+  uint32_t max_gap_us = 0;
+  // Time this output's writer thread spent blocked writing video frames.
+  uint64_t writer_block_us = 0;
+  // Where the last frame of the second sits on the video timeline minus
+  // where the monotonic clock that stamps audio puts it. Negative when video
+  // has fallen behind the audio. Not written for variable frame rate
+  // recordings, whose frames are stamped from that same clock and so cannot
+  // drift from it.
+  int64_t av_offset_us = 0;
+};
+
+// Sidecar of the recording written to |output_path|.
+std::string TimingSidecarPath(const std::string& output_path);
+
+// Appends lines from the capture thread. Each line is flushed as it is
+// written, so a crashed recording keeps everything up to its last second.
+class TimingSidecarWriter {
+ public:
+  TimingSidecarWriter() = default;
+  ~TimingSidecarWriter();
+  TimingSidecarWriter(const TimingSidecarWriter&) = delete;
+  TimingSidecarWriter& operator=(const TimingSidecarWriter&) = delete;
+
+  bool Open(const std::string& path, const TimingSidecarHeader& header, std::string* error_out);
+  void Write(const TimingSecond& second);
+  void Close();
+  bool is_open() const { return file_ != nullptr; }
+
+ private:
+  FILE* file_ = nullptr;
+  bool write_av_offset_ = true;
+};
+
+bool ReadTimingSidecar(const std::string& path,
+                       TimingSidecarHeader* header,
+                       std::vector<TimingSecond>* seconds,
+                       std::string* error_out);
@@ -0,0 +1,26 @@
+#include "encoder.h"
+
+#include "ffmpeg_writer.h"
+#include "null_encoder.h"
+
+#ifdef SCREEN_RECORDER_HAVE_LIBAV
+#include "libav_encoder.h"
+#endif
+
+std::unique_ptr<Encoder> CreateEncoder(EncoderBackend backend, std::string* error_out) {
+  switch (backend) {
+    case EncoderBackend::kFfmpegCli:
+      return std::make_unique<FfmpegWriter>();
+    case EncoderBackend::kLibav:
+#ifdef SCREEN_RECORDER_HAVE_LIBAV
+      return std::make_unique<LibavEncoder>();
+#else
+      *error_out = "libav encoder backend is not available in this build";
+      return nullptr;
+#endif
+    case EncoderBackend::kNull:
+      return std::make_unique<NullEncoder>();
+  }
+  *error_out = "Unknown encoder backend";
+  return nullptr;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "frame_pool.h"
+#include "latency_histogram.h"
+#include "recording_options.h"
+
+// One compressed packet as handed to the muxer. |data| is only valid for the
+// duration of the callback.
+struct EncodedPacket {
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  int64_t pts_us = 0;
+  int64_t dts_us = 0;
+  bool keyframe = false;
+  bool is_audio = false;
+};
+
+using PacketCallback = std::function<void(const EncodedPacket& packet)>;
+
+// Layout of captured audio handed to Encoder::WriteAudio: interleaved 32-bit
+// float samples.
+constexpr int kCaptureAudioRate = 48000;
+constexpr int kCaptureAudioChannels = 2;
+
+// Encoded output taken from an encoder's replay ring. It keeps what it needs,
+// so it can be written from any thread after the encoder has gone.
+class ReplayClip {
+ public:
+  virtual ~ReplayClip() = default;
+  virtual bool Write(const std::string& path, std::string* error_out) = 0;
+};
+// Cost of handing frames to a backend that runs out of process.
+struct TransportStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t syscalls = 0;
+  // Time spent inside those syscalls, mostly waiting for pipe space.
+  uint64_t blocked_ns = 0;
+  // Per frame: how long pushing it into the transport took.
+  LatencyHistogram::Summary frame_write_ns;
+  // Frame pages are spliced into the pipe instead of copied.
+  bool zero_copy = false;
+};
+
+// The encoder's own account of how it keeps up, as the ffmpeg CLI reports it
+// about twice a second. Backends that encode in process report nothing.
+struct EncoderProgress {
+  bool reported = false;
+  uint64_t frames = 0;
+  double fps = 0;
+  // Media time encoded per second of wall time. Below 1.0 the encoder falls
+  // behind and its input backs up until capture starts dropping frames.
+  double speed = 0;
+  double bitrate_kbps = 0;
+  // End of the encoded output timeline.
+  int64_t out_time_us = 0;
+  // Frames the encoder repeated or discarded to hold its output rate.
+  uint64_t dup_frames = 0;
+  uint64_t drop_frames = 0;
+};
+
+// Consumes tightly packed frames in RecordingOptions::frame_format and
+// produces the output file. Frames arrive at the size passed to Start, which
+// is the capture size of the largest rendition; an encoder whose
+// RecordingOptions::output_height is smaller scales them down itself. Start,
+// WriteFrame, WriteAudio and Stop are called from a single thread (the encoder
+// worker once started).
+class Encoder {
+ public:
+  virtual ~Encoder() = default;
+
+  virtual bool Start(int width,
+                     int height,
+                     const RecordingOptions& options,
+                     std::string* error_out) = 0;
+  // |timestamp_us| is only meaningful in variable frame rate mode; constant
+  // rate output is timed by frame order.
+  virtual bool WriteFrame(const FrameHandle& frame,
+                          int64_t timestamp_us,
+                          std::string* error_out) = 0;
+  // |frames| sample frames of captured audio, starting |timestamp_us| after
+  // the first video frame on the same clock. Only called when
+  // RecordingOptions::capture_audio is set.
+  virtual bool WriteAudio(const float* samples,
+                          size_t frames,
+                          int64_t timestamp_us,
+                          std::string* error_out) = 0;
+  virtual bool Stop(std::string* error_out) = 0;
+
+  // Observes every packet before it is muxed. Must be set before Start.
+  // Returns false when the backend never sees compressed packets.
+  virtual bool SetPacketCallback(PacketCallback callback) {
+    (void)callback;
+    return false;
+  }
+
+  // Safe to call from any thread while frames are being written.
+  virtual TransportStats GetTransportStats() const { return TransportStats {}; }
+  // Latest progress report. Safe to call from any thread.
+  virtual EncoderProgress GetProgress() const { return EncoderProgress {}; }
+
+  // Takes at least the last |seconds| of encoded output, starting at a
+  // keyframe, without stopping or re-encoding; nothing is written yet. Needs
+  // RecordingOptions::replay_buffer_bytes. Cheap and safe to call from any
+  // thread. Returns null on failure.
+  virtual std::unique_ptr<ReplayClip> SnapshotReplay(double seconds, std::string* error_out) {
+    (void)seconds;
+    *error_out = std::string("The ") + name() + " encoder backend cannot keep a replay buffer";
+    return nullptr;
+  }
+
+  virtual const char* name() const = 0;
+};
+
+// Returns nullptr with |error_out| set when |backend| is not compiled in.
+std::unique_ptr<Encoder> CreateEncoder(EncoderBackend backend, std::string* error_out);
@@ -0,0 +1,193 @@
+#include "encoder_autotune.h"
+
+#include "utils/keyed_line_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Encoding must outrun the clock by this factor; the rest of the CPU is left
+// to the compositor, the capture copy and whatever is being recorded.
+constexpr double kRequiredSpeed = 1.5;
+constexpr uint32_t kBenchmarkSeconds = 2;
+constexpr auto kPollInterval = std::chrono::milliseconds(5);
+
+std::string CacheFilePath() {
+  return UserFilePath("XDG_CACHE_HOME", ".cache", "encoder_autotune");
+}
+
+// Results do not carry over to other hardware, e.g. a synced home directory.
+std::string CpuFingerprint() {
+  std::string model = "unknown";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos && colon + 2 <= line.size()) {
+        model = line.substr(colon + 2);
+      }
+      break;
+    }
+  }
+  for (char& c : model) {
+    if (c == '\t') {
+      c = ' ';
+    }
+  }
+  return model + " x" + std::to_string(sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+std::string CacheKey(const EncoderProfile& profile, int width, int height, uint32_t fps) {
+  std::ostringstream key;
+  key << CpuFingerprint() << '\t' << profile.codec << '\t' << width << 'x' << height << '@'
+      << fps;
+  return key.str();
+}
+
+// Encodes kBenchmarkSeconds of ffmpeg's moving test pattern with |profile|
+// and reports how many times faster than real time it ran. The pattern is
+// generated in the same process, so the figure errs on the slow side.
+// Returns false when ffmpeg could not run the encode at all.
+bool MeasureSpeed(const EncoderProfile& profile,
+                  int width,
+                  int height,
+                  uint32_t fps,
+                  double* speed_out,
+                  std::string* error_out) {
+  const uint32_t frames = fps * kBenchmarkSeconds;
+  std::vector<std::string> args = {"ffmpeg",
+                                   "-hide_banner",
+                                   "-nostdin",
+                                   "-loglevel",
+                                   "error",
+                                   "-f",
+                                   "lavfi",
+                                   "-i",
+                                   "testsrc2=size=" + std::to_string(width) + "x" +
+                                       std::to_string(height) + ":rate=" + std::to_string(fps),
+                                   "-frames:v",
+                                   std::to_string(frames)};
+  AppendEncoderArgs(profile, &args);
+  args.insert(args.end(), {"-f", "null", "-"});
+  std::vector<char*> argv;
+  argv.reserve(args.size() + 1);
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const auto start = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+  if (pid < 0) {
+    *error_out = "Failed to fork ffmpeg benchmark: " + std::string(std::strerror(errno));
+    return false;
+  }
+  if (pid == 0) {
+    const int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+    }
+    execvp("ffmpeg", argv.data());
+    _exit(127);
+  }
+
+  // Past this point the preset can no longer reach kRequiredSpeed.
+  const auto deadline = std::chrono::duration<double>(kBenchmarkSeconds / kRequiredSpeed);
+  int status = 0;
+  while (true) {
+    const pid_t done = waitpid(pid, &status, WNOHANG);
+    if (done == pid) {
+      break;
+    }
+    if (done < 0 && errno != EINTR) {
+      *error_out = "Failed waiting for ffmpeg benchmark";
+      return false;
+    }
+    if (std::chrono::steady_clock::now() - start > deadline) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      *speed_out = 0.0;
+      return true;
+    }
+    std::this_thread::sleep_for(kPollInterval);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    *error_out = "ffmpeg could not encode with " + profile.codec;
+    return false;
+  }
+  *speed_out = kBenchmarkSeconds / std::max(elapsed.count(), 1e-6);
+  return true;
+}
+
+}  // namespace
+
+bool AutotuneEncoderProfile(int width,
+                            int height,
+                            uint32_t fps,
+                            EncoderProfile* profile,
+                            std::string* error_out) {
+  const std::vector<std::string> presets = EncoderPresets(profile->codec);
+  if (presets.empty()) {
+    return true;
+  }
+  fps = std::max<uint32_t>(fps, 1);
+
+  const std::string cache_path = CacheFilePath();
+  const std::string key = CacheKey(*profile, width, height, fps);
+  if (!cache_path.empty()) {
+    const std::string cached = LoadKeyedLine(cache_path, key);
+    for (const auto& preset : presets) {
+      if (preset == cached) {
+        profile->preset = cached;
+        return true;
+      }
+    }
+  }
+
+  // Presets get monotonically slower, so stop at the first one that misses.
+  // When even the fastest misses it is still the best available choice.
+  std::string chosen;
+  for (const auto& preset : presets) {
+    EncoderProfile candidate = *profile;
+    candidate.preset = preset;
+    double speed = 0.0;
+    if (!MeasureSpeed(candidate, width, height, fps, &speed, error_out)) {
+      if (chosen.empty()) {
+        return false;
+      }
+      break;
+    }
+    if (speed < kRequiredSpeed) {
+      if (chosen.empty()) {
+        chosen = preset;
+      }
+      break;
+    }
+    chosen = preset;
+  }
+
+  if (!cache_path.empty()) {
+    StoreKeyedLine(cache_path, key, chosen);
+  }
+  profile->preset = chosen;
+  return true;
+}
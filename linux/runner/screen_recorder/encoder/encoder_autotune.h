@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "encoder_profile.h"
+
+// Replaces |profile|'s preset with the slowest one of its codec that still
+// encodes width x height at |fps| in real time on this machine with headroom
+// left for capture. Presets are measured with short synthetic ffmpeg encodes
+// and the choice is cached per CPU, codec, resolution and rate under
+// $XDG_CACHE_HOME, so only the first session of a kind pays for it.
+//
+// Returns false with |profile| untouched when nothing could be measured, e.g.
+// without an ffmpeg binary.
+bool AutotuneEncoderProfile(int width,
+                            int height,
+                            uint32_t fps,
+                            EncoderProfile* profile,
+                            std::string* error_out);
@@ -0,0 +1,107 @@
+#include "encoder_profile.h"
+
+namespace {
+
+struct CodecTraits {
+  const char* codec;
+  // Private option that takes EncoderProfile::preset.
+  const char* preset_option;
+  // Fastest first.
+  std::vector<std::string> presets;
+};
+
+const std::vector<CodecTraits>& Codecs() {
+  static const std::vector<CodecTraits> codecs = {
+      {"libx264", "preset", {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium"}},
+      {"libx265", "preset", {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium"}},
+      {"libsvtav1", "preset", {"12", "11", "10", "9", "8", "7"}},
+      {"libvpx-vp9", "cpu-used", {"8", "7", "6", "5", "4"}},
+      {"ffv1", nullptr, {}},
+  };
+  return codecs;
+}
+
+const CodecTraits* FindCodec(const std::string& codec) {
+  for (const auto& traits : Codecs()) {
+    if (codec == traits.codec) {
+      return &traits;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+const std::vector<EncoderProfile>& EncoderProfiles() {
+  // name, codec, preset, crf, bitrate_kbps, threads, slices, gop, pixel_format, codec_options
+  static const std::vector<EncoderProfile> profiles = {
+      {"realtime", "libx264", "ultrafast", -1, 0, 0, 0, 0, "yuv420p", {{"tune", "zerolatency"}}},
+      {"balanced", "libx264", "veryfast", 23, 0, 0, 0, 0, "yuv420p", {}},
+      {"quality", "libx264", "medium", 20, 0, 0, 0, 0, "yuv420p", {}},
+      {"hevc", "libx265", "veryfast", 26, 0, 0, 0, 0, "yuv420p", {}},
+      {"av1", "libsvtav1", "10", 35, 0, 0, 0, 0, "yuv420p", {}},
+      // libvpx only honours crf as a constant quality target with b=0.
+      {"vp9",
+       "libvpx-vp9",
+       "8",
+       33,
+       0,
+       0,
+       0,
+       0,
+       "yuv420p",
+       {{"deadline", "realtime"}, {"row-mt", "1"}, {"b", "0"}}},
+      {"lossless", "ffv1", "", -1, 0, 0, 16, 1, "yuv420p", {{"level", "3"}}},
+  };
+  return profiles;
+}
+
+const EncoderProfile* FindEncoderProfile(const std::string& name) {
+  for (const auto& profile : EncoderProfiles()) {
+    if (profile.name == name) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<std::string> EncoderPresets(const std::string& codec) {
+  const CodecTraits* traits = FindCodec(codec);
+  return traits ? traits->presets : std::vector<std::string> {};
+}
+
+std::vector<CodecOption> EncoderCodecOptions(const EncoderProfile& profile) {
+  std::vector<CodecOption> options = profile.codec_options;
+  if (!profile.preset.empty()) {
+    const CodecTraits* traits = FindCodec(profile.codec);
+    const char* preset_option = traits ? traits->preset_option : "preset";
+    if (preset_option) {
+      options.emplace_back(preset_option, profile.preset);
+    }
+  }
+  if (profile.bitrate_kbps > 0) {
+    options.emplace_back("b", std::to_string(profile.bitrate_kbps * 1000LL));
+  } else if (profile.crf >= 0) {
+    options.emplace_back("crf", std::to_string(profile.crf));
+  }
+  if (profile.threads > 0) {
+    options.emplace_back("threads", std::to_string(profile.threads));
+  }
+  if (profile.slices > 0) {
+    options.emplace_back("slices", std::to_string(profile.slices));
+  }
+  if (profile.gop > 0) {
+    options.emplace_back("g", std::to_string(profile.gop));
+  }
+  return options;
+}
+
+void AppendEncoderArgs(const EncoderProfile& profile, std::vector<std::string>* args) {
+  args->insert(args->end(), {"-c:v", profile.codec});
+  for (const auto& option : EncoderCodecOptions(profile)) {
+    args->insert(args->end(), {"-" + option.first + ":v", option.second});
+  }
+  if (!profile.pixel_format.empty()) {
+    args->insert(args->end(), {"-pix_fmt", profile.pixel_format});
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using CodecOption = std::pair<std::string, std::string>;
+
+// Video codec settings shared by both encoder backends. Zero and empty fields
+// keep the codec's own default.
+struct EncoderProfile {
+  std::string name;
+  // libavcodec encoder name, e.g. "libx264" or "libsvtav1".
+  std::string codec = "libx264";
+  // Speed/quality step in the codec's own vocabulary ("veryfast" for x264,
+  // "10" for SVT-AV1, the cpu-used level for libvpx).
+  std::string preset;
+  // Constant quality; used when bitrate_kbps is 0.
+  int crf = -1;
+  int bitrate_kbps = 0;
+  int threads = 0;
+  // Slices per frame let x264/x265 spread a frame over threads without the
+  // latency of frame threading.
+  int slices = 0;
+  // Keyframe interval in frames.
+  int gop = 0;
+  std::string pixel_format = "yuv420p";
+  // Codec private options applied before the fields above, e.g.
+  // {"tune", "zerolatency"}.
+  std::vector<CodecOption> codec_options;
+};
+
+// Built-in profile table. The first entry is the default.
+const std::vector<EncoderProfile>& EncoderProfiles();
+
+// Returns nullptr when |name| is not in the table.
+const EncoderProfile* FindEncoderProfile(const std::string& name);
+
+// Presets of |codec| from fastest to slowest; empty when the codec has no
+// speed knob.
+std::vector<std::string> EncoderPresets(const std::string& codec);
+
+// Flattens |profile| into AVOption name/value pairs. The ffmpeg CLI takes
+// them as "-name:v value" and the libav backend as an AVDictionary, so both
+// backends configure the codec identically.
+std::vector<CodecOption> EncoderCodecOptions(const EncoderProfile& profile);
+
+// Appends "-c:v ... -pix_fmt ..." for |profile| to an ffmpeg command line.
+void AppendEncoderArgs(const EncoderProfile& profile, std::vector<std::string>* args);
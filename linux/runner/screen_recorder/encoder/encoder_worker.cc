@@ -0,0 +1,193 @@
+#include "encoder_worker.h"
+
+#include <chrono>
+#include <utility>
+
+#include "encoder.h"
+#include "utils/tracer.h"
+
+namespace {
+
+// Upper bound on a missed wakeup; the producer never takes the mutex on the
+// fast path.
+constexpr auto kMaxIdleWait = std::chrono::milliseconds(5);
+
+}  // namespace
+
+EncoderWorker::EncoderWorker(size_t queue_capacity, size_t max_queued_frames)
+    : queue_(queue_capacity), max_queued_frames_(max_queued_frames) {}
+
+EncoderWorker::~EncoderWorker() {
+  std::string ignored;
+  Stop(&ignored);
+}
+
+bool EncoderWorker::Start(Encoder* encoder, std::string* error_out) {
+  if (thread_.joinable()) {
+    *error_out = "Encoder worker already started";
+    return false;
+  }
+  encoder_ = encoder;
+  stop_requested_ = false;
+  failed_ = false;
+  error_.clear();
+  thread_ = std::thread([this]() { ThreadMain(); });
+  return true;
+}
+
+bool EncoderWorker::Enqueue(const FrameHandle& frame,
+                            uint32_t repeat,
+                            int64_t timestamp_us,
+                            int64_t repeat_interval_us) {
+  // Only this thread increments the count, so the check cannot overshoot.
+  if (queued_frames_.load(std::memory_order_acquire) >= max_queued_frames_) {
+    enqueue_failures_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  QueuedFrame item;
+  item.frame = frame;
+  item.repeat = repeat;
+  item.timestamp_us = timestamp_us;
+  item.repeat_interval_us = repeat_interval_us;
+  queued_frames_.fetch_add(1, std::memory_order_relaxed);
+  if (!Push(std::move(item))) {
+    queued_frames_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+  frames_enqueued_.fetch_add(repeat, std::memory_order_relaxed);
+  return true;
+}
+
+bool EncoderWorker::EnqueueAudio(const FrameHandle& samples, int64_t timestamp_us) {
+  QueuedFrame item;
+  item.frame = samples;
+  item.audio = true;
+  item.timestamp_us = timestamp_us;
+  return Push(std::move(item));
+}
+
+bool EncoderWorker::Push(QueuedFrame item) {
+  if (!queue_.Push(std::move(item))) {
+    enqueue_failures_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  const size_t depth = queue_.Size();
+  if (depth > max_queue_depth_.load(std::memory_order_relaxed)) {
+    max_queue_depth_.store(depth, std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumer_waiting_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    wait_cv_.notify_one();
+  }
+  return true;
+}
+
+void EncoderWorker::WaitForWork() {
+  std::unique_lock<std::mutex> lock(wait_mutex_);
+  consumer_waiting_.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  wait_cv_.wait_for(lock, kMaxIdleWait, [this]() {
+    return !queue_.Empty() || stop_requested_.load(std::memory_order_acquire);
+  });
+  consumer_waiting_.store(false, std::memory_order_relaxed);
+}
+
+void EncoderWorker::ThreadMain() {
+  Tracer::SetThreadName("encoder");
+  QueuedFrame item;
+  while (true) {
+    if (!queue_.Pop(&item)) {
+      if (stop_requested_.load(std::memory_order_acquire)) {
+        // Stop is only requested after the producer is done; one last look
+        // catches frames pushed just before the flag was set.
+        if (!queue_.Pop(&item)) {
+          break;
+        }
+      } else {
+        WaitForWork();
+        continue;
+      }
+    }
+
+    if (!failed_.load(std::memory_order_relaxed)) {
+      WriteItem(&item);
+    }
+    // After a failure keep draining so the producer's frame slots are released.
+    if (item.frame) {
+      item.frame.Reset();
+      if (!item.audio) {
+        queued_frames_.fetch_sub(1, std::memory_order_release);
+      }
+    }
+  }
+}
+
+void EncoderWorker::WriteItem(QueuedFrame* item) {
+  std::string write_error;
+  if (item->audio) {
+    const size_t frames = item->frame.size() / (sizeof(float) * kCaptureAudioChannels);
+    const auto write_start = std::chrono::steady_clock::now();
+    const bool ok = encoder_->WriteAudio(reinterpret_cast<const float*>(item->frame.data()),
+                                         frames, item->timestamp_us, &write_error);
+    const auto write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - write_start)
+                              .count();
+    audio_write_ns_.fetch_add(static_cast<uint64_t>(write_ns), std::memory_order_relaxed);
+    if (!ok) {
+      error_ = write_error;
+      failed_.store(true, std::memory_order_release);
+      return;
+    }
+    audio_frames_written_.fetch_add(frames, std::memory_order_relaxed);
+    return;
+  }
+  for (uint32_t n = 0; n < item->repeat; ++n) {
+    TraceScope trace("encoder", "WriteFrame");
+    const int64_t timestamp_us = item->timestamp_us + n * item->repeat_interval_us;
+    const auto write_start = std::chrono::steady_clock::now();
+    const bool ok = encoder_->WriteFrame(item->frame, timestamp_us, &write_error);
+    const auto write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - write_start)
+                              .count();
+    writer_stall_ns_.fetch_add(static_cast<uint64_t>(write_ns), std::memory_order_relaxed);
+    if (!ok) {
+      error_ = write_error;
+      failed_.store(true, std::memory_order_release);
+      return;
+    }
+    frames_written_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool EncoderWorker::Stop(std::string* error_out) {
+  if (!thread_.joinable()) {
+    return !failed();
+  }
+  stop_requested_.store(true, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    wait_cv_.notify_one();
+  }
+  thread_.join();
+  if (failed()) {
+    *error_out = error_;
+    return false;
+  }
+  return true;
+}
+
+EncoderWorker::Stats EncoderWorker::GetStats() const {
+  Stats stats;
+  stats.queue_depth = queue_.Size();
+  stats.max_queue_depth = max_queue_depth_.load(std::memory_order_relaxed);
+  stats.frames_enqueued = frames_enqueued_.load(std::memory_order_relaxed);
+  stats.enqueue_failures = enqueue_failures_.load(std::memory_order_relaxed);
+  stats.frames_written = frames_written_.load(std::memory_order_relaxed);
+  stats.audio_frames_written = audio_frames_written_.load(std::memory_order_relaxed);
+  stats.writer_stall_ns = writer_stall_ns_.load(std::memory_order_relaxed);
+  stats.audio_write_ns = audio_write_ns_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_pool.h"
+#include "spsc_ring.h"
+
+class Encoder;
+
+// Moves encoder writes off the PipeWire loop thread. The capture callbacks
+// enqueue frame handles and audio blocks without blocking and a dedicated
+// thread drains them into the encoder in queue order.
+class EncoderWorker {
+ public:
+  struct Stats {
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    uint64_t frames_enqueued = 0;
+    uint64_t enqueue_failures = 0;
+    uint64_t frames_written = 0;
+    uint64_t audio_frames_written = 0;
+    // Time the writer thread spent blocked inside Encoder::WriteFrame.
+    uint64_t writer_stall_ns = 0;
+    // Time it spent inside Encoder::WriteAudio.
+    uint64_t audio_write_ns = 0;
+  };
+
+  // At most |max_queued_frames| video entries wait at once, which bounds the
+  // pooled frames this worker can pin however slow its encoder is.
+  EncoderWorker(size_t queue_capacity, size_t max_queued_frames);
+  ~EncoderWorker();
+
+  bool Start(Encoder* encoder, std::string* error_out);
+  // Producer side, never blocks. The frame is written |repeat| times in a row,
+  // each copy |repeat_interval_us| after the previous one.
+  bool Enqueue(const FrameHandle& frame,
+               uint32_t repeat,
+               int64_t timestamp_us,
+               int64_t repeat_interval_us = 0);
+  // Producer side, never blocks. |samples| is a pooled block of interleaved
+  // kCaptureAudioChannels float samples, which other workers may share.
+  bool EnqueueAudio(const FrameHandle& samples, int64_t timestamp_us);
+  // Producer side. Counts |count| frames the producer gave up on without
+  // offering them, as enqueue failures.
+  void DropFrames(uint64_t count) {
+    enqueue_failures_.fetch_add(count, std::memory_order_relaxed);
+  }
+  // Writes everything still queued, then joins the writer thread.
+  bool Stop(std::string* error_out);
+
+  bool failed() const { return failed_.load(std::memory_order_acquire); }
+  Stats GetStats() const;
+
+ private:
+  struct QueuedFrame {
+    FrameHandle frame;
+    uint32_t repeat = 0;
+    int64_t timestamp_us = 0;
+    int64_t repeat_interval_us = 0;
+    // |frame| holds audio samples rather than a video frame.
+    bool audio = false;
+  };
+
+  void ThreadMain();
+  void WaitForWork();
+  bool Push(QueuedFrame item);
+  void WriteItem(QueuedFrame* item);
+
+  SpscRing<QueuedFrame> queue_;
+  Encoder* encoder_ = nullptr;
+  std::thread thread_;
+
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
+  std::atomic<bool> consumer_waiting_ {false};
+  std::atomic<bool> stop_requested_ {false};
+  std::atomic<bool> failed_ {false};
+  std::string error_;
+
+  const size_t max_queued_frames_;
+  std::atomic<size_t> queued_frames_ {0};
+  std::atomic<size_t> max_queue_depth_ {0};
+  std::atomic<uint64_t> frames_enqueued_ {0};
+  std::atomic<uint64_t> enqueue_failures_ {0};
+  std::atomic<uint64_t> frames_written_ {0};
+  std::atomic<uint64_t> audio_frames_written_ {0};
+  std::atomic<uint64_t> writer_stall_ns_ {0};
+  std::atomic<uint64_t> audio_write_ns_ {0};
+};
@@ -1,32 +1,163 @@
 #include "ffmpeg_writer.h"
 
-#include <algorithm>
+#include "encoder_profile.h"
+#include "matroska_pipe.h"
+#include "output_container.h"
+#include "utils/dimensions.h"
+#include "utils/tracer.h"
+
 #include <cerrno>
+#include <chrono>
 #include <csignal>
-#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+using screen_recorder::utils::ComputeOutputDimensions;
+
 namespace {
 
-bool WriteAll(int fd, const uint8_t* data, size_t size) {
-  size_t written_total = 0;
-  while (written_total < size) {
-    const ssize_t written = write(fd, data + written_total, size - written_total);
-    if (written < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      return false;
+// Raw pixel format names as understood by ffmpeg and the matching Matroska
+// V_UNCOMPRESSED colour space fourcc.
+const char* PixelFormatName(FrameFormat format) {
+  switch (format) {
+    case FrameFormat::kI420:
+      return "yuv420p";
+    case FrameFormat::kNv12:
+      return "nv12";
+    case FrameFormat::kBgr0:
+      break;
+  }
+  return "bgr0";
+}
+
+const char* PixelFormatFourCc(FrameFormat format) {
+  switch (format) {
+    case FrameFormat::kI420:
+      return "I420";
+    case FrameFormat::kNv12:
+      return "NV12";
+    case FrameFormat::kBgr0:
+      break;
+  }
+  return "BGR\0";
+}
+
+constexpr uint8_t kVideoTrackNumber = 1;
+constexpr uint8_t kAudioTrackNumber = 2;
+// Used when /proc/sys/fs/pipe-max-size cannot be read.
+constexpr int kDefaultMaxPipeSize = 1 << 20;
+constexpr int kMinPipeSize = 64 * 1024;
+// Descriptor the child writes its -progress reports to.
+constexpr int kProgressFd = 3;
+// stderr lines kept for the error message when ffmpeg fails.
+constexpr size_t kStderrTailLines = 4;
+// Longest stderr line kept; the rest of the line is dropped.
+constexpr size_t kMaxStderrLine = 512;
+
+int64_t ElapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                              start)
+      .count();
+}
+
+int MaxPipeSize() {
+  int size = kDefaultMaxPipeSize;
+  FILE* file = fopen("/proc/sys/fs/pipe-max-size", "r");
+  if (file) {
+    if (fscanf(file, "%d", &size) != 1) {
+      size = kDefaultMaxPipeSize;
     }
-    written_total += static_cast<size_t>(written);
+    fclose(file);
   }
-  return true;
+  return size;
+}
+
+// Grows |fd|'s pipe to the system maximum, halving while the per-user pipe
+// budget refuses. Returns the resulting capacity.
+int GrowPipe(int fd) {
+  for (int size = MaxPipeSize(); size > kMinPipeSize; size /= 2) {
+    const int result = fcntl(fd, F_SETPIPE_SZ, size);
+    if (result > 0) {
+      return result;
+    }
+  }
+  return fcntl(fd, F_GETPIPE_SZ);
+}
+
+// Folds one key=value line of a -progress report into |progress|. Returns
+// true on the progress= line that ends each report.
+bool ParseProgressLine(const std::string& line, EncoderProgress* progress) {
+  const size_t equals = line.find('=');
+  if (equals == std::string::npos) {
+    return false;
+  }
+  const std::string key = line.substr(0, equals);
+  const char* value = line.c_str() + equals + 1;
+  // Fields read "N/A" until ffmpeg has something to report; those leave the
+  // previous value in place.
+  char* end = nullptr;
+  if (key == "progress") {
+    return true;
+  } else if (key == "frame") {
+    const unsigned long long frames = std::strtoull(value, &end, 10);
+    if (end != value) {
+      progress->frames = frames;
+    }
+  } else if (key == "fps") {
+    const double fps = std::strtod(value, &end);
+    if (end != value) {
+      progress->fps = fps;
+    }
+  } else if (key == "speed") {
+    // "1.02x"
+    const double speed = std::strtod(value, &end);
+    if (end != value) {
+      progress->speed = speed;
+    }
+  } else if (key == "bitrate") {
+    // "2345.6kbits/s"
+    const double bitrate = std::strtod(value, &end);
+    if (end != value) {
+      progress->bitrate_kbps = bitrate;
+    }
+  } else if (key == "out_time_us") {
+    const long long out_time = std::strtoll(value, &end, 10);
+    if (end != value) {
+      progress->out_time_us = out_time;
+    }
+  } else if (key == "out_time" && progress->out_time_us == 0) {
+    // "HH:MM:SS.micros", from ffmpeg releases without out_time_us.
+    int hours = 0;
+    int minutes = 0;
+    double seconds = 0;
+    if (std::sscanf(value, "%d:%d:%lf", &hours, &minutes, &seconds) == 3) {
+      progress->out_time_us = (static_cast<int64_t>(hours) * 3600 + minutes * 60) * 1000000 +
+                              static_cast<int64_t>(seconds * 1e6);
+    }
+  } else if (key == "dup_frames") {
+    const unsigned long long dup = std::strtoull(value, &end, 10);
+    if (end != value) {
+      progress->dup_frames = dup;
+    }
+  } else if (key == "drop_frames") {
+    const unsigned long long drop = std::strtoull(value, &end, 10);
+    if (end != value) {
+      progress->drop_frames = drop;
+    }
+  }
+  return false;
 }
 
 }  // namespace
@@ -36,263 +167,378 @@ FfmpegWriter::~FfmpegWriter() {
   Stop(&ignored);
 }
 
+std::vector<std::string> FfmpegWriter::BuildArgs(int width,
+                                                 int height,
+                                                 const RecordingOptions& options) {
+  const std::string video_size = std::to_string(width) + "x" + std::to_string(height);
+  const std::string fps_s = std::to_string(options.fps);
+
+  std::vector<std::string> args = {"ffmpeg", "-y", "-loglevel", "error", "-nostats",
+                                   "-progress", "pipe:" + std::to_string(kProgressFd)};
+  if (options.variable_frame_rate || options.capture_audio) {
+    // Frames arrive in Matroska with capture timestamps; keep them as-is.
+    // Audio shares that pipe and clock, so the tracks line up by construction.
+    args.insert(args.end(), {"-f", "matroska", "-i", "-"});
+  } else {
+    args.insert(args.end(), {"-use_wallclock_as_timestamps", "1",
+                             "-fflags", "+genpts",
+                             "-f", "rawvideo",
+                             "-pix_fmt", PixelFormatName(options.frame_format),
+                             "-video_size", video_size,
+                             "-framerate", fps_s,
+                             "-i", "-"});
+  }
+
+  AppendEncoderArgs(ContainerEncoderProfile(options), &args);
+  args.insert(args.end(), {"-bf", "0"});
+  const auto encode_size = ComputeOutputDimensions(width, height, options.output_height);
+  if (encode_size.first != width || encode_size.second != height) {
+    // A downscaled rendition of frames captured for a larger output.
+    args.insert(args.end(), {"-vf", "scale=" + std::to_string(encode_size.first) + ":" +
+                                        std::to_string(encode_size.second) +
+                                        ":flags=lanczos"});
+  }
+  if (options.capture_audio) {
+    args.insert(args.end(), {"-c:a", "aac",
+                             "-b:a", "128k",
+                             "-af", "aresample=async=1:first_pts=0"});
+  }
+  if (options.variable_frame_rate) {
+    args.insert(args.end(), {"-enc_time_base:v", "-1", "-vsync", "vfr"});
+  } else {
+    args.insert(args.end(), {"-r", fps_s, "-vsync", "cfr"});
+  }
+  if (options.capture_audio) {
+    args.push_back("-shortest");
+  }
+  if (const char* muxer = ContainerMuxerName(options.container)) {
+    args.insert(args.end(), {"-f", muxer});
+  }
+  for (const auto& option : ContainerMuxerOptions(options)) {
+    args.insert(args.end(), {"-" + option.first, option.second});
+  }
+  args.push_back(options.output_path);
+  return args;
+}
+
 bool FfmpegWriter::Start(int width,
                          int height,
-                         uint32_t fps,
-                         const std::string& output_path,
-                         bool capture_audio,
-                         const std::string& audio_device,
-                         int output_height,
+                         const RecordingOptions& options,
                          std::string* error_out) {
   if (started_) {
     *error_out = "FFmpeg writer already started";
     return false;
   }
+  if (options.replay_buffer_bytes > 0) {
+    *error_out = "Instant replay needs the libav encoder backend";
+    return false;
+  }
+  TraceScope trace("ffmpeg", "spawn");
 
+  // Close-on-exec everywhere, so that no other child (another rendition's
+  // ffmpeg in particular) keeps a pipe end open and withholds the EOF.
   int pipefd[2];
-  if (pipe(pipefd) != 0) {
+  if (pipe2(pipefd, O_CLOEXEC) != 0) {
     *error_out = "Failed to create ffmpeg stdin pipe: " + std::string(std::strerror(errno));
     return false;
   }
+  int progress_pipe[2];
+  int stderr_pipe[2];
+  if (pipe2(progress_pipe, O_CLOEXEC) != 0) {
+    *error_out = "Failed to create ffmpeg progress pipe: " + std::string(std::strerror(errno));
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return false;
+  }
+  if (pipe2(stderr_pipe, O_CLOEXEC) != 0) {
+    *error_out = "Failed to create ffmpeg stderr pipe: " + std::string(std::strerror(errno));
+    for (int fd : {pipefd[0], pipefd[1], progress_pipe[0], progress_pipe[1]}) {
+      close(fd);
+    }
+    return false;
+  }
+
+  const std::vector<std::string> args = BuildArgs(width, height, options);
+  std::vector<char*> argv;
+  argv.reserve(args.size() + 1);
+  for (const auto& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
 
   const pid_t pid = fork();
   if (pid < 0) {
-    close(pipefd[0]);
-    close(pipefd[1]);
+    for (int fd : {pipefd[0], pipefd[1], progress_pipe[0], progress_pipe[1], stderr_pipe[0],
+                   stderr_pipe[1]}) {
+      close(fd);
+    }
     *error_out = "Failed to fork ffmpeg process: " + std::string(std::strerror(errno));
     return false;
   }
 
   if (pid == 0) {
+    // Every other descriptor closes on exec. dup2 onto itself would keep the
+    // flag, so that case clears it instead.
     dup2(pipefd[0], STDIN_FILENO);
-    close(pipefd[0]);
-    close(pipefd[1]);
-
-    const std::string video_size = std::to_string(width) + "x" + std::to_string(height);
-    const std::string fps_s = std::to_string(fps);
-    // Output preset is a max target only. Never upscale above captured source size.
-    const int target_height = (output_height > 0 && output_height < height) ? output_height : height;
-    const int scaled_width =
-        std::max(2, static_cast<int>(std::round((static_cast<double>(width) * target_height) /
-                                                static_cast<double>(height))));
-    const int even_scaled_width = (scaled_width / 2) * 2;
-    const int even_scaled_height = (target_height / 2) * 2;
-    const bool use_downscale = even_scaled_width > 0 && even_scaled_height > 0 &&
-                               (even_scaled_width != width || even_scaled_height != height);
-    const std::string scale_filter =
-        "scale=" + std::to_string(even_scaled_width) + ":" + std::to_string(even_scaled_height) +
-        ":flags=lanczos";
-
-    if (capture_audio) {
-      const std::string input_device = audio_device.empty() ? "default" : audio_device;
-      if (use_downscale) {
-        execlp("ffmpeg",
-               "ffmpeg",
-               "-y",
-               "-loglevel",
-               "error",
-               "-use_wallclock_as_timestamps",
-               "1",
-               "-fflags",
-               "+genpts",
-               "-f",
-               "rawvideo",
-               "-pix_fmt",
-               "bgr0",
-               "-video_size",
-               video_size.c_str(),
-               "-framerate",
-               fps_s.c_str(),
-               "-i",
-               "-",
-               "-thread_queue_size",
-                "512",
-               "-use_wallclock_as_timestamps",
-                "1",
-               "-f",
-                "pulse",
-               "-sample_rate",
-               "48000",
-               "-channels",
-               "2",
-               "-fragment_size",
-               "1024",
-               "-i",
-                input_device.c_str(),
-               "-vf",
-               scale_filter.c_str(),
-               "-c:v",
-               "libx264",
-               "-preset",
-               "ultrafast",
-               "-tune",
-               "zerolatency",
-               "-bf",
-               "0",
-               "-pix_fmt",
-               "yuv420p",
-               "-c:a",
-               "aac",
-               "-b:a",
-               "128k",
-               "-af",
-               "aresample=async=1:first_pts=0",
-               "-vsync",
-               "cfr",
-               "-shortest",
-               output_path.c_str(),
-               static_cast<char*>(nullptr));
-      } else {
-        execlp("ffmpeg",
-               "ffmpeg",
-               "-y",
-               "-loglevel",
-               "error",
-               "-use_wallclock_as_timestamps",
-               "1",
-               "-fflags",
-               "+genpts",
-               "-f",
-               "rawvideo",
-               "-pix_fmt",
-               "bgr0",
-               "-video_size",
-               video_size.c_str(),
-               "-framerate",
-               fps_s.c_str(),
-               "-i",
-               "-",
-               "-thread_queue_size",
-                "512",
-               "-use_wallclock_as_timestamps",
-                "1",
-               "-f",
-                "pulse",
-               "-sample_rate",
-               "48000",
-               "-channels",
-               "2",
-               "-fragment_size",
-               "1024",
-               "-i",
-                input_device.c_str(),
-               "-c:v",
-               "libx264",
-               "-preset",
-               "ultrafast",
-               "-tune",
-               "zerolatency",
-               "-bf",
-               "0",
-               "-pix_fmt",
-               "yuv420p",
-               "-c:a",
-               "aac",
-               "-b:a",
-               "128k",
-               "-af",
-               "aresample=async=1:first_pts=0",
-               "-vsync",
-               "cfr",
-               "-shortest",
-               output_path.c_str(),
-               static_cast<char*>(nullptr));
-      }
+    dup2(stderr_pipe[1], STDERR_FILENO);
+    if (progress_pipe[1] == kProgressFd) {
+      fcntl(kProgressFd, F_SETFD, 0);
     } else {
-      if (use_downscale) {
-        execlp("ffmpeg",
-               "ffmpeg",
-               "-y",
-               "-loglevel",
-               "error",
-               "-use_wallclock_as_timestamps",
-               "1",
-               "-fflags",
-               "+genpts",
-               "-f",
-               "rawvideo",
-               "-pix_fmt",
-               "bgr0",
-               "-video_size",
-               video_size.c_str(),
-               "-framerate",
-               fps_s.c_str(),
-               "-i",
-               "-",
-               "-vf",
-               scale_filter.c_str(),
-               "-c:v",
-               "libx264",
-               "-preset",
-               "ultrafast",
-               "-tune",
-               "zerolatency",
-               "-bf",
-               "0",
-               "-pix_fmt",
-               "yuv420p",
-               "-vsync",
-               "cfr",
-               output_path.c_str(),
-               static_cast<char*>(nullptr));
-      } else {
-        execlp("ffmpeg",
-               "ffmpeg",
-               "-y",
-               "-loglevel",
-               "error",
-               "-use_wallclock_as_timestamps",
-               "1",
-               "-fflags",
-               "+genpts",
-               "-f",
-               "rawvideo",
-               "-pix_fmt",
-               "bgr0",
-               "-video_size",
-               video_size.c_str(),
-               "-framerate",
-               fps_s.c_str(),
-               "-i",
-               "-",
-               "-c:v",
-               "libx264",
-               "-preset",
-               "ultrafast",
-               "-tune",
-               "zerolatency",
-               "-bf",
-               "0",
-               "-pix_fmt",
-               "yuv420p",
-               "-vsync",
-               "cfr",
-               output_path.c_str(),
-               static_cast<char*>(nullptr));
-      }
+      dup2(progress_pipe[1], kProgressFd);
     }
+    execvp("ffmpeg", argv.data());
     _exit(127);
   }
 
   close(pipefd[0]);
+  close(progress_pipe[1]);
+  close(stderr_pipe[1]);
+  stderr_tail_.clear();
+  reader_ = std::thread(&FfmpegWriter::ReadChildOutput, this, progress_pipe[0], stderr_pipe[0]);
+  trace.SetArg("pid", pid);
   stdin_fd_ = pipefd[1];
   child_pid_ = pid;
   started_ = true;
+  timestamped_ = options.variable_frame_rate || options.capture_audio;
+  audio_ = options.capture_audio;
+  splice_.store(options.pipe_transport == PipeTransport::kVmsplice, std::memory_order_relaxed);
+  in_flight_.clear();
+  pipe_offset_ = 0;
+  frames_written_ = 0;
+  bytes_written_ = 0;
+  syscalls_ = 0;
+  blocked_ns_ = 0;
+  if (splice_) {
+    // A frame is usually larger than the pipe, so the bigger the pipe the
+    // fewer times the writer wakes up per frame.
+    GrowPipe(stdin_fd_);
+  }
+
+  if (timestamped_) {
+    const std::vector<uint8_t> header =
+        BuildMatroskaStreamHeader(width, height, PixelFormatFourCc(options.frame_format),
+                                  audio_ ? kCaptureAudioChannels : 0,
+                                  audio_ ? kCaptureAudioRate : 0);
+    if (!WriteAll(header.data(), header.size())) {
+      *error_out = "Failed writing stream header to ffmpeg stdin: " +
+                   std::string(std::strerror(errno));
+      std::string ignored;
+      Stop(&ignored);
+      return false;
+    }
+  }
   return true;
 }
 
-bool FfmpegWriter::WriteFrame(const uint8_t* data, size_t size, std::string* error_out) {
+bool FfmpegWriter::WriteFrame(const FrameHandle& frame,
+                              int64_t timestamp_us,
+                              std::string* error_out) {
   if (!started_ || stdin_fd_ < 0) {
     *error_out = "FFmpeg writer is not started";
     return false;
   }
-  if (!WriteAll(stdin_fd_, data, size)) {
+  const auto write_start = std::chrono::steady_clock::now();
+  const uint8_t* data = frame.data();
+  const size_t size = frame.size();
+  if (splice_) {
+    ReleaseConsumedFrames();
+  }
+  if (timestamped_) {
+    // The header lives on the stack, so it is always copied.
+    uint8_t header[kMatroskaFrameHeaderSize];
+    BuildMatroskaFrameHeader(kVideoTrackNumber, timestamp_us, size, header);
+    if (!WriteAll(header, sizeof(header))) {
+      *error_out = "Failed writing frame to ffmpeg stdin: " + std::string(std::strerror(errno));
+      return false;
+    }
+  }
+  const bool written = splice_ ? SpliceAll(data, size) : WriteAll(data, size);
+  if (!written) {
     *error_out = "Failed writing frame to ffmpeg stdin: " + std::string(std::strerror(errno));
     return false;
   }
+  if (splice_) {
+    in_flight_.push_back({frame, pipe_offset_});
+  }
+  frame_write_ns_.Record(static_cast<uint64_t>(ElapsedNs(write_start)));
+  frames_written_.fetch_add(1, std::memory_order_relaxed);
+  bytes_written_.fetch_add(size, std::memory_order_relaxed);
+  return true;
+}
+
+bool FfmpegWriter::WriteAudio(const float* samples,
+                              size_t frames,
+                              int64_t timestamp_us,
+                              std::string* error_out) {
+  if (!started_ || stdin_fd_ < 0 || !audio_) {
+    *error_out = "FFmpeg writer is not recording audio";
+    return false;
+  }
+  const size_t size = frames * kCaptureAudioChannels * sizeof(float);
+  uint8_t header[kMatroskaFrameHeaderSize];
+  BuildMatroskaFrameHeader(kAudioTrackNumber, timestamp_us, size, header);
+  // Samples are copied into the pipe: the caller's buffer is reused as soon
+  // as this returns, unlike pooled video frames.
+  if (!WriteAll(header, sizeof(header)) ||
+      !WriteAll(reinterpret_cast<const uint8_t*>(samples), size)) {
+    *error_out = "Failed writing audio to ffmpeg stdin: " + std::string(std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool FfmpegWriter::WriteAll(const uint8_t* data, size_t size) {
+  size_t written_total = 0;
+  while (written_total < size) {
+    const auto start = std::chrono::steady_clock::now();
+    const ssize_t written = write(stdin_fd_, data + written_total, size - written_total);
+    blocked_ns_.fetch_add(static_cast<uint64_t>(ElapsedNs(start)), std::memory_order_relaxed);
+    syscalls_.fetch_add(1, std::memory_order_relaxed);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written_total += static_cast<size_t>(written);
+  }
+  pipe_offset_ += size;
+  return true;
+}
+
+// SPLICE_F_GIFT is deliberately not passed: gifted pages may never be touched
+// again, while pool slots are recycled once ffmpeg has read them.
+bool FfmpegWriter::SpliceAll(const uint8_t* data, size_t size) {
+  size_t spliced_total = 0;
+  while (spliced_total < size) {
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t*>(data + spliced_total);
+    iov.iov_len = size - spliced_total;
+    const auto start = std::chrono::steady_clock::now();
+    const ssize_t spliced = vmsplice(stdin_fd_, &iov, 1, 0);
+    blocked_ns_.fetch_add(static_cast<uint64_t>(ElapsedNs(start)), std::memory_order_relaxed);
+    syscalls_.fetch_add(1, std::memory_order_relaxed);
+    if (spliced < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (spliced_total == 0 && (errno == EINVAL || errno == ENOSYS)) {
+        // No vmsplice for this pipe; copy from now on.
+        splice_ = false;
+        in_flight_.clear();
+        return WriteAll(data, size);
+      }
+      return false;
+    }
+    spliced_total += static_cast<size_t>(spliced);
+  }
+  pipe_offset_ += size;
   return true;
 }
 
+void FfmpegWriter::ReleaseConsumedFrames() {
+  if (in_flight_.empty()) {
+    return;
+  }
+  int unread = 0;
+  syscalls_.fetch_add(1, std::memory_order_relaxed);
+  if (ioctl(stdin_fd_, FIONREAD, &unread) != 0) {
+    return;
+  }
+  const uint64_t consumed = pipe_offset_ - static_cast<uint64_t>(unread);
+  while (!in_flight_.empty() && in_flight_.front().end_offset <= consumed) {
+    in_flight_.pop_front();
+  }
+}
+
+void FfmpegWriter::ReadChildOutput(int progress_fd, int stderr_fd) {
+  struct pollfd fds[2] = {{progress_fd, POLLIN, 0}, {stderr_fd, POLLIN, 0}};
+  std::string pending[2];
+  EncoderProgress progress;
+  char buffer[4096];
+  int open_fds = 2;
+  while (open_fds > 0) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      const ssize_t got = read(fds[i].fd, buffer, sizeof(buffer));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        close(fds[i].fd);
+        // poll skips negative descriptors.
+        fds[i].fd = -1;
+        --open_fds;
+        if (i == 1 && !pending[i].empty()) {
+          stderr_tail_.push_back(std::move(pending[i]));
+          if (stderr_tail_.size() > kStderrTailLines) {
+            stderr_tail_.pop_front();
+          }
+        }
+        continue;
+      }
+      if (i == 1) {
+        // ffmpeg used to write straight to our stderr; keep it visible there.
+        const ssize_t ignored = write(STDERR_FILENO, buffer, static_cast<size_t>(got));
+        (void)ignored;
+      }
+      pending[i].append(buffer, static_cast<size_t>(got));
+      size_t start = 0;
+      size_t end = 0;
+      while ((end = pending[i].find('\n', start)) != std::string::npos) {
+        std::string line = pending[i].substr(start, end - start);
+        start = end + 1;
+        if (i == 0) {
+          if (ParseProgressLine(line, &progress)) {
+            progress.reported = true;
+            progress_.Store(progress);
+          }
+        } else if (!line.empty()) {
+          line.resize(std::min(line.size(), kMaxStderrLine));
+          stderr_tail_.push_back(std::move(line));
+          if (stderr_tail_.size() > kStderrTailLines) {
+            stderr_tail_.pop_front();
+          }
+        }
+      }
+      pending[i].erase(0, start);
+      if (pending[i].size() > kMaxStderrLine) {
+        pending[i].resize(kMaxStderrLine);
+      }
+    }
+  }
+  for (const auto& fd : fds) {
+    if (fd.fd >= 0) {
+      close(fd.fd);
+    }
+  }
+}
+
+EncoderProgress FfmpegWriter::GetProgress() const {
+  EncoderProgress progress;
+  progress_.Load(&progress);
+  return progress;
+}
+
+TransportStats FfmpegWriter::GetTransportStats() const {
+  TransportStats stats;
+  stats.frames = frames_written_.load(std::memory_order_relaxed);
+  stats.bytes = bytes_written_.load(std::memory_order_relaxed);
+  stats.syscalls = syscalls_.load(std::memory_order_relaxed);
+  stats.blocked_ns = blocked_ns_.load(std::memory_order_relaxed);
+  stats.frame_write_ns = frame_write_ns_.Summarize();
+  stats.zero_copy = splice_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool FfmpegWriter::Stop(std::string* error_out) {
   if (!started_) {
     return true;
@@ -303,8 +549,18 @@ bool FfmpegWriter::Stop(std::string* error_out) {
     stdin_fd_ = -1;
   }
 
+  // Covers ffmpeg draining its input and closing the file.
+  TraceScope trace("ffmpeg", "exit");
   int status = 0;
-  if (waitpid(child_pid_, &status, 0) < 0) {
+  const pid_t waited = waitpid(child_pid_, &status, 0);
+  trace.SetArg("status", status);
+  // ffmpeg has exited, so nothing reads the spliced pages any more.
+  in_flight_.clear();
+  // Its pipes are at EOF with the child gone.
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+  if (waited < 0) {
     *error_out = "Failed waiting for ffmpeg process: " + std::string(std::strerror(errno));
     started_ = false;
     child_pid_ = -1;
@@ -326,6 +582,10 @@ bool FfmpegWriter::Stop(std::string* error_out) {
   } else {
     oss << "ffmpeg exited abnormally";
   }
+  // Usually names the actual problem, e.g. an encoder missing from this build.
+  for (size_t i = 0; i < stderr_tail_.size(); ++i) {
+    oss << (i == 0 ? ": " : "; ") << stderr_tail_[i];
+  }
   *error_out = oss.str();
   return false;
 }
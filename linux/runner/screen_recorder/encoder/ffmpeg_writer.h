@@ -1,28 +1,78 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <sys/types.h>
+#include <thread>
+#include <vector>
 
-class FfmpegWriter {
+#include "encoder.h"
+#include "recording_options.h"
+#include "seqlock.h"
+
+// Forks the ffmpeg CLI and streams raw frames into its stdin. Its -progress
+// reports and stderr come back over pipes drained by a reader thread.
+class FfmpegWriter : public Encoder {
  public:
   FfmpegWriter() = default;
-  ~FfmpegWriter();
+  ~FfmpegWriter() override;
 
   bool Start(int width,
              int height,
-             uint32_t fps,
-             const std::string& output_path,
-             bool capture_audio,
-             const std::string& audio_device,
-             int output_height,
-             std::string* error_out);
-  bool WriteFrame(const uint8_t* data, size_t size, std::string* error_out);
-  bool Stop(std::string* error_out);
+             const RecordingOptions& options,
+             std::string* error_out) override;
+  bool WriteFrame(const FrameHandle& frame, int64_t timestamp_us, std::string* error_out) override;
+  bool WriteAudio(const float* samples,
+                  size_t frames,
+                  int64_t timestamp_us,
+                  std::string* error_out) override;
+  bool Stop(std::string* error_out) override;
+  TransportStats GetTransportStats() const override;
+  EncoderProgress GetProgress() const override;
+  const char* name() const override { return "ffmpeg"; }
 
  private:
+  // A spliced frame whose pages ffmpeg has not read yet. |end_offset| counts
+  // bytes pushed into the pipe up to and including this frame.
+  struct InFlightFrame {
+    FrameHandle frame;
+    uint64_t end_offset = 0;
+  };
+
+  static std::vector<std::string> BuildArgs(int width, int height, const RecordingOptions& options);
+
+  bool WriteAll(const uint8_t* data, size_t size);
+  bool SpliceAll(const uint8_t* data, size_t size);
+  // Drops the references of every spliced frame ffmpeg has fully read.
+  void ReleaseConsumedFrames();
+  // Parses progress reports and keeps the tail of stderr until ffmpeg closes
+  // both pipes. Owns and closes the descriptors.
+  void ReadChildOutput(int progress_fd, int stderr_fd);
+
   pid_t child_pid_ = -1;
   int stdin_fd_ = -1;
   bool started_ = false;
+  // Frames (and audio) go through the Matroska pipe with explicit timestamps.
+  bool timestamped_ = false;
+  bool audio_ = false;
+  std::atomic<bool> splice_ {false};
+  // Spliced pages stay referenced by the pipe, so their pool slots must not
+  // be reused until ffmpeg has read past them.
+  std::deque<InFlightFrame> in_flight_;
+  uint64_t pipe_offset_ = 0;
+
+  std::atomic<uint64_t> frames_written_ {0};
+  std::atomic<uint64_t> bytes_written_ {0};
+  std::atomic<uint64_t> syscalls_ {0};
+  std::atomic<uint64_t> blocked_ns_ {0};
+  LatencyHistogram frame_write_ns_;
+
+  std::thread reader_;
+  Seqlock<EncoderProgress> progress_;
+  // Last lines ffmpeg wrote to stderr, for the error when it fails. Only the
+  // reader thread touches them until it is joined.
+  std::deque<std::string> stderr_tail_;
 };
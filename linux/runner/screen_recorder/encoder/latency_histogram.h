@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Log-linear histogram in the style of HdrHistogram. Values up to 2^40 (about
+// 18 minutes in nanoseconds) fall into one of 16 sub-buckets per power of two,
+// so reported quantiles are within 1/16 of the recorded value. Record is a
+// handful of relaxed atomic operations and may be called from any thread;
+// Summarize may run concurrently and then sees a slightly torn but usable view.
+class LatencyHistogram {
+ public:
+  struct Summary {
+    uint64_t count = 0;
+    uint64_t min = 0;
+    uint64_t mean = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+  };
+
+  LatencyHistogram() = default;
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  void Record(uint64_t value) {
+    buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t seen = min_.load(std::memory_order_relaxed);
+    while (value < seen && !min_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+    seen = max_.load(std::memory_order_relaxed);
+    while (value > seen && !max_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  Summary Summarize() const {
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      counts[i] = buckets_[i].load(std::memory_order_relaxed);
+      total += counts[i];
+    }
+    Summary summary;
+    if (total == 0) {
+      return summary;
+    }
+    summary.count = total;
+    summary.min = min_.load(std::memory_order_relaxed);
+    summary.max = max_.load(std::memory_order_relaxed);
+    summary.mean = sum_.load(std::memory_order_relaxed) /
+                   std::max<uint64_t>(count_.load(std::memory_order_relaxed), 1);
+    summary.p50 = Quantile(counts, total, 500, summary.min, summary.max);
+    summary.p90 = Quantile(counts, total, 900, summary.min, summary.max);
+    summary.p99 = Quantile(counts, total, 990, summary.min, summary.max);
+    summary.p999 = Quantile(counts, total, 999, summary.min, summary.max);
+    return summary;
+  }
+
+ private:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = uint64_t {1} << kSubBucketBits;
+  static constexpr int kMaxValueBits = 40;
+  static constexpr uint64_t kMaxValue = (uint64_t {1} << kMaxValueBits) - 1;
+  // Values below kSubBuckets are exact; every higher power of two gets
+  // kSubBuckets buckets of equal width.
+  static constexpr size_t kBucketCount = kSubBuckets * (kMaxValueBits - kSubBucketBits + 1);
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value > kMaxValue) {
+      value = kMaxValue;
+    }
+    if (value < kSubBuckets) {
+      return static_cast<size_t>(value);
+    }
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - kSubBucketBits;
+    const uint64_t sub = (value >> shift) - kSubBuckets;
+    return static_cast<size_t>(kSubBuckets + static_cast<uint64_t>(shift) * kSubBuckets + sub);
+  }
+
+  // Midpoint of the values that land in bucket |index|.
+  static uint64_t BucketValue(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    const uint64_t shift = (index - kSubBuckets) / kSubBuckets;
+    const uint64_t sub = (index - kSubBuckets) % kSubBuckets;
+    const uint64_t lower = (kSubBuckets + sub) << shift;
+    return lower + ((uint64_t {1} << shift) >> 1);
+  }
+
+  // Smallest bucket value with at least |per_mille| of the samples at or
+  // below it, clamped to the exact extremes.
+  static uint64_t Quantile(const std::array<uint64_t, kBucketCount>& counts,
+                           uint64_t total,
+                           uint64_t per_mille,
+                           uint64_t min,
+                           uint64_t max) {
+    const uint64_t rank = std::max<uint64_t>((total * per_mille + 999) / 1000, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::min(std::max(BucketValue(i), min), max);
+      }
+    }
+    return max;
+  }
+
+  std::array<std::atomic<uint64_t>, kBucketCount> buckets_ {};
+  std::atomic<uint64_t> count_ {0};
+  std::atomic<uint64_t> sum_ {0};
+  std::atomic<uint64_t> min_ {std::numeric_limits<uint64_t>::max()};
+  std::atomic<uint64_t> max_ {0};
+};
@@ -0,0 +1,754 @@
+#include "libav_encoder.h"
+
+#include "color_convert.h"
+#include "encoder_profile.h"
+#include "output_container.h"
+#include "utils/dimensions.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/buffer.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// AVChannelLayout replaced the channel mask API in libavutil 57.28.
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+#define SCREEN_RECORDER_LIBAV_CH_LAYOUT 1
+#endif
+
+using screen_recorder::utils::ComputeOutputDimensions;
+
+namespace {
+
+constexpr int64_t kAudioBitRate = 128000;
+constexpr int kDefaultAudioFrameSize = 1024;
+// Capture timestamps jitter by a period or so; only a hole longer than this
+// (an xrun, a suspended node) is filled with silence to keep audio in place.
+constexpr int64_t kAudioGapToleranceUs = 40000;
+
+std::string AvError(const char* what, int code) {
+  char buffer[AV_ERROR_MAX_STRING_SIZE] = {0};
+  av_strerror(code, buffer, sizeof(buffer));
+  return std::string(what) + ": " + buffer;
+}
+
+int64_t PacketTimeUs(int64_t value, AVRational time_base) {
+  return value == AV_NOPTS_VALUE ? 0 : av_rescale_q(value, time_base, AV_TIME_BASE_Q);
+}
+
+AVPixelFormat InputPixelFormat(FrameFormat format) {
+  switch (format) {
+    case FrameFormat::kI420:
+      return AV_PIX_FMT_YUV420P;
+    case FrameFormat::kNv12:
+      return AV_PIX_FMT_NV12;
+    case FrameFormat::kBgr0:
+      break;
+  }
+  return AV_PIX_FMT_BGR0;
+}
+
+// Drops the pool reference an AVBufferRef was holding on a frame slot.
+void ReleaseFrameHandle(void* opaque, uint8_t* data) {
+  (void)data;
+  delete static_cast<FrameHandle*>(opaque);
+}
+
+// Remuxes replay packets into |path|, with the first (key)frame at zero.
+// Audio from before that frame is dropped.
+bool MuxReplay(const std::string& path,
+               const AVCodecParameters* video_params,
+               const AVCodecParameters* audio_params,
+               const ReplayBuffer::Packets& packets,
+               std::string* error_out) {
+  AVFormatContext* output = nullptr;
+  int ret = avformat_alloc_output_context2(&output, nullptr, nullptr, path.c_str());
+  if (ret < 0 || !output) {
+    *error_out = AvError("Failed to create replay output", ret);
+    return false;
+  }
+  bool ok = true;
+  bool header_written = false;
+  AVStream* video = avformat_new_stream(output, nullptr);
+  AVStream* audio = audio_params ? avformat_new_stream(output, nullptr) : nullptr;
+  if (!video || (audio_params && !audio)) {
+    *error_out = "Failed to allocate replay streams";
+    ok = false;
+  } else {
+    avcodec_parameters_copy(video->codecpar, video_params);
+    video->time_base = AV_TIME_BASE_Q;
+    if (audio) {
+      avcodec_parameters_copy(audio->codecpar, audio_params);
+      audio->time_base = AV_TIME_BASE_Q;
+    }
+  }
+  if (ok && !(output->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE);
+    if (ret < 0) {
+      *error_out = AvError("Failed to open replay file", ret);
+      ok = false;
+    }
+  }
+  if (ok) {
+    ret = avformat_write_header(output, nullptr);
+    if (ret < 0) {
+      *error_out = AvError("Failed to write replay header", ret);
+      ok = false;
+    }
+    header_written = ok;
+  }
+
+  AVPacket* packet = av_packet_alloc();
+  const int64_t origin_us = packets.front()->dts_us;
+  for (const auto& stored : packets) {
+    if (!ok || !packet) {
+      break;
+    }
+    if (stored->is_audio && (!audio || stored->pts_us < origin_us)) {
+      continue;
+    }
+    AVStream* stream = stored->is_audio ? audio : video;
+    ret = av_new_packet(packet, static_cast<int>(stored->data.size()));
+    if (ret < 0) {
+      *error_out = AvError("Failed to allocate replay packet", ret);
+      ok = false;
+      break;
+    }
+    std::memcpy(packet->data, stored->data.data(), stored->data.size());
+    packet->pts = av_rescale_q(stored->pts_us - origin_us, AV_TIME_BASE_Q, stream->time_base);
+    packet->dts = av_rescale_q(stored->dts_us - origin_us, AV_TIME_BASE_Q, stream->time_base);
+    packet->flags = stored->keyframe ? AV_PKT_FLAG_KEY : 0;
+    packet->stream_index = stream->index;
+    ret = av_interleaved_write_frame(output, packet);
+    if (ret < 0) {
+      *error_out = AvError("Failed to write replay packet", ret);
+      ok = false;
+    }
+  }
+  av_packet_free(&packet);
+
+  if (header_written) {
+    ret = av_write_trailer(output);
+    if (ok && ret < 0) {
+      *error_out = AvError("Failed to write replay trailer", ret);
+      ok = false;
+    }
+  }
+  if (output->pb && !(output->oformat->flags & AVFMT_NOFILE)) {
+    avio_closep(&output->pb);
+  }
+  avformat_free_context(output);
+  return ok;
+}
+
+// The snapshot shares the ring's payloads; the stream layout is copied,
+// since the encoder frees its own when it stops.
+class LibavReplayClip : public ReplayClip {
+ public:
+  LibavReplayClip(ReplayBuffer::Packets packets,
+                  const AVCodecParameters* video_params,
+                  const AVCodecParameters* audio_params)
+      : packets_(std::move(packets)), video_params_(avcodec_parameters_alloc()) {
+    avcodec_parameters_copy(video_params_, video_params);
+    if (audio_params) {
+      audio_params_ = avcodec_parameters_alloc();
+      avcodec_parameters_copy(audio_params_, audio_params);
+    }
+  }
+  ~LibavReplayClip() override {
+    avcodec_parameters_free(&video_params_);
+    avcodec_parameters_free(&audio_params_);
+  }
+  LibavReplayClip(const LibavReplayClip&) = delete;
+  LibavReplayClip& operator=(const LibavReplayClip&) = delete;
+
+  bool Write(const std::string& path, std::string* error_out) override {
+    return MuxReplay(path, video_params_, audio_params_, packets_, error_out);
+  }
+
+ private:
+  ReplayBuffer::Packets packets_;
+  AVCodecParameters* video_params_ = nullptr;
+  AVCodecParameters* audio_params_ = nullptr;
+};
+
+}  // namespace
+
+LibavEncoder::~LibavEncoder() {
+  std::string ignored;
+  Stop(&ignored);
+  Close();
+}
+
+bool LibavEncoder::SetPacketCallback(PacketCallback callback) {
+  packet_callback_ = std::move(callback);
+  return true;
+}
+
+bool LibavEncoder::Start(int width,
+                         int height,
+                         const RecordingOptions& options,
+                         std::string* error_out) {
+  if (started_) {
+    *error_out = "libav encoder already started";
+    return false;
+  }
+  width_ = width;
+  height_ = height;
+  std::tie(encode_width_, encode_height_) =
+      ComputeOutputDimensions(width, height, options.output_height);
+  variable_frame_rate_ = options.variable_frame_rate;
+  input_format_ = options.frame_format;
+  video_frame_index_ = 0;
+  audio_next_pts_ = 0;
+  audio_started_ = false;
+
+  int ret = avformat_alloc_output_context2(&format_,
+                                           nullptr,
+                                           ContainerMuxerName(options.container),
+                                           options.output_path.c_str());
+  if (ret < 0 || !format_) {
+    *error_out = AvError("Failed to create output context", ret);
+    Close();
+    return false;
+  }
+  if (!OpenVideo(options, error_out)) {
+    Close();
+    return false;
+  }
+  if (options.capture_audio) {
+    if (!OpenAudio(error_out)) {
+      Close();
+      return false;
+    }
+  }
+
+  if (!(format_->oformat->flags & AVFMT_NOFILE)) {
+    ret = avio_open(&format_->pb, options.output_path.c_str(), AVIO_FLAG_WRITE);
+    if (ret < 0) {
+      *error_out = AvError("Failed to open output file", ret);
+      Close();
+      return false;
+    }
+  }
+  AVDictionary* muxer_options = nullptr;
+  for (const auto& option : ContainerMuxerOptions(options)) {
+    av_dict_set(&muxer_options, option.first.c_str(), option.second.c_str(), 0);
+  }
+  ret = avformat_write_header(format_, &muxer_options);
+  av_dict_free(&muxer_options);
+  if (ret < 0) {
+    *error_out = AvError("Failed to write output header", ret);
+    Close();
+    return false;
+  }
+
+  if (options.replay_buffer_bytes > 0) {
+    std::lock_guard<std::mutex> lock(replay_mutex_);
+    replay_ = std::make_unique<ReplayBuffer>(static_cast<size_t>(options.replay_buffer_bytes));
+    replay_video_params_ = avcodec_parameters_alloc();
+    avcodec_parameters_from_context(replay_video_params_, video_codec_);
+    if (audio_codec_) {
+      replay_audio_params_ = avcodec_parameters_alloc();
+      avcodec_parameters_from_context(replay_audio_params_, audio_codec_);
+    }
+  }
+
+  started_ = true;
+  return true;
+}
+
+bool LibavEncoder::OpenVideo(const RecordingOptions& options, std::string* error_out) {
+  const EncoderProfile profile = ContainerEncoderProfile(options);
+  const AVCodec* codec = avcodec_find_encoder_by_name(profile.codec.c_str());
+  if (!codec) {
+    *error_out = profile.codec + " encoder not found";
+    return false;
+  }
+  const AVPixelFormat pix_fmt = av_get_pix_fmt(profile.pixel_format.c_str());
+  if (pix_fmt == AV_PIX_FMT_NONE) {
+    *error_out = "Unknown encoder pixel format: " + profile.pixel_format;
+    return false;
+  }
+  // I420 frames can be handed over untouched when the codec wants I420 at
+  // the captured size.
+  const bool scaling = encode_width_ != width_ || encode_height_ != height_;
+  passthrough_ =
+      !scaling && input_format_ == FrameFormat::kI420 && pix_fmt == AV_PIX_FMT_YUV420P;
+  video_stream_ = avformat_new_stream(format_, nullptr);
+  video_codec_ = avcodec_alloc_context3(codec);
+  if (!video_stream_ || !video_codec_) {
+    *error_out = "Failed to allocate video stream";
+    return false;
+  }
+
+  const int fps = static_cast<int>(std::max<uint32_t>(1, options.fps));
+  video_codec_->width = encode_width_;
+  video_codec_->height = encode_height_;
+  video_codec_->pix_fmt = pix_fmt;
+  // Variable rate frames carry their own microsecond timestamps; constant
+  // rate output counts frames.
+  video_codec_->time_base = variable_frame_rate_ ? AVRational {1, 1000000} : AVRational {1, fps};
+  video_codec_->framerate = AVRational {fps, 1};
+  video_codec_->max_b_frames = 0;
+  // Both the capture conversion and swscale produce BT.601 limited range.
+  video_codec_->color_range = AVCOL_RANGE_MPEG;
+  video_codec_->colorspace = AVCOL_SPC_SMPTE170M;
+  if (format_->oformat->flags & AVFMT_GLOBALHEADER) {
+    video_codec_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+
+  AVDictionary* codec_options = nullptr;
+  for (const auto& option : EncoderCodecOptions(profile)) {
+    av_dict_set(&codec_options, option.first.c_str(), option.second.c_str(), 0);
+  }
+  int ret = avcodec_open2(video_codec_, codec, &codec_options);
+  av_dict_free(&codec_options);
+  if (ret < 0) {
+    *error_out = AvError(("Failed to open " + profile.codec).c_str(), ret);
+    return false;
+  }
+  ret = avcodec_parameters_from_context(video_stream_->codecpar, video_codec_);
+  if (ret < 0) {
+    *error_out = AvError("Failed to copy video parameters", ret);
+    return false;
+  }
+  video_stream_->time_base = video_codec_->time_base;
+
+  if (passthrough_) {
+    return true;
+  }
+  video_frame_ = av_frame_alloc();
+  if (!video_frame_) {
+    *error_out = "Failed to allocate video frame";
+    return false;
+  }
+  video_frame_->format = pix_fmt;
+  video_frame_->width = encode_width_;
+  video_frame_->height = encode_height_;
+  ret = av_frame_get_buffer(video_frame_, 0);
+  if (ret < 0) {
+    *error_out = AvError("Failed to allocate video frame buffer", ret);
+    return false;
+  }
+
+  sws_ = sws_getContext(width_,
+                        height_,
+                        InputPixelFormat(input_format_),
+                        encode_width_,
+                        encode_height_,
+                        pix_fmt,
+                        scaling ? SWS_LANCZOS : SWS_POINT,
+                        nullptr,
+                        nullptr,
+                        nullptr);
+  if (!sws_) {
+    *error_out = "Failed to create colour conversion context";
+    return false;
+  }
+  return true;
+}
+
+bool LibavEncoder::OpenAudio(std::string* error_out) {
+  const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+  if (!codec) {
+    *error_out = "AAC encoder not found";
+    return false;
+  }
+  audio_stream_ = avformat_new_stream(format_, nullptr);
+  audio_codec_ = avcodec_alloc_context3(codec);
+  if (!audio_stream_ || !audio_codec_) {
+    *error_out = "Failed to allocate audio stream";
+    return false;
+  }
+
+  audio_codec_->sample_fmt = AV_SAMPLE_FMT_FLTP;
+  audio_codec_->sample_rate = kCaptureAudioRate;
+  audio_codec_->bit_rate = kAudioBitRate;
+  audio_codec_->time_base = AVRational {1, kCaptureAudioRate};
+#ifdef SCREEN_RECORDER_LIBAV_CH_LAYOUT
+  av_channel_layout_default(&audio_codec_->ch_layout, kCaptureAudioChannels);
+#else
+  audio_codec_->channels = kCaptureAudioChannels;
+  audio_codec_->channel_layout = av_get_default_channel_layout(kCaptureAudioChannels);
+#endif
+  if (format_->oformat->flags & AVFMT_GLOBALHEADER) {
+    audio_codec_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  int ret = avcodec_open2(audio_codec_, codec, nullptr);
+  if (ret < 0) {
+    *error_out = AvError("Failed to open AAC encoder", ret);
+    return false;
+  }
+  ret = avcodec_parameters_from_context(audio_stream_->codecpar, audio_codec_);
+  if (ret < 0) {
+    *error_out = AvError("Failed to copy audio parameters", ret);
+    return false;
+  }
+  audio_stream_->time_base = audio_codec_->time_base;
+
+  audio_frame_ = av_frame_alloc();
+  if (!audio_frame_) {
+    *error_out = "Failed to allocate audio frame";
+    return false;
+  }
+  audio_frame_->format = audio_codec_->sample_fmt;
+  audio_frame_->sample_rate = kCaptureAudioRate;
+  audio_frame_->nb_samples =
+      audio_codec_->frame_size > 0 ? audio_codec_->frame_size : kDefaultAudioFrameSize;
+#ifdef SCREEN_RECORDER_LIBAV_CH_LAYOUT
+  av_channel_layout_copy(&audio_frame_->ch_layout, &audio_codec_->ch_layout);
+#else
+  audio_frame_->channels = kCaptureAudioChannels;
+  audio_frame_->channel_layout = audio_codec_->channel_layout;
+#endif
+  ret = av_frame_get_buffer(audio_frame_, 0);
+  if (ret < 0) {
+    *error_out = AvError("Failed to allocate audio frame buffer", ret);
+    return false;
+  }
+
+#ifdef SCREEN_RECORDER_LIBAV_CH_LAYOUT
+  AVChannelLayout input_layout;
+  av_channel_layout_default(&input_layout, kCaptureAudioChannels);
+  ret = swr_alloc_set_opts2(&swr_,
+                            &audio_codec_->ch_layout,
+                            AV_SAMPLE_FMT_FLTP,
+                            kCaptureAudioRate,
+                            &input_layout,
+                            AV_SAMPLE_FMT_FLT,
+                            kCaptureAudioRate,
+                            0,
+                            nullptr);
+  av_channel_layout_uninit(&input_layout);
+#else
+  swr_ = swr_alloc_set_opts(nullptr,
+                            static_cast<int64_t>(audio_codec_->channel_layout),
+                            AV_SAMPLE_FMT_FLTP,
+                            kCaptureAudioRate,
+                            av_get_default_channel_layout(kCaptureAudioChannels),
+                            AV_SAMPLE_FMT_FLT,
+                            kCaptureAudioRate,
+                            0,
+                            nullptr);
+  ret = swr_ ? 0 : AVERROR(ENOMEM);
+#endif
+  if (ret >= 0) {
+    ret = swr_init(swr_);
+  }
+  if (ret < 0) {
+    *error_out = AvError("Failed to create audio resampler", ret);
+    return false;
+  }
+
+  audio_fifo_ = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, kCaptureAudioChannels, audio_frame_->nb_samples);
+  if (!audio_fifo_) {
+    *error_out = "Failed to allocate audio fifo";
+    return false;
+  }
+  return true;
+}
+
+bool LibavEncoder::WriteFrame(const FrameHandle& frame,
+                              int64_t timestamp_us,
+                              std::string* error_out) {
+  if (!started_) {
+    *error_out = "libav encoder is not started";
+    return false;
+  }
+  const size_t frame_bytes = FrameFormatBytes(input_format_, width_, height_);
+  if (frame.size() < frame_bytes) {
+    *error_out = "Frame is smaller than the configured video size";
+    return false;
+  }
+  const int64_t pts = variable_frame_rate_ ? timestamp_us : video_frame_index_;
+  ++video_frame_index_;
+
+  uint8_t* src_planes[4] = {nullptr};
+  int src_strides[4] = {0};
+  int ret = av_image_fill_arrays(src_planes, src_strides, frame.data(),
+                                 InputPixelFormat(input_format_), width_, height_, 1);
+  if (ret < 0) {
+    *error_out = AvError("Failed to map frame planes", ret);
+    return false;
+  }
+
+  if (passthrough_) {
+    // The encoder reads the pooled slot directly; the AVBufferRef keeps the
+    // slot referenced until libavcodec lets go of the frame.
+    AVFrame* wrapped = av_frame_alloc();
+    auto* handle = new FrameHandle(frame);
+    AVBufferRef* buffer = av_buffer_create(frame.data(), static_cast<int>(frame_bytes),
+                                           ReleaseFrameHandle, handle, AV_BUFFER_FLAG_READONLY);
+    if (!wrapped || !buffer) {
+      if (buffer) {
+        av_buffer_unref(&buffer);
+      } else {
+        delete handle;
+      }
+      av_frame_free(&wrapped);
+      *error_out = "Failed to wrap frame for the encoder";
+      return false;
+    }
+    wrapped->buf[0] = buffer;
+    wrapped->format = AV_PIX_FMT_YUV420P;
+    wrapped->width = width_;
+    wrapped->height = height_;
+    for (int plane = 0; plane < 4; ++plane) {
+      wrapped->data[plane] = src_planes[plane];
+      wrapped->linesize[plane] = src_strides[plane];
+    }
+    wrapped->pts = pts;
+    const bool ok = Encode(video_codec_, video_stream_, wrapped, error_out);
+    av_frame_free(&wrapped);
+    return ok;
+  }
+
+  ret = av_frame_make_writable(video_frame_);
+  if (ret < 0) {
+    *error_out = AvError("Failed to reuse video frame", ret);
+    return false;
+  }
+  // Converts straight out of the pooled slot; no intermediate copy.
+  sws_scale(sws_, src_planes, src_strides, 0, height_, video_frame_->data, video_frame_->linesize);
+  video_frame_->pts = pts;
+  return Encode(video_codec_, video_stream_, video_frame_, error_out);
+}
+
+bool LibavEncoder::Encode(AVCodecContext* codec,
+                          AVStream* stream,
+                          AVFrame* frame,
+                          std::string* error_out) {
+  int ret = avcodec_send_frame(codec, frame);
+  if (ret < 0 && !(frame == nullptr && ret == AVERROR_EOF)) {
+    *error_out = AvError("Failed to send frame to encoder", ret);
+    return false;
+  }
+
+  AVPacket* packet = av_packet_alloc();
+  if (!packet) {
+    *error_out = "Failed to allocate packet";
+    return false;
+  }
+  bool ok = true;
+  while (true) {
+    ret = avcodec_receive_packet(codec, packet);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+      break;
+    }
+    if (ret < 0) {
+      *error_out = AvError("Failed to receive packet from encoder", ret);
+      ok = false;
+      break;
+    }
+    if (!WritePacket(packet, stream, codec, error_out)) {
+      ok = false;
+      break;
+    }
+  }
+  av_packet_free(&packet);
+  return ok;
+}
+
+bool LibavEncoder::WritePacket(AVPacket* packet,
+                               AVStream* stream,
+                               AVCodecContext* codec,
+                               std::string* error_out) {
+  av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+  packet->stream_index = stream->index;
+
+  if (packet_callback_ || replay_) {
+    EncodedPacket encoded;
+    encoded.data = packet->data;
+    encoded.size = static_cast<size_t>(packet->size);
+    encoded.pts_us = PacketTimeUs(packet->pts, stream->time_base);
+    encoded.dts_us = PacketTimeUs(packet->dts, stream->time_base);
+    encoded.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+    encoded.is_audio = stream == audio_stream_;
+    if (packet_callback_) {
+      packet_callback_(encoded);
+    }
+    if (replay_) {
+      replay_->Push(encoded);
+    }
+  }
+  // Takes ownership of the packet payload and leaves |packet| blank.
+  const int ret = av_interleaved_write_frame(format_, packet);
+  if (ret < 0) {
+    *error_out = AvError("Failed to write packet", ret);
+    return false;
+  }
+  return true;
+}
+
+bool LibavEncoder::WriteAudio(const float* samples,
+                              size_t frames,
+                              int64_t timestamp_us,
+                              std::string* error_out) {
+  if (!started_ || !audio_codec_) {
+    *error_out = "libav encoder is not recording audio";
+    return false;
+  }
+  if (frames == 0) {
+    return true;
+  }
+  const int64_t pts = av_rescale(timestamp_us, kCaptureAudioRate, AV_TIME_BASE);
+  if (!audio_started_) {
+    // The first block lands where it was heard relative to the first frame.
+    audio_next_pts_ = std::max<int64_t>(0, pts);
+    audio_started_ = true;
+  } else {
+    const int64_t queued = audio_next_pts_ + av_audio_fifo_size(audio_fifo_);
+    const int64_t gap = pts - queued;
+    if (gap > av_rescale(kAudioGapToleranceUs, kCaptureAudioRate, AV_TIME_BASE)) {
+      std::vector<float> silence(static_cast<size_t>(gap) * kCaptureAudioChannels, 0.0f);
+      if (!BufferAudio(silence.data(), static_cast<int>(gap), error_out)) {
+        return false;
+      }
+    }
+  }
+  return BufferAudio(samples, static_cast<int>(frames), error_out) &&
+         DrainAudioFifo(false, error_out);
+}
+
+bool LibavEncoder::BufferAudio(const float* samples, int frames, std::string* error_out) {
+  const int out_capacity = swr_get_out_samples(swr_, frames);
+  uint8_t* out_planes[kCaptureAudioChannels];
+  for (int c = 0; c < kCaptureAudioChannels; ++c) {
+    if (audio_planes_[c].size() < static_cast<size_t>(out_capacity)) {
+      audio_planes_[c].resize(static_cast<size_t>(out_capacity));
+    }
+    out_planes[c] = reinterpret_cast<uint8_t*>(audio_planes_[c].data());
+  }
+  const uint8_t* in_planes[1] = {reinterpret_cast<const uint8_t*>(samples)};
+  const int converted = swr_convert(swr_, out_planes, out_capacity, in_planes, frames);
+  if (converted < 0) {
+    *error_out = AvError("Failed to convert audio", converted);
+    return false;
+  }
+  void** fifo_planes = reinterpret_cast<void**>(out_planes);
+  if (converted > 0 && av_audio_fifo_write(audio_fifo_, fifo_planes, converted) < converted) {
+    *error_out = "Failed to buffer audio samples";
+    return false;
+  }
+  return true;
+}
+
+bool LibavEncoder::DrainAudioFifo(bool flush, std::string* error_out) {
+  const int frame_size = audio_frame_->nb_samples;
+  while (av_audio_fifo_size(audio_fifo_) >= frame_size ||
+         (flush && av_audio_fifo_size(audio_fifo_) > 0)) {
+    int ret = av_frame_make_writable(audio_frame_);
+    if (ret < 0) {
+      *error_out = AvError("Failed to reuse audio frame", ret);
+      return false;
+    }
+    const int samples = std::min(av_audio_fifo_size(audio_fifo_), frame_size);
+    ret = av_audio_fifo_read(audio_fifo_, reinterpret_cast<void**>(audio_frame_->data), samples);
+    if (ret < samples) {
+      *error_out = "Failed to read buffered audio samples";
+      return false;
+    }
+    if (samples < frame_size) {
+      av_samples_set_silence(audio_frame_->data,
+                             samples,
+                             frame_size - samples,
+                             kCaptureAudioChannels,
+                             AV_SAMPLE_FMT_FLTP);
+    }
+    audio_frame_->pts = audio_next_pts_;
+    audio_next_pts_ += frame_size;
+    if (!Encode(audio_codec_, audio_stream_, audio_frame_, error_out)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<ReplayClip> LibavEncoder::SnapshotReplay(double seconds,
+                                                         std::string* error_out) {
+  std::lock_guard<std::mutex> lock(replay_mutex_);
+  if (!replay_) {
+    *error_out = "Replay buffer is not enabled for this recording";
+    return nullptr;
+  }
+  ReplayBuffer::Packets packets = replay_->Snapshot(seconds);
+  if (packets.empty()) {
+    *error_out = "Replay buffer is still empty";
+    return nullptr;
+  }
+  return std::make_unique<LibavReplayClip>(
+      std::move(packets), replay_video_params_, replay_audio_params_);
+}
+
+bool LibavEncoder::Stop(std::string* error_out) {
+  if (!started_) {
+    return true;
+  }
+  started_ = false;
+
+  bool ok = true;
+  std::string error;
+  if (!Encode(video_codec_, video_stream_, nullptr, &error)) {
+    ok = false;
+  }
+  if (ok && audio_codec_) {
+    if (!DrainAudioFifo(true, &error) || !Encode(audio_codec_, audio_stream_, nullptr, &error)) {
+      ok = false;
+    }
+  }
+  const int ret = av_write_trailer(format_);
+  if (ok && ret < 0) {
+    error = AvError("Failed to write output trailer", ret);
+    ok = false;
+  }
+  Close();
+
+  if (!ok) {
+    *error_out = error;
+  }
+  return ok;
+}
+
+void LibavEncoder::Close() {
+  if (format_ && format_->pb && !(format_->oformat->flags & AVFMT_NOFILE)) {
+    avio_closep(&format_->pb);
+  }
+  avformat_free_context(format_);
+  format_ = nullptr;
+  video_stream_ = nullptr;
+  audio_stream_ = nullptr;
+  avcodec_free_context(&video_codec_);
+  avcodec_free_context(&audio_codec_);
+  av_frame_free(&video_frame_);
+  av_frame_free(&audio_frame_);
+  sws_freeContext(sws_);
+  sws_ = nullptr;
+  swr_free(&swr_);
+  if (audio_fifo_) {
+    av_audio_fifo_free(audio_fifo_);
+    audio_fifo_ = nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(replay_mutex_);
+    replay_.reset();
+    avcodec_parameters_free(&replay_video_params_);
+    avcodec_parameters_free(&replay_audio_params_);
+  }
+  started_ = false;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "encoder.h"
+#include "recording_options.h"
+#include "replay_buffer.h"
+
+struct AVAudioFifo;
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct SwrContext;
+struct SwsContext;
+
+// Encodes with libx264/aac and muxes in process. Video is read straight from
+// the pooled capture memory, so frames never cross a pipe.
+class LibavEncoder : public Encoder {
+ public:
+  LibavEncoder() = default;
+  ~LibavEncoder() override;
+
+  bool Start(int width,
+             int height,
+             const RecordingOptions& options,
+             std::string* error_out) override;
+  bool WriteFrame(const FrameHandle& frame, int64_t timestamp_us, std::string* error_out) override;
+  bool WriteAudio(const float* samples,
+                  size_t frames,
+                  int64_t timestamp_us,
+                  std::string* error_out) override;
+  bool Stop(std::string* error_out) override;
+  bool SetPacketCallback(PacketCallback callback) override;
+  std::unique_ptr<ReplayClip> SnapshotReplay(double seconds, std::string* error_out) override;
+  const char* name() const override { return "libav"; }
+
+ private:
+  bool OpenVideo(const RecordingOptions& options, std::string* error_out);
+  bool OpenAudio(std::string* error_out);
+  // Sends |frame| (nullptr flushes) and muxes every packet it produces.
+  bool Encode(AVCodecContext* codec, AVStream* stream, AVFrame* frame, std::string* error_out);
+  bool WritePacket(AVPacket* packet,
+                   AVStream* stream,
+                   AVCodecContext* codec,
+                   std::string* error_out);
+  // Converts interleaved capture samples to planar and queues them for AAC.
+  bool BufferAudio(const float* samples, int frames, std::string* error_out);
+  // Encodes whole frames from the sample fifo; |flush| also pads out the tail.
+  bool DrainAudioFifo(bool flush, std::string* error_out);
+  void Close();
+
+  // Size of the incoming frames; the encoded size may be smaller when this
+  // is a downscaled rendition.
+  int width_ = 0;
+  int height_ = 0;
+  int encode_width_ = 0;
+  int encode_height_ = 0;
+  bool variable_frame_rate_ = false;
+  FrameFormat input_format_ = FrameFormat::kBgr0;
+  // Frames are handed to the encoder by reference instead of through swscale.
+  bool passthrough_ = false;
+  bool started_ = false;
+
+  AVFormatContext* format_ = nullptr;
+  AVCodecContext* video_codec_ = nullptr;
+  AVStream* video_stream_ = nullptr;
+  AVFrame* video_frame_ = nullptr;
+  SwsContext* sws_ = nullptr;
+  int64_t video_frame_index_ = 0;
+
+  AVCodecContext* audio_codec_ = nullptr;
+  AVStream* audio_stream_ = nullptr;
+  AVFrame* audio_frame_ = nullptr;
+  SwrContext* swr_ = nullptr;
+  AVAudioFifo* audio_fifo_ = nullptr;
+  std::vector<float> audio_planes_[kCaptureAudioChannels];
+  // Next pts in samples; set from the first block's capture timestamp.
+  int64_t audio_next_pts_ = 0;
+  bool audio_started_ = false;
+
+  PacketCallback packet_callback_;
+
+  std::unique_ptr<ReplayBuffer> replay_;
+  // Stream layout for SnapshotReplay, which may run while Stop tears the codecs
+  // down; both are guarded by replay_mutex_.
+  std::mutex replay_mutex_;
+  AVCodecParameters* replay_video_params_ = nullptr;
+  AVCodecParameters* replay_audio_params_ = nullptr;
+};
@@ -0,0 +1,215 @@
+#include "matroska_pipe.h"
+
+#include <cstring>
+#include <string>
+
+namespace {
+
+constexpr uint32_t kEbmlId = 0x1A45DFA3;
+constexpr uint32_t kEbmlVersionId = 0x4286;
+constexpr uint32_t kEbmlReadVersionId = 0x42F7;
+constexpr uint32_t kEbmlMaxIdLengthId = 0x42F2;
+constexpr uint32_t kEbmlMaxSizeLengthId = 0x42F3;
+constexpr uint32_t kDocTypeId = 0x4282;
+constexpr uint32_t kDocTypeVersionId = 0x4287;
+constexpr uint32_t kDocTypeReadVersionId = 0x4285;
+constexpr uint32_t kSegmentId = 0x18538067;
+constexpr uint32_t kInfoId = 0x1549A966;
+constexpr uint32_t kTimecodeScaleId = 0x2AD7B1;
+constexpr uint32_t kMuxingAppId = 0x4D80;
+constexpr uint32_t kWritingAppId = 0x5741;
+constexpr uint32_t kTracksId = 0x1654AE6B;
+constexpr uint32_t kTrackEntryId = 0xAE;
+constexpr uint32_t kTrackNumberId = 0xD7;
+constexpr uint32_t kTrackUidId = 0x73C5;
+constexpr uint32_t kTrackTypeId = 0x83;
+constexpr uint32_t kFlagLacingId = 0x9C;
+constexpr uint32_t kCodecId = 0x86;
+constexpr uint32_t kVideoId = 0xE0;
+constexpr uint32_t kPixelWidthId = 0xB0;
+constexpr uint32_t kPixelHeightId = 0xBA;
+constexpr uint32_t kColourSpaceId = 0x2EB524;
+constexpr uint32_t kAudioId = 0xE1;
+constexpr uint32_t kSamplingFrequencyId = 0xB5;
+constexpr uint32_t kChannelsId = 0x9F;
+constexpr uint32_t kBitDepthId = 0x6264;
+constexpr uint32_t kClusterId = 0x1F43B675;
+constexpr uint32_t kClusterTimecodeId = 0xE7;
+constexpr uint32_t kSimpleBlockId = 0xA3;
+
+constexpr uint64_t kTrackTypeVideo = 1;
+constexpr uint64_t kTrackTypeAudio = 2;
+// Timestamps are expressed in microseconds.
+constexpr uint64_t kTimecodeScaleNs = 1000;
+constexpr uint8_t kSimpleBlockKeyframe = 0x80;
+constexpr size_t kSimpleBlockHeaderSize = 4;
+
+using Bytes = std::vector<uint8_t>;
+
+void PutId(Bytes* out, uint32_t id) {
+  int bytes = 1;
+  if (id > 0xFFFFFF) {
+    bytes = 4;
+  } else if (id > 0xFFFF) {
+    bytes = 3;
+  } else if (id > 0xFF) {
+    bytes = 2;
+  }
+  for (int i = bytes - 1; i >= 0; --i) {
+    out->push_back(static_cast<uint8_t>(id >> (8 * i)));
+  }
+}
+
+// Sizes always use the 8-byte form, which keeps the per-frame header a fixed size.
+void PutSize(uint8_t* out, uint64_t size) {
+  out[0] = 0x01;
+  for (int i = 0; i < 7; ++i) {
+    out[1 + i] = static_cast<uint8_t>(size >> (8 * (6 - i)));
+  }
+}
+
+void PutSize(Bytes* out, uint64_t size) {
+  uint8_t encoded[8];
+  PutSize(encoded, size);
+  out->insert(out->end(), encoded, encoded + sizeof(encoded));
+}
+
+void PutUnknownSize(Bytes* out) {
+  out->push_back(0x01);
+  out->insert(out->end(), 7, 0xFF);
+}
+
+void PutUint(Bytes* out, uint32_t id, uint64_t value) {
+  int bytes = 1;
+  while (bytes < 8 && (value >> (8 * bytes)) != 0) {
+    ++bytes;
+  }
+  PutId(out, id);
+  PutSize(out, static_cast<uint64_t>(bytes));
+  for (int i = bytes - 1; i >= 0; --i) {
+    out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+void PutBinary(Bytes* out, uint32_t id, const void* data, size_t size) {
+  PutId(out, id);
+  PutSize(out, size);
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  out->insert(out->end(), bytes, bytes + size);
+}
+
+void PutFloat(Bytes* out, uint32_t id, double value) {
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  PutId(out, id);
+  PutSize(out, sizeof(bits));
+  for (int i = 7; i >= 0; --i) {
+    out->push_back(static_cast<uint8_t>(bits >> (8 * i)));
+  }
+}
+
+void PutString(Bytes* out, uint32_t id, const std::string& value) {
+  PutBinary(out, id, value.data(), value.size());
+}
+
+void PutMaster(Bytes* out, uint32_t id, const Bytes& body) {
+  PutId(out, id);
+  PutSize(out, body.size());
+  out->insert(out->end(), body.begin(), body.end());
+}
+
+}  // namespace
+
+std::vector<uint8_t> BuildMatroskaStreamHeader(int width,
+                                               int height,
+                                               const char fourcc[4],
+                                               int audio_channels,
+                                               int audio_rate) {
+  Bytes ebml;
+  PutUint(&ebml, kEbmlVersionId, 1);
+  PutUint(&ebml, kEbmlReadVersionId, 1);
+  PutUint(&ebml, kEbmlMaxIdLengthId, 4);
+  PutUint(&ebml, kEbmlMaxSizeLengthId, 8);
+  PutString(&ebml, kDocTypeId, "matroska");
+  PutUint(&ebml, kDocTypeVersionId, 4);
+  PutUint(&ebml, kDocTypeReadVersionId, 2);
+
+  Bytes info;
+  PutUint(&info, kTimecodeScaleId, kTimecodeScaleNs);
+  PutString(&info, kMuxingAppId, "screen-recorder");
+  PutString(&info, kWritingAppId, "screen-recorder");
+
+  Bytes video;
+  PutUint(&video, kPixelWidthId, static_cast<uint64_t>(width));
+  PutUint(&video, kPixelHeightId, static_cast<uint64_t>(height));
+  PutBinary(&video, kColourSpaceId, fourcc, 4);
+
+  Bytes track;
+  PutUint(&track, kTrackNumberId, 1);
+  PutUint(&track, kTrackUidId, 1);
+  PutUint(&track, kTrackTypeId, kTrackTypeVideo);
+  PutUint(&track, kFlagLacingId, 0);
+  PutString(&track, kCodecId, "V_UNCOMPRESSED");
+  PutMaster(&track, kVideoId, video);
+
+  Bytes tracks;
+  PutMaster(&tracks, kTrackEntryId, track);
+  if (audio_channels > 0) {
+    Bytes audio;
+    PutFloat(&audio, kSamplingFrequencyId, static_cast<double>(audio_rate));
+    PutUint(&audio, kChannelsId, static_cast<uint64_t>(audio_channels));
+    PutUint(&audio, kBitDepthId, 32);
+
+    Bytes audio_track;
+    PutUint(&audio_track, kTrackNumberId, 2);
+    PutUint(&audio_track, kTrackUidId, 2);
+    PutUint(&audio_track, kTrackTypeId, kTrackTypeAudio);
+    PutUint(&audio_track, kFlagLacingId, 0);
+    PutString(&audio_track, kCodecId, "A_PCM/FLOAT/IEEE");
+    PutMaster(&audio_track, kAudioId, audio);
+    PutMaster(&tracks, kTrackEntryId, audio_track);
+  }
+
+  Bytes out;
+  PutMaster(&out, kEbmlId, ebml);
+  PutId(&out, kSegmentId);
+  PutUnknownSize(&out);
+  PutMaster(&out, kInfoId, info);
+  PutMaster(&out, kTracksId, tracks);
+  return out;
+}
+
+void BuildMatroskaFrameHeader(uint8_t track_number,
+                              int64_t timestamp_us,
+                              size_t payload_size,
+                              uint8_t* out) {
+  const uint64_t timecode = timestamp_us > 0 ? static_cast<uint64_t>(timestamp_us) : 0;
+  constexpr size_t kTimecodeElementSize = 1 + 8 + 8;
+  constexpr size_t kBlockPrefixSize = 1 + 8 + kSimpleBlockHeaderSize;
+  const uint64_t block_size = kSimpleBlockHeaderSize + payload_size;
+  const uint64_t cluster_size = kTimecodeElementSize + kBlockPrefixSize + payload_size;
+
+  size_t pos = 0;
+  out[pos++] = static_cast<uint8_t>(kClusterId >> 24);
+  out[pos++] = static_cast<uint8_t>(kClusterId >> 16);
+  out[pos++] = static_cast<uint8_t>(kClusterId >> 8);
+  out[pos++] = static_cast<uint8_t>(kClusterId);
+  PutSize(out + pos, cluster_size);
+  pos += 8;
+
+  out[pos++] = static_cast<uint8_t>(kClusterTimecodeId);
+  PutSize(out + pos, 8);
+  pos += 8;
+  for (int i = 7; i >= 0; --i) {
+    out[pos++] = static_cast<uint8_t>(timecode >> (8 * i));
+  }
+
+  out[pos++] = static_cast<uint8_t>(kSimpleBlockId);
+  PutSize(out + pos, block_size);
+  pos += 8;
+  out[pos++] = static_cast<uint8_t>(0x80 | (track_number & 0x7F));
+  // Block timecode relative to the cluster; every cluster holds one block.
+  out[pos++] = 0;
+  out[pos++] = 0;
+  out[pos++] = kSimpleBlockKeyframe;
+}
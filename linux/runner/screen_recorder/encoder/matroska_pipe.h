@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal live Matroska framing for the ffmpeg stdin pipe. Unlike rawvideo it
+// carries an explicit timestamp per frame, so ffmpeg does not have to derive
+// timing from arrival order.
+
+// Size of the cluster and block header written in front of every frame.
+constexpr size_t kMatroskaFrameHeaderSize = 42;
+
+// EBML header, a segment of unknown size, segment info and one
+// V_UNCOMPRESSED video track (track number 1) using |fourcc| for the layout.
+// A non-zero |audio_channels| adds an A_PCM/FLOAT/IEEE track (track number 2)
+// of interleaved 32-bit samples at |audio_rate|.
+std::vector<uint8_t> BuildMatroskaStreamHeader(int width,
+                                               int height,
+                                               const char fourcc[4],
+                                               int audio_channels = 0,
+                                               int audio_rate = 0);
+
+// Writes the header of a single-block cluster for a keyframe of
+// |payload_size| bytes on |track_number| at |timestamp_us| into |out|, which
+// must hold kMatroskaFrameHeaderSize bytes.
+void BuildMatroskaFrameHeader(uint8_t track_number,
+                              int64_t timestamp_us,
+                              size_t payload_size,
+                              uint8_t* out);
@@ -0,0 +1,45 @@
+#include "null_encoder.h"
+
+bool NullEncoder::Start(int width,
+                        int height,
+                        const RecordingOptions& options,
+                        std::string* error_out) {
+  (void)width;
+  (void)height;
+  (void)options;
+  (void)error_out;
+  return true;
+}
+
+bool NullEncoder::WriteFrame(const FrameHandle& frame,
+                             int64_t timestamp_us,
+                             std::string* error_out) {
+  (void)timestamp_us;
+  (void)error_out;
+  frames_written_.fetch_add(1, std::memory_order_relaxed);
+  bytes_written_.fetch_add(frame.size(), std::memory_order_relaxed);
+  return true;
+}
+
+bool NullEncoder::WriteAudio(const float* samples,
+                             size_t frames,
+                             int64_t timestamp_us,
+                             std::string* error_out) {
+  (void)samples;
+  (void)frames;
+  (void)timestamp_us;
+  (void)error_out;
+  return true;
+}
+
+bool NullEncoder::Stop(std::string* error_out) {
+  (void)error_out;
+  return true;
+}
+
+TransportStats NullEncoder::GetTransportStats() const {
+  TransportStats stats;
+  stats.frames = frames_written_.load(std::memory_order_relaxed);
+  stats.bytes = bytes_written_.load(std::memory_order_relaxed);
+  return stats;
+}
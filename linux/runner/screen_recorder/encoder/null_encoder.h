@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "encoder.h"
+#include "recording_options.h"
+
+// Accepts frames and audio and throws them away. Measures the capture and
+// writer path without any encoder cost; nothing is written to disk.
+class NullEncoder : public Encoder {
+ public:
+  NullEncoder() = default;
+
+  bool Start(int width,
+             int height,
+             const RecordingOptions& options,
+             std::string* error_out) override;
+  bool WriteFrame(const FrameHandle& frame, int64_t timestamp_us, std::string* error_out) override;
+  bool WriteAudio(const float* samples,
+                  size_t frames,
+                  int64_t timestamp_us,
+                  std::string* error_out) override;
+  bool Stop(std::string* error_out) override;
+  TransportStats GetTransportStats() const override;
+  const char* name() const override { return "null"; }
+
+ private:
+  std::atomic<uint64_t> frames_written_ {0};
+  std::atomic<uint64_t> bytes_written_ {0};
+};
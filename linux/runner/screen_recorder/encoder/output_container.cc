@@ -0,0 +1,59 @@
+#include "output_container.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+bool IsFragmented(OutputContainer container) {
+  return container != OutputContainer::kMp4;
+}
+
+uint32_t FragmentDurationMs(const RecordingOptions& options) {
+  return std::max<uint32_t>(options.fragment_duration_ms, 100);
+}
+
+}  // namespace
+
+const char* ContainerMuxerName(OutputContainer container) {
+  switch (container) {
+    case OutputContainer::kFragmentedMp4:
+      return "mp4";
+    case OutputContainer::kMatroska:
+      return "matroska";
+    case OutputContainer::kMp4:
+      break;
+  }
+  return nullptr;
+}
+
+std::vector<CodecOption> ContainerMuxerOptions(const RecordingOptions& options) {
+  const uint32_t duration_ms = FragmentDurationMs(options);
+  switch (options.container) {
+    case OutputContainer::kFragmentedMp4:
+      // default_base_moof keeps fragments self-contained; the trailer is only
+      // the small mfra index, so stop does not depend on recording length.
+      return {{"movflags", "+frag_keyframe+empty_moov+default_base_moof"},
+              {"frag_duration", std::to_string(static_cast<uint64_t>(duration_ms) * 1000)}};
+    case OutputContainer::kMatroska:
+      return {{"cluster_time_limit", std::to_string(duration_ms)}};
+    case OutputContainer::kMp4:
+      break;
+  }
+  return {};
+}
+
+EncoderProfile ContainerEncoderProfile(const RecordingOptions& options) {
+  EncoderProfile profile = options.encoder_profile;
+  if (!IsFragmented(options.container)) {
+    return profile;
+  }
+  const uint64_t fragment_frames =
+      static_cast<uint64_t>(std::max<uint32_t>(options.fps, 1)) * FragmentDurationMs(options) /
+      1000;
+  const int gop = static_cast<int>(std::max<uint64_t>(fragment_frames, 1));
+  if (profile.gop <= 0 || profile.gop > gop) {
+    profile.gop = gop;
+  }
+  return profile;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "encoder_profile.h"
+#include "recording_options.h"
+
+// Muxer for RecordingOptions::container; nullptr lets libavformat guess from
+// the output path.
+const char* ContainerMuxerName(OutputContainer container);
+
+// Private muxer options (AVOption name/value) that make the file readable up
+// to the last complete fragment. The ffmpeg CLI takes them as "-name value".
+std::vector<CodecOption> ContainerMuxerOptions(const RecordingOptions& options);
+
+// RecordingOptions::encoder_profile with its GOP capped to one fragment, since
+// fragments can only start on a keyframe.
+EncoderProfile ContainerEncoderProfile(const RecordingOptions& options);
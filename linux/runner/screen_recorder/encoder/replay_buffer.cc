@@ -0,0 +1,79 @@
+#include "replay_buffer.h"
+
+#include <cmath>
+
+ReplayBuffer::ReplayBuffer(size_t budget_bytes) : budget_bytes_(budget_bytes) {}
+
+void ReplayBuffer::Push(const EncodedPacket& packet) {
+  auto stored = std::make_shared<ReplayPacket>();
+  stored->data.assign(packet.data, packet.data + packet.size);
+  stored->pts_us = packet.pts_us;
+  stored->dts_us = packet.dts_us;
+  stored->keyframe = packet.keyframe;
+  stored->is_audio = packet.is_audio;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (IsVideoKeyframe(*stored)) {
+    waiting_for_keyframe_ = false;
+    ++keyframes_;
+  } else if (waiting_for_keyframe_) {
+    return;
+  }
+  bytes_ += Cost(*stored);
+  packets_.push_back(std::move(stored));
+  EvictLocked();
+}
+
+void ReplayBuffer::PopFront() {
+  const ReplayPacket& front = *packets_.front();
+  bytes_ -= Cost(front);
+  if (IsVideoKeyframe(front)) {
+    --keyframes_;
+  }
+  packets_.pop_front();
+}
+
+void ReplayBuffer::EvictLocked() {
+  while (bytes_ > budget_bytes_ && keyframes_ > 1) {
+    // Drop the oldest GOP along with the audio interleaved with it.
+    do {
+      PopFront();
+    } while (!IsVideoKeyframe(*packets_.front()));
+  }
+  if (bytes_ > budget_bytes_) {
+    packets_.clear();
+    bytes_ = 0;
+    keyframes_ = 0;
+    waiting_for_keyframe_ = true;
+  }
+}
+
+ReplayBuffer::Packets ReplayBuffer::Snapshot(double seconds) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t begin = 0;
+  if (seconds > 0 && !packets_.empty()) {
+    int64_t end_us = 0;
+    for (auto it = packets_.rbegin(); it != packets_.rend(); ++it) {
+      if (!(*it)->is_audio) {
+        end_us = (*it)->pts_us;
+        break;
+      }
+    }
+    const int64_t start_us = end_us - static_cast<int64_t>(std::llround(seconds * 1e6));
+    // Latest keyframe at or before the requested start; the front is always
+    // a keyframe, so the walk cannot come up empty.
+    for (size_t i = packets_.size(); i-- > 0;) {
+      const ReplayPacket& packet = *packets_[i];
+      if (IsVideoKeyframe(packet) && packet.pts_us <= start_us) {
+        begin = i;
+        break;
+      }
+    }
+  }
+  return Packets(packets_.begin() + static_cast<std::ptrdiff_t>(begin), packets_.end());
+}
+
+size_t ReplayBuffer::bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
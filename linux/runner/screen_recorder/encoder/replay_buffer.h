@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "encoder.h"
+
+struct ReplayPacket {
+  std::vector<uint8_t> data;
+  int64_t pts_us = 0;
+  int64_t dts_us = 0;
+  bool keyframe = false;
+  bool is_audio = false;
+};
+
+// Bounded history of encoded packets for instant replay. Packets are kept in
+// arrival order and the oldest whole GOPs are dropped once the byte budget is
+// exceeded, so the ring always starts at a video keyframe. A budget smaller
+// than one GOP empties the ring until the next keyframe.
+class ReplayBuffer {
+ public:
+  using Packets = std::vector<std::shared_ptr<const ReplayPacket>>;
+
+  explicit ReplayBuffer(size_t budget_bytes);
+
+  // Called from the muxing thread(s); copies |packet|.
+  void Push(const EncodedPacket& packet);
+
+  // Packets covering at least the last |seconds| (everything when <= 0),
+  // starting at a video keyframe. Cheap: payloads are shared, not copied.
+  Packets Snapshot(double seconds) const;
+
+  size_t bytes() const;
+
+ private:
+  // Bookkeeping per packet on top of its payload.
+  static constexpr size_t kPacketOverhead = sizeof(ReplayPacket) + 32;
+
+  static size_t Cost(const ReplayPacket& packet) { return packet.data.size() + kPacketOverhead; }
+  static bool IsVideoKeyframe(const ReplayPacket& packet) {
+    return packet.keyframe && !packet.is_audio;
+  }
+
+  void PopFront();
+  void EvictLocked();
+
+  const size_t budget_bytes_;
+  mutable std::mutex mutex_;
+  std::deque<std::shared_ptr<const ReplayPacket>> packets_;
+  size_t bytes_ = 0;
+  size_t keyframes_ = 0;
+  bool waiting_for_keyframe_ = true;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// Latest value of a small trivially copyable struct, published by exactly one
+// writer thread and read by any number of readers. The writer never waits;
+// a reader that overlaps a write retries. The payload lives in atomic words,
+// so concurrent copies are well defined.
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock payloads are copied bytewise");
+
+ public:
+  Seqlock() = default;
+  Seqlock(const Seqlock&) = delete;
+  Seqlock& operator=(const Seqlock&) = delete;
+
+  // Writer only.
+  void Store(const T& value) {
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Any thread. Returns false until the first Store.
+  bool Load(T* value_out) const {
+    uint64_t words[kWords];
+    for (;;) {
+      const uint64_t before = sequence_.load(std::memory_order_acquire);
+      if (before == 0) {
+        return false;
+      }
+      if ((before & 1) != 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (size_t i = 0; i < kWords; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+    std::memcpy(value_out, words, sizeof(T));
+    return true;
+  }
+
+ private:
+  static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint64_t> sequence_ {0};
+  std::array<std::atomic<uint64_t>, kWords> words_ {};
+};
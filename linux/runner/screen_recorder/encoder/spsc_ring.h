@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+ public:
+  explicit SpscRing(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    slots_.resize(rounded);
+    mask_ = rounded - 1;
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Producer only. Returns false without touching |value| when the ring is full.
+  bool Push(T&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == slots_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false when the ring is empty.
+  bool Pop(T* value_out) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    *value_out = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called concurrently with Push/Pop; exact otherwise.
+  size_t Size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  bool Empty() const { return Size() == 0; }
+  size_t capacity() const { return slots_.size(); }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+
+  alignas(64) std::atomic<size_t> head_ {0};
+  size_t cached_tail_ = 0;
+  alignas(64) std::atomic<size_t> tail_ {0};
+  size_t cached_head_ = 0;
+};
@@ -3,42 +3,161 @@
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
 
+#include "utils/tracer.h"
+
+#include <unistd.h>
+
 #include <sstream>
+#include <utility>
 
 namespace {
 
 constexpr const char* kPortalBusName = "org.freedesktop.portal.Desktop";
 constexpr const char* kPortalObjectPath = "/org/freedesktop/portal/desktop";
+constexpr const char* kRequestPathPrefix = "/org/freedesktop/portal/desktop/request/";
 constexpr const char* kScreenCastIface = "org.freedesktop.portal.ScreenCast";
 constexpr const char* kRequestIface = "org.freedesktop.portal.Request";
 constexpr const char* kSessionIface = "org.freedesktop.portal.Session";
+// Response codes of org.freedesktop.portal.Request.
+constexpr guint32 kResponseCanceled = 1;
+// ScreenCast persist_mode: keep the grant until the user revokes it.
+constexpr guint32 kPersistUntilRevoked = 2;
+
+int64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                               start)
+      .count();
+}
+
+}  // namespace
 
-struct WaitContext {
-  GMainLoop* loop = nullptr;
-  PortalClient::RequestResult* out = nullptr;
+struct PortalClient::Negotiation {
+  ~Negotiation() {
+    if (cancellable) {
+      g_object_unref(cancellable);
+    }
+  }
+
+  PortalClient* client = nullptr;
+  GCancellable* cancellable = nullptr;
+  SessionCallback callback;
+  // Cleared when the portal rejects it.
+  std::string restore_token;
+  std::chrono::steady_clock::time_point attempt_start;
+  Step step = Step::kCreateSession;
+  std::string request_path;
+  guint response_subscription = 0;
+  PortalSession session;
+  std::chrono::steady_clock::time_point step_start;
+  std::vector<PortalStepTiming> timings;
 };
 
-void OnRequestResponse(GDBusConnection*,
-                       const gchar*,
-                       const gchar*,
-                       const gchar*,
-                       const gchar*,
-                       GVariant* parameters,
-                       gpointer user_data) {
-  auto* ctx = static_cast<WaitContext*>(user_data);
-  guint32 code = 2;
-  GVariant* results = nullptr;
-  g_variant_get(parameters, "(u@a{sv})", &code, &results);
-  ctx->out->response_code = code;
-  ctx->out->results = results;
-  g_main_loop_quit(ctx->loop);
-}
+// Every GDBus callback holds the negotiation weakly: once the client drops
+// it (finished or destroyed), late replies and signals are ignored.
+struct PortalCallbacks {
+  using WeakNegotiation = std::weak_ptr<PortalClient::Negotiation>;
+  struct PendingCall {
+    WeakNegotiation negotiation;
+    PortalClient::Step step;
+  };
+
+  static void FreeWeak(gpointer data) { delete static_cast<WeakNegotiation*>(data); }
+
+  static void OnCallDone(GObject* source, GAsyncResult* result, gpointer user_data) {
+    std::unique_ptr<PendingCall> call(static_cast<PendingCall*>(user_data));
+    GError* error = nullptr;
+    GVariant* reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+    const std::shared_ptr<PortalClient::Negotiation> negotiation = call->negotiation.lock();
+    if (!negotiation) {
+      if (reply) {
+        g_variant_unref(reply);
+      }
+      if (error) {
+        g_error_free(error);
+      }
+      return;
+    }
+    PortalClient* client = negotiation->client;
+    if (!reply) {
+      const std::string message = error ? error->message : "Unknown DBus call failure";
+      if (error) {
+        g_error_free(error);
+      }
+      if (!client->RetryInteractively()) {
+        client->Fail(message);
+      }
+      return;
+    }
+    const gchar* request_handle = nullptr;
+    g_variant_get(reply, "(&o)", &request_handle);
+    // Portals older than 0.9 ignore handle_token and pick their own path. The
+    // step check skips replies overtaken by their own Response.
+    if (negotiation->step == call->step && negotiation->response_subscription != 0 &&
+        negotiation->request_path != request_handle) {
+      client->SubscribeResponse(request_handle);
+    }
+    g_variant_unref(reply);
+  }
 
-std::string BuildRequestPathFromHandle(const std::string& handle) {
-  return handle;
-}
+  static void OnRequestResponse(GDBusConnection*,
+                                const gchar*,
+                                const gchar*,
+                                const gchar*,
+                                const gchar*,
+                                GVariant* parameters,
+                                gpointer user_data) {
+    const std::shared_ptr<PortalClient::Negotiation> negotiation =
+        static_cast<WeakNegotiation*>(user_data)->lock();
+    if (!negotiation) {
+      return;
+    }
+    guint32 code = 2;
+    GVariant* results = nullptr;
+    g_variant_get(parameters, "(u@a{sv})", &code, &results);
+    negotiation->client->HandleResponse(code, results);
+    g_variant_unref(results);
+  }
 
-}  // namespace
+  static void OnOpenRemoteDone(GObject* source, GAsyncResult* result, gpointer user_data) {
+    std::unique_ptr<WeakNegotiation> weak(static_cast<WeakNegotiation*>(user_data));
+    GError* error = nullptr;
+    GUnixFDList* fds = nullptr;
+    GVariant* reply = g_dbus_connection_call_with_unix_fd_list_finish(
+        G_DBUS_CONNECTION(source), &fds, result, &error);
+    const std::shared_ptr<PortalClient::Negotiation> negotiation = weak->lock();
+    int fd = -1;
+    std::string message;
+    if (reply) {
+      gint fd_index = -1;
+      g_variant_get(reply, "(h)", &fd_index);
+      g_variant_unref(reply);
+      fd = g_unix_fd_list_get(fds, fd_index, &error);
+    }
+    if (fds) {
+      g_object_unref(fds);
+    }
+    if (fd < 0) {
+      message = error ? error->message : "Failed to extract PipeWire fd";
+    }
+    if (error) {
+      g_error_free(error);
+    }
+    if (!negotiation) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      return;
+    }
+    PortalClient* client = negotiation->client;
+    if (fd < 0) {
+      client->Fail(message);
+      return;
+    }
+    negotiation->session.pipewire_fd = fd;
+    client->FinishStep();
+    client->Succeed();
+  }
+};
 
 PortalClient::PortalClient() {
   GError* error = nullptr;
@@ -49,281 +168,300 @@ PortalClient::PortalClient() {
 }
 
 PortalClient::~PortalClient() {
+  if (negotiation_) {
+    g_cancellable_cancel(negotiation_->cancellable);
+    UnsubscribeResponse();
+    if (!negotiation_->session.session_handle.empty()) {
+      CloseSession(negotiation_->session.session_handle);
+    }
+    negotiation_.reset();
+  }
   if (connection_) {
     g_object_unref(static_cast<GDBusConnection*>(connection_));
   }
 }
 
+const char* PortalClient::StepName(Step step) {
+  switch (step) {
+    case Step::kCreateSession:
+      return "createSession";
+    case Step::kSelectSources:
+      return "selectSources";
+    case Step::kStart:
+      return "start";
+    case Step::kOpenPipeWireRemote:
+      return "openPipeWireRemote";
+  }
+  return "unknown";
+}
+
 std::string PortalClient::MakeHandleToken(const char* prefix) {
   std::ostringstream oss;
   oss << prefix << "_" << ++token_counter_;
   return oss.str();
 }
 
-std::optional<std::string> PortalClient::CallRequestAndWait(const char* method_name,
-                                                            void* parameters,
-                                                            std::string* error_out,
-                                                            RequestResult* request_out) {
-  if (!connection_) {
-    *error_out = "DBus session bus is unavailable";
-    return std::nullopt;
-  }
-
-  GError* error = nullptr;
-  GVariant* result = g_dbus_connection_call_sync(
-      static_cast<GDBusConnection*>(connection_),
-      kPortalBusName,
-      kPortalObjectPath,
-      kScreenCastIface,
-      method_name,
-      static_cast<GVariant*>(parameters),
-      G_VARIANT_TYPE("(o)"),
-      G_DBUS_CALL_FLAGS_NONE,
-      -1,
-      nullptr,
-      &error);
-  if (!result) {
-    *error_out = error ? error->message : "Unknown DBus call failure";
-    if (error) {
-      g_error_free(error);
-    }
-    return std::nullopt;
+std::string PortalClient::RequestPath(const std::string& token) const {
+  // The sender part is our unique bus name without the leading ':' and with
+  // '.' replaced by '_'.
+  const gchar* unique_name =
+      g_dbus_connection_get_unique_name(static_cast<GDBusConnection*>(connection_));
+  std::string sender = unique_name ? unique_name : "";
+  if (!sender.empty() && sender[0] == ':') {
+    sender.erase(0, 1);
   }
-
-  const gchar* request_handle = nullptr;
-  g_variant_get(result, "(o)", &request_handle);
-  std::string request_path = BuildRequestPathFromHandle(request_handle);
-  g_variant_unref(result);
-
-  GMainLoop* loop = g_main_loop_new(nullptr, FALSE);
-  WaitContext wait_ctx;
-  wait_ctx.loop = loop;
-  wait_ctx.out = request_out;
-  guint sub_id = g_dbus_connection_signal_subscribe(
-      static_cast<GDBusConnection*>(connection_),
-      kPortalBusName,
-      kRequestIface,
-      "Response",
-      request_path.c_str(),
-      nullptr,
-      G_DBUS_SIGNAL_FLAGS_NO_MATCH_RULE,
-      OnRequestResponse,
-      &wait_ctx,
-      nullptr);
-
-  g_main_loop_run(loop);
-  g_dbus_connection_signal_unsubscribe(static_cast<GDBusConnection*>(connection_), sub_id);
-  g_main_loop_unref(loop);
-
-  if (request_out->response_code != 0) {
-    *error_out = "Portal request was denied or canceled";
-    if (request_out->results) {
-      g_variant_unref(static_cast<GVariant*>(request_out->results));
-      request_out->results = nullptr;
+  for (char& c : sender) {
+    if (c == '.') {
+      c = '_';
     }
-    return std::nullopt;
   }
-
-  return request_path;
+  return kRequestPathPrefix + sender + "/" + token;
 }
 
-bool PortalClient::SelectSources(const std::string& session_handle, std::string* error_out) {
-  GVariantBuilder options;
-  g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
-  g_variant_builder_add(&options, "{sv}", "types", g_variant_new_uint32(1));
-  g_variant_builder_add(&options, "{sv}", "multiple", g_variant_new_boolean(FALSE));
-  g_variant_builder_add(&options, "{sv}", "handle_token",
-                        g_variant_new_string(MakeHandleToken("select").c_str()));
-
-  RequestResult response;
-  auto request = CallRequestAndWait(
-      "SelectSources",
-      g_variant_new("(oa{sv})", session_handle.c_str(), &options),
-      error_out,
-      &response);
-  if (!request) {
+bool PortalClient::StartMonitorSessionAsync(const std::string& restore_token,
+                                            SessionCallback callback,
+                                            std::string* error_out) {
+  if (!connection_) {
+    *error_out = "DBus session bus is unavailable";
     return false;
   }
-
-  if (response.results) {
-    g_variant_unref(static_cast<GVariant*>(response.results));
+  if (negotiation_) {
+    *error_out = "A portal negotiation is already running";
+    return false;
   }
+  negotiation_ = std::make_shared<Negotiation>();
+  negotiation_->client = this;
+  negotiation_->cancellable = g_cancellable_new();
+  negotiation_->callback = std::move(callback);
+  negotiation_->restore_token = restore_token;
+  CreateSession();
   return true;
 }
 
-std::optional<PortalSession> PortalClient::StartSession(const std::string& session_handle,
-                                                        std::string* error_out) {
+void PortalClient::CreateSession() {
+  negotiation_->attempt_start = std::chrono::steady_clock::now();
+  const std::string token = MakeHandleToken("create");
   GVariantBuilder options;
   g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
-  g_variant_builder_add(&options, "{sv}", "handle_token",
-                        g_variant_new_string(MakeHandleToken("start").c_str()));
-
-  RequestResult response;
-  auto request = CallRequestAndWait(
-      "Start",
-      g_variant_new("(osa{sv})", session_handle.c_str(), "", &options),
-      error_out,
-      &response);
-  if (!request) {
-    return std::nullopt;
-  }
+  g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+  g_variant_builder_add(&options, "{sv}", "session_handle_token",
+                        g_variant_new_string(MakeHandleToken("session").c_str()));
+  CallRequest(Step::kCreateSession, "CreateSession", token, g_variant_new("(a{sv})", &options));
+}
 
-  auto* results = static_cast<GVariant*>(response.results);
-  if (!results) {
-    *error_out = "Portal returned empty start results";
-    return std::nullopt;
+bool PortalClient::RetryInteractively() {
+  // The token only takes part from SelectSources on.
+  if (negotiation_->restore_token.empty() || negotiation_->step == Step::kCreateSession) {
+    return false;
   }
-
-  GVariant* streams = g_variant_lookup_value(results, "streams", G_VARIANT_TYPE("a(ua{sv})"));
-  if (!streams) {
-    g_variant_unref(results);
-    *error_out = "Portal start response has no stream list";
-    return std::nullopt;
+  UnsubscribeResponse();
+  if (!negotiation_->session.session_handle.empty()) {
+    CloseSession(negotiation_->session.session_handle);
   }
+  TraceStep(true);
+  negotiation_->restore_token.clear();
+  negotiation_->session = PortalSession();
+  // The failed attempt is reported as one step so the interactive steps that
+  // follow keep their own names.
+  negotiation_->timings = {{"rejectedRestore", MicrosecondsSince(negotiation_->attempt_start)}};
+  CreateSession();
+  return true;
+}
 
-  GVariantIter iter;
-  g_variant_iter_init(&iter, streams);
-  GVariant* stream = g_variant_iter_next_value(&iter);
-  if (!stream) {
-    g_variant_unref(streams);
-    g_variant_unref(results);
-    *error_out = "Portal returned zero streams";
-    return std::nullopt;
-  }
+void PortalClient::CallRequest(Step step,
+                               const char* method_name,
+                               const std::string& token,
+                               void* parameters) {
+  negotiation_->step = step;
+  negotiation_->step_start = std::chrono::steady_clock::now();
+  SubscribeResponse(RequestPath(token));
+  g_dbus_connection_call(static_cast<GDBusConnection*>(connection_),
+                         kPortalBusName,
+                         kPortalObjectPath,
+                         kScreenCastIface,
+                         method_name,
+                         static_cast<GVariant*>(parameters),
+                         G_VARIANT_TYPE("(o)"),
+                         G_DBUS_CALL_FLAGS_NONE,
+                         -1,
+                         negotiation_->cancellable,
+                         PortalCallbacks::OnCallDone,
+                         new PortalCallbacks::PendingCall {negotiation_, step});
+}
 
-  guint32 node_id = 0;
-  GVariant* props = nullptr;
-  g_variant_get(stream, "(u@a{sv})", &node_id, &props);
+void PortalClient::SubscribeResponse(const std::string& request_path) {
+  UnsubscribeResponse();
+  negotiation_->request_path = request_path;
+  negotiation_->response_subscription = g_dbus_connection_signal_subscribe(
+      static_cast<GDBusConnection*>(connection_),
+      kPortalBusName,
+      kRequestIface,
+      "Response",
+      request_path.c_str(),
+      nullptr,
+      G_DBUS_SIGNAL_FLAGS_NO_MATCH_RULE,
+      PortalCallbacks::OnRequestResponse,
+      new PortalCallbacks::WeakNegotiation(negotiation_),
+      PortalCallbacks::FreeWeak);
+}
 
-  int width = 0;
-  int height = 0;
-  GVariant* size = g_variant_lookup_value(props, "size", G_VARIANT_TYPE("(ii)"));
-  if (size) {
-    g_variant_get(size, "(ii)", &width, &height);
-    g_variant_unref(size);
+void PortalClient::UnsubscribeResponse() {
+  if (negotiation_->response_subscription != 0) {
+    g_dbus_connection_signal_unsubscribe(static_cast<GDBusConnection*>(connection_),
+                                         negotiation_->response_subscription);
+    negotiation_->response_subscription = 0;
   }
+}
 
-  g_variant_unref(props);
-  g_variant_unref(stream);
-  g_variant_unref(streams);
-  g_variant_unref(results);
+void PortalClient::FinishStep() {
+  negotiation_->timings.push_back(
+      {StepName(negotiation_->step), MicrosecondsSince(negotiation_->step_start)});
+  TraceStep(false);
+}
 
-  auto pipewire_fd = OpenPipeWireRemote(session_handle, error_out);
-  if (!pipewire_fd) {
-    return std::nullopt;
+void PortalClient::TraceStep(bool failed) {
+  if (!Tracer::enabled() || negotiation_->step_start == std::chrono::steady_clock::time_point {}) {
+    return;
   }
+  const int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               negotiation_->step_start.time_since_epoch())
+                               .count();
+  Tracer::Complete("portal", StepName(negotiation_->step), start_ns, Tracer::NowNs() - start_ns,
+                   "failed", failed ? 1 : 0);
+}
 
-  PortalSession session;
-  session.session_handle = session_handle;
-  session.node_id = node_id;
-  session.width = width;
-  session.height = height;
-  session.pipewire_fd = *pipewire_fd;
-  return session;
+void PortalClient::HandleResponse(uint32_t code, void* results_ptr) {
+  UnsubscribeResponse();
+  if (code != 0) {
+    if (code != kResponseCanceled && RetryInteractively()) {
+      return;
+    }
+    Fail(code == kResponseCanceled ? "Screen sharing was canceled"
+                                   : "Portal request was denied or failed");
+    return;
+  }
+  FinishStep();
+  auto* results = static_cast<GVariant*>(results_ptr);
+  PortalSession& session = negotiation_->session;
+
+  switch (negotiation_->step) {
+    case Step::kCreateSession: {
+      GVariant* handle = g_variant_lookup_value(results, "session_handle", nullptr);
+      if (!handle) {
+        Fail("CreateSession missing session_handle");
+        return;
+      }
+      if (g_variant_is_of_type(handle, G_VARIANT_TYPE_OBJECT_PATH) ||
+          g_variant_is_of_type(handle, G_VARIANT_TYPE_STRING)) {
+        session.session_handle = g_variant_get_string(handle, nullptr);
+      }
+      g_variant_unref(handle);
+      if (session.session_handle.empty()) {
+        Fail("CreateSession session_handle has unexpected type");
+        return;
+      }
+
+      const std::string token = MakeHandleToken("select");
+      GVariantBuilder options;
+      g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add(&options, "{sv}", "types", g_variant_new_uint32(1));
+      g_variant_builder_add(&options, "{sv}", "multiple", g_variant_new_boolean(FALSE));
+      g_variant_builder_add(&options, "{sv}", "persist_mode",
+                            g_variant_new_uint32(kPersistUntilRevoked));
+      if (!negotiation_->restore_token.empty()) {
+        g_variant_builder_add(&options, "{sv}", "restore_token",
+                              g_variant_new_string(negotiation_->restore_token.c_str()));
+      }
+      g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+      CallRequest(Step::kSelectSources, "SelectSources", token,
+                  g_variant_new("(oa{sv})", session.session_handle.c_str(), &options));
+      return;
+    }
+    case Step::kSelectSources: {
+      const std::string token = MakeHandleToken("start");
+      GVariantBuilder options;
+      g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add(&options, "{sv}", "handle_token", g_variant_new_string(token.c_str()));
+      CallRequest(Step::kStart, "Start", token,
+                  g_variant_new("(osa{sv})", session.session_handle.c_str(), "", &options));
+      return;
+    }
+    case Step::kStart: {
+      GVariant* streams = g_variant_lookup_value(results, "streams", G_VARIANT_TYPE("a(ua{sv})"));
+      if (!streams) {
+        Fail("Portal start response has no stream list");
+        return;
+      }
+      GVariantIter iter;
+      g_variant_iter_init(&iter, streams);
+      GVariant* stream = g_variant_iter_next_value(&iter);
+      if (!stream) {
+        g_variant_unref(streams);
+        Fail("Portal returned zero streams");
+        return;
+      }
+      guint32 node_id = 0;
+      GVariant* props = nullptr;
+      g_variant_get(stream, "(u@a{sv})", &node_id, &props);
+      session.node_id = node_id;
+      GVariant* size = g_variant_lookup_value(props, "size", G_VARIANT_TYPE("(ii)"));
+      if (size) {
+        g_variant_get(size, "(ii)", &session.width, &session.height);
+        g_variant_unref(size);
+      }
+      g_variant_unref(props);
+      g_variant_unref(stream);
+      g_variant_unref(streams);
+      GVariant* restore_token =
+          g_variant_lookup_value(results, "restore_token", G_VARIANT_TYPE_STRING);
+      if (restore_token) {
+        session.restore_token = g_variant_get_string(restore_token, nullptr);
+        g_variant_unref(restore_token);
+      }
+      session.restored = !negotiation_->restore_token.empty();
+      OpenPipeWireRemote();
+      return;
+    }
+    case Step::kOpenPipeWireRemote:
+      break;
+  }
 }
 
-std::optional<int> PortalClient::OpenPipeWireRemote(const std::string& session_handle,
-                                                    std::string* error_out) {
+void PortalClient::OpenPipeWireRemote() {
+  negotiation_->step = Step::kOpenPipeWireRemote;
+  negotiation_->step_start = std::chrono::steady_clock::now();
   GVariantBuilder options;
   g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
-
-  GError* error = nullptr;
-  GUnixFDList* out_fds = nullptr;
-  GVariant* reply = g_dbus_connection_call_with_unix_fd_list_sync(
+  g_dbus_connection_call_with_unix_fd_list(
       static_cast<GDBusConnection*>(connection_),
       kPortalBusName,
       kPortalObjectPath,
       kScreenCastIface,
       "OpenPipeWireRemote",
-      g_variant_new("(oa{sv})", session_handle.c_str(), &options),
+      g_variant_new("(oa{sv})", negotiation_->session.session_handle.c_str(), &options),
       G_VARIANT_TYPE("(h)"),
       G_DBUS_CALL_FLAGS_NONE,
       -1,
       nullptr,
-      &out_fds,
-      nullptr,
-      &error);
-  if (!reply) {
-    *error_out = error ? error->message : "OpenPipeWireRemote failed";
-    if (error) {
-      g_error_free(error);
-    }
-    return std::nullopt;
-  }
-
-  gint fd_idx = -1;
-  g_variant_get(reply, "(h)", &fd_idx);
-  g_variant_unref(reply);
-
-  int fd = g_unix_fd_list_get(out_fds, fd_idx, &error);
-  g_object_unref(out_fds);
-  if (fd < 0) {
-    *error_out = error ? error->message : "Failed to extract PipeWire fd";
-    if (error) {
-      g_error_free(error);
-    }
-    return std::nullopt;
-  }
-  return fd;
+      negotiation_->cancellable,
+      PortalCallbacks::OnOpenRemoteDone,
+      new PortalCallbacks::WeakNegotiation(negotiation_));
 }
 
-std::optional<PortalSession> PortalClient::StartMonitorSession(std::string* error_out) {
-  GVariantBuilder options;
-  g_variant_builder_init(&options, G_VARIANT_TYPE_VARDICT);
-  g_variant_builder_add(&options, "{sv}", "handle_token",
-                        g_variant_new_string(MakeHandleToken("create").c_str()));
-  g_variant_builder_add(&options, "{sv}", "session_handle_token",
-                        g_variant_new_string(MakeHandleToken("session").c_str()));
-
-  RequestResult response;
-  auto request = CallRequestAndWait("CreateSession",
-                                    g_variant_new("(a{sv})", &options),
-                                    error_out,
-                                    &response);
-  if (!request) {
-    return std::nullopt;
-  }
-
-  auto* create_results = static_cast<GVariant*>(response.results);
-  if (!create_results) {
-    *error_out = "CreateSession returned no results";
-    return std::nullopt;
-  }
-
-  GVariant* session_handle_v = g_variant_lookup_value(create_results, "session_handle", nullptr);
-  if (!session_handle_v) {
-    g_variant_unref(create_results);
-    *error_out = "CreateSession missing session_handle";
-    return std::nullopt;
-  }
-
-  const gchar* session_handle_c = nullptr;
-  if (g_variant_is_of_type(session_handle_v, G_VARIANT_TYPE_OBJECT_PATH)) {
-    g_variant_get(session_handle_v, "o", &session_handle_c);
-  } else if (g_variant_is_of_type(session_handle_v, G_VARIANT_TYPE_STRING)) {
-    g_variant_get(session_handle_v, "s", &session_handle_c);
-  } else {
-    g_variant_unref(session_handle_v);
-    g_variant_unref(create_results);
-    *error_out = "CreateSession session_handle has unexpected type";
-    return std::nullopt;
-  }
-  std::string session_handle = session_handle_c;
-  g_variant_unref(session_handle_v);
-  g_variant_unref(create_results);
-
-  if (!SelectSources(session_handle, error_out)) {
-    CloseSession(session_handle);
-    return std::nullopt;
-  }
+void PortalClient::Succeed() {
+  // The callback may destroy this client, so nothing here touches it after.
+  std::shared_ptr<Negotiation> negotiation = std::move(negotiation_);
+  negotiation->callback(negotiation->session, std::string(), negotiation->timings);
+}
 
-  auto started = StartSession(session_handle, error_out);
-  if (!started) {
-    CloseSession(session_handle);
-    return std::nullopt;
+void PortalClient::Fail(const std::string& error) {
+  TraceStep(true);
+  UnsubscribeResponse();
+  if (!negotiation_->session.session_handle.empty()) {
+    CloseSession(negotiation_->session.session_handle);
   }
-
-  return started;
+  std::shared_ptr<Negotiation> negotiation = std::move(negotiation_);
+  negotiation->callback(std::nullopt, error, negotiation->timings);
 }
 
 void PortalClient::CloseSession(const std::string& session_handle) {
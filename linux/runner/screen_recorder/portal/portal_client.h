@@ -1,8 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 struct PortalSession {
   std::string session_handle;
@@ -10,34 +14,80 @@ struct PortalSession {
   int width = 0;
   int height = 0;
   int pipewire_fd = -1;
+  // Token for reopening this source without the dialog next time; empty
+  // when the portal does not support persistence.
+  std::string restore_token;
+  // Set when the session was started with a restore token. The portal may
+  // still have shown its dialog if it no longer knew the token.
+  bool restored = false;
+};
+
+// Wall-clock time one portal step took, from its call until its response.
+// The Start step includes the time the user spends in the share dialog.
+struct PortalStepTiming {
+  std::string step;
+  int64_t duration_us = 0;
 };
 
 class PortalClient {
  public:
-  struct RequestResult {
-    uint32_t response_code = 2;
-    void* results = nullptr;
-  };
+  // Invoked once on the main context: a session on success, otherwise an
+  // error message. Timings cover the steps that completed.
+  using SessionCallback = std::function<void(std::optional<PortalSession> session,
+                                             const std::string& error,
+                                             const std::vector<PortalStepTiming>& timings)>;
 
   PortalClient();
+  // Abandons a negotiation in flight without invoking its callback and
+  // closes the session it had created.
   ~PortalClient();
 
-  std::optional<PortalSession> StartMonitorSession(std::string* error_out);
+  // Runs CreateSession, SelectSources, Start and OpenPipeWireRemote as a
+  // chain of GDBus callbacks on the thread-default main context, so the
+  // caller's loop keeps running. A non-empty |restore_token| from an earlier
+  // session is offered to the portal; if the portal rejects it, the
+  // negotiation starts over interactively. Returns false, without calling
+  // |callback|, when the negotiation cannot begin.
+  bool StartMonitorSessionAsync(const std::string& restore_token,
+                                SessionCallback callback,
+                                std::string* error_out);
   void CloseSession(const std::string& session_handle);
 
  private:
+  enum class Step {
+    kCreateSession,
+    kSelectSources,
+    kStart,
+    kOpenPipeWireRemote,
+  };
+  struct Negotiation;
+
+  // GDBus trampolines, defined next to the GIO types they take.
+  friend struct PortalCallbacks;
+
+  static const char* StepName(Step step);
 
+  void CreateSession();
+  // Drops a rejected restore token and restarts from CreateSession. Returns
+  // false when the failed step did not involve a token.
+  bool RetryInteractively();
   std::string MakeHandleToken(const char* prefix);
-  std::optional<std::string> CallRequestAndWait(const char* method_name,
-                                                void* parameters,
-                                                std::string* error_out,
-                                                RequestResult* request_out);
-  bool SelectSources(const std::string& session_handle, std::string* error_out);
-  std::optional<PortalSession> StartSession(const std::string& session_handle,
-                                            std::string* error_out);
-  std::optional<int> OpenPipeWireRemote(const std::string& session_handle,
-                                        std::string* error_out);
+  // Object path the portal will use for the request carrying |token|.
+  std::string RequestPath(const std::string& token) const;
+  // Subscribes to the request's Response first and then issues the call, so
+  // a fast reply cannot be missed.
+  void CallRequest(Step step, const char* method_name, const std::string& token, void* parameters);
+  void SubscribeResponse(const std::string& request_path);
+  void UnsubscribeResponse();
+  void HandleResponse(uint32_t code, void* results);
+  void OpenPipeWireRemote();
+  void FinishStep();
+  // Records the step in progress as a trace span.
+  void TraceStep(bool failed);
+  void Succeed();
+  void Fail(const std::string& error);
 
   void* connection_ = nullptr;
   uint64_t token_counter_ = 0;
+  std::shared_ptr<Negotiation> negotiation_;
 };
@@ -0,0 +1,27 @@
+#include "restore_token_store.h"
+
+#include "utils/keyed_line_file.h"
+
+namespace {
+
+std::string TokenFilePath() {
+  return UserFilePath("XDG_STATE_HOME", ".local/state", "portal_restore_tokens");
+}
+
+// Keys are caller-chosen, so tabs are refused rather than trusted to stay
+// unambiguous.
+bool ValidKey(const std::string& key) {
+  return !key.empty() && key.find_first_of("\t\n") == std::string::npos;
+}
+
+}  // namespace
+
+std::string LoadPortalRestoreToken(const std::string& key) {
+  return ValidKey(key) ? LoadKeyedLine(TokenFilePath(), key) : std::string();
+}
+
+void StorePortalRestoreToken(const std::string& key, const std::string& token) {
+  if (ValidKey(key)) {
+    StoreKeyedLine(TokenFilePath(), key, token);
+  }
+}
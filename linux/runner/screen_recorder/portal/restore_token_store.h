@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// Restore tokens let the ScreenCast portal reopen a previously granted
+// source without showing its dialog. They are kept per caller-chosen key,
+// normally one per monitor, in a file under $XDG_STATE_HOME readable only by
+// the user. Each token is good for one session, so every start replaces it.
+
+// Returns an empty string when no token is stored for |key|.
+std::string LoadPortalRestoreToken(const std::string& key);
+// Stores |token| for |key|; an empty token forgets the key. Failures are
+// ignored, leaving the next start interactive.
+void StorePortalRestoreToken(const std::string& key, const std::string& token);
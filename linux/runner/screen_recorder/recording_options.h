@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "encoder/encoder_profile.h"
+
+enum class EncoderBackend {
+  // Forks the ffmpeg CLI and streams raw frames over a pipe.
+  kFfmpegCli,
+  // Encodes and muxes in process through libavcodec/libavformat.
+  kLibav,
+  // Discards every frame; for benchmarking the capture path alone.
+  kNull,
+};
+
+// Pixel layout of the frames handed to the encoder.
+enum class FrameFormat {
+  // Packed 4 bytes per pixel, as delivered by the compositor.
+  kBgr0,
+  // Planar 4:2:0 (BT.601 limited range), converted during the capture copy.
+  kI420,
+  // 4:2:0 with interleaved chroma.
+  kNv12,
+};
+
+// How the ffmpeg CLI backend moves frames into the child's stdin pipe.
+enum class PipeTransport {
+  // Plain write() through a default-sized pipe.
+  kWrite,
+  // vmsplice() of the pooled frame pages into a pipe grown to the system
+  // maximum. Falls back to kWrite when the kernel refuses.
+  kVmsplice,
+};
+
+// File layout of the recording.
+enum class OutputContainer {
+  // Muxer chosen from the output path extension, normally a plain MP4. The
+  // index is written on stop, so an interrupted recording is unreadable.
+  kMp4,
+  // MP4 with an empty moov and a moof/mdat pair per fragment.
+  kFragmentedMp4,
+  // Matroska with one cluster per fragment.
+  kMatroska,
+};
+
+// An additional rendition of the same capture, written next to the primary
+// output with its own size and codec settings.
+struct RecordingOutput {
+  std::string output_path;
+  // Maximum output height; 0 keeps the captured size.
+  int output_height = 0;
+  EncoderProfile encoder_profile = EncoderProfiles().front();
+};
+
+// User-facing recording settings passed from the method channel down to the
+// capture and encoder layers.
+struct RecordingOptions {
+  std::string output_path;
+  uint32_t fps = 60;
+  bool capture_audio = false;
+  std::string audio_device;
+  // Maximum output height; 0 keeps the captured size.
+  int output_height = 0;
+  // Send each distinct frame once with its compositor timestamp instead of
+  // pacing a constant frame rate with duplicates.
+  bool variable_frame_rate = false;
+  EncoderBackend encoder_backend = EncoderBackend::kFfmpegCli;
+  FrameFormat frame_format = FrameFormat::kI420;
+  PipeTransport pipe_transport = PipeTransport::kVmsplice;
+  // Video codec settings for either backend. Defaults to the first built-in
+  // profile, which matches the historical ultrafast x264 output.
+  EncoderProfile encoder_profile = EncoderProfiles().front();
+  // Swap encoder_profile.preset for the slowest one this machine sustains at
+  // the output size and rate (see AutotuneEncoderProfile).
+  bool autotune_encoder = false;
+  OutputContainer container = OutputContainer::kMp4;
+  // Upper bound on how much of an interrupted fragmented recording is lost.
+  uint32_t fragment_duration_ms = 2000;
+  // Memory budget for the instant replay ring of encoded packets; 0 disables
+  // it. Only the libav backend sees encoded packets.
+  uint64_t replay_buffer_bytes = 0;
+  // Renditions encoded from the same frames in parallel, each on its own
+  // writer thread. Every other setting is shared with the primary output;
+  // the replay ring is kept for the primary only.
+  std::vector<RecordingOutput> extra_outputs;
+  // Names the source, normally a monitor, whose portal grant is remembered
+  // so the next start with the same key skips the dialog. Empty always asks.
+  std::string portal_restore_key;
+  // Chrome trace of the capture pipeline, written when the recording ends.
+  // Empty falls back to $SCREEN_RECORDER_TRACE; tracing is off when both are.
+  std::string trace_path;
+  // Write per-second frame and timing counters next to each output file
+  // (see TimingSidecarPath).
+  bool timing_sidecar = true;
+};
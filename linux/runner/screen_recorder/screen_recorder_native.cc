@@ -1,12 +1,59 @@
 #include "screen_recorder_native.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <utility>
 
+#include "portal/restore_token_store.h"
+#include "utils/tracer.h"
+
+namespace {
+
+constexpr const char* kStartCanceled = "Start canceled";
+constexpr const char* kTraceEnv = "SCREEN_RECORDER_TRACE";
+
+}  // namespace
+
 ScreenRecorderNative::ScreenRecorderNative() = default;
 
 ScreenRecorderNative::~ScreenRecorderNative() {
-  std::string ignored;
-  StopRecording(&ignored);
+  // Unlike StopRecording, shutdown waits for every file to be closed.
+  std::vector<std::unique_ptr<Recording>> recordings;
+  std::vector<std::unique_ptr<ReplaySave>> replay_saves;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finalize_callback_ = nullptr;
+    state_callback_ = nullptr;
+    // A pending start is dropped without calling back.
+    if (starting_ && starting_->tracing) {
+      Tracer::Stop();
+    }
+    starting_.reset();
+    if (active_) {
+      active_->on_started = nullptr;
+    }
+    if (active_ && active_->capture) {
+      active_->capture->RequestStop();
+    }
+    live_metrics_.store(nullptr, std::memory_order_release);
+    if (active_) {
+      recordings.push_back(std::move(active_));
+    }
+    for (auto& recording : finalizing_) {
+      recordings.push_back(std::move(recording));
+    }
+    finalizing_.clear();
+    replay_saves = std::move(replay_saves_);
+    state_ = State::kIdle;
+  }
+  for (auto& recording : recordings) {
+    if (recording->thread.joinable()) {
+      recording->thread.join();
+    }
+  }
+  for (auto& save : replay_saves) {
+    save->thread.join();
+  }
 }
 
 const char* ScreenRecorderNative::StateToString(State state) {
@@ -15,134 +62,280 @@ const char* ScreenRecorderNative::StateToString(State state) {
       return "idle";
     case State::kStarting:
       return "starting";
+    case State::kTuning:
+      return "tuning";
     case State::kRecording:
       return "recording";
-    case State::kStopping:
-      return "stopping";
   }
   return "unknown";
 }
 
-bool ScreenRecorderNative::StartRecording(const std::string& output_path,
-                                          uint32_t fps,
-                                          bool capture_audio,
-                                          const std::string& audio_device,
-                                          int output_height,
+void ScreenRecorderNative::SetFinalizeCallback(FinalizeCallback callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  finalize_callback_ = std::move(callback);
+}
+
+void ScreenRecorderNative::SetStateCallback(StateCallback callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_callback_ = std::move(callback);
+}
+
+bool ScreenRecorderNative::StartRecording(const RecordingOptions& options,
+                                          StartCallback done,
                                           std::string* error_out) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (state_ != State::kIdle) {
-      *error_out = "Recorder is not idle";
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReapFinishedLocked();
+  if (state_ != State::kIdle) {
+    *error_out = "Recorder is not idle";
+    return false;
+  }
+  for (const auto& recording : finalizing_) {
+    if (recording->output_path == options.output_path) {
+      *error_out = "Previous recording to this path is still being finalized";
       return false;
     }
-    state_ = State::kStarting;
-    message_.clear();
   }
 
-  auto portal = std::make_unique<PortalClient>();
-  std::string error;
-  auto session = portal->StartMonitorSession(&error);
-  if (!session) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    state_ = State::kIdle;
-    message_ = error;
-    *error_out = error;
+  auto recording = std::make_unique<Recording>();
+  recording->portal = std::make_unique<PortalClient>();
+  recording->options = options;
+  recording->output_path = options.output_path;
+  recording->on_started = std::move(done);
+  recording->start_time = std::chrono::steady_clock::now();
+  if (recording->options.trace_path.empty()) {
+    if (const char* env = getenv(kTraceEnv); env && *env) {
+      recording->options.trace_path = env;
+    }
+  }
+  // One trace session at a time. Starting another would drop the events of a
+  // recording still finalizing under its own, so this one goes untraced and
+  // says so when it finishes.
+  if (!recording->options.trace_path.empty()) {
+    if (Tracer::enabled()) {
+      recording->trace_error = "Trace not started: an earlier recording is still being traced";
+    } else {
+      Tracer::SetThreadName("main");
+      Tracer::Start();
+      recording->tracing = true;
+    }
+  }
+  const std::string restore_token = options.portal_restore_key.empty()
+                                        ? std::string()
+                                        : LoadPortalRestoreToken(options.portal_restore_key);
+  Recording* raw = recording.get();
+  // GDBus replies are dispatched from the main loop, never from inside this
+  // call, so the lock is not re-entered. Dropping the recording destroys the
+  // portal client, which guarantees the callback no longer runs.
+  const bool started = raw->portal->StartMonitorSessionAsync(
+      restore_token,
+      [this, raw](std::optional<PortalSession> session,
+                  const std::string& error,
+                  const std::vector<PortalStepTiming>& timings) {
+        OnPortalReady(raw, std::move(session), error, timings);
+      },
+      error_out);
+  if (!started) {
+    FinishTrace(recording.get());
+    message_ = *error_out;
     return false;
   }
+  starting_ = std::move(recording);
+  SetStateLocked(State::kStarting, std::string());
+  return true;
+}
 
-  auto capture = std::make_unique<PipeWireCapture>(session->node_id,
-                                                   session->pipewire_fd,
-                                                   session->width,
-                                                   session->height,
-                                                   fps,
-                                                   output_path,
-                                                   0,
-                                                   true,
-                                                   capture_audio,
-                                                   audio_device,
-                                                   output_height);
+void ScreenRecorderNative::OnPortalReady(Recording* recording,
+                                         std::optional<PortalSession> session,
+                                         const std::string& error,
+                                         const std::vector<PortalStepTiming>& timings) {
+  // Tokens are single use: the old one is gone whether or not this worked.
+  if (!recording->options.portal_restore_key.empty()) {
+    StorePortalRestoreToken(recording->options.portal_restore_key,
+                            session ? session->restore_token : std::string());
+  }
+  StateEvent event;
+  event.message = error;
+  event.portal_timings = timings;
+  if (session) {
+    event.portal_restored = session->restored;
+    // Only the main loop touches a starting recording, so the capture can be
+    // built without the lock.
+    recording->session = *session;
+    recording->capture = std::make_unique<PipeWireCapture>(session->node_id,
+                                                           session->pipewire_fd,
+                                                           session->width,
+                                                           session->height,
+                                                           recording->options,
+                                                           0,
+                                                           true);
+    recording->capture->PublishMetricsTo(&recording->metrics);
+  }
 
+  StartCallback done;
+  std::unique_ptr<Recording> failed;
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    portal_ = std::move(portal);
-    session_ = *session;
-    capture_ = std::move(capture);
-    state_ = State::kRecording;
-    message_.clear();
-  }
-
-  worker_ = std::thread([this]() {
-    std::string run_error;
-    bool ok = false;
-
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      if (capture_) {
-        // Run without holding lock.
+    if (!session) {
+      done = std::move(recording->on_started);
+      failed = std::move(starting_);
+      SetStateLocked(State::kIdle, std::move(event));
+    } else {
+      active_ = std::move(starting_);
+      live_metrics_.store(&recording->metrics, std::memory_order_release);
+      if (recording->options.autotune_encoder) {
+        // The recording thread announces kRecording and reports the start
+        // once the presets are known.
+        recording->recording_event = std::move(event);
+        SetStateLocked(State::kTuning, std::string());
       } else {
-        state_ = State::kIdle;
-        message_ = "Capture instance missing";
-        return;
+        done = std::move(recording->on_started);
+        event.time_to_recording_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::steady_clock::now() - recording->start_time)
+                                         .count();
+        SetStateLocked(State::kRecording, std::move(event));
       }
+      // Started under the lock so the thread cannot finish before it is stored.
+      recording->thread = std::thread([this, recording]() { RunRecording(recording); });
     }
+  }
+  if (failed) {
+    FinishTrace(failed.get());
+  }
+  if (done) {
+    done(session.has_value(), error);
+  }
+  // |failed| owns the portal client that is calling us; it has already let go
+  // of its negotiation, so destroying it here is safe.
+}
 
-    PipeWireCapture* capture_ptr = nullptr;
+void ScreenRecorderNative::RunRecording(Recording* recording) {
+  Tracer::SetThreadName("capture");
+  if (recording->options.autotune_encoder) {
+    recording->capture->ResolveEncoderProfiles();
+    StartCallback done;
+    bool canceled = false;
     {
       std::lock_guard<std::mutex> lock(mutex_);
-      capture_ptr = capture_.get();
-    }
-    if (capture_ptr) {
-      ok = capture_ptr->Run(&run_error);
+      done = std::move(recording->on_started);
+      canceled = active_.get() != recording;
+      if (!canceled) {
+        StateEvent event = std::move(recording->recording_event);
+        event.time_to_recording_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::steady_clock::now() - recording->start_time)
+                                         .count();
+        SetStateLocked(State::kRecording, std::move(event));
+      }
     }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (portal_ && session_) {
-      portal_->CloseSession(session_->session_handle);
+    if (done) {
+      done(!canceled, canceled ? kStartCanceled : std::string());
     }
-    capture_.reset();
-    portal_.reset();
-    session_.reset();
-
-    if (state_ == State::kStopping) {
-      state_ = State::kIdle;
-      message_.clear();
+    if (canceled) {
+      // Stopped while tuning: no file was started, so there is nothing to
+      // finalize.
+      recording->portal->CloseSession(recording->session.session_handle);
+      // No longer active, so nothing else reaches the capture.
+      recording->capture.reset();
+      FinishTrace(recording);
+      std::lock_guard<std::mutex> lock(mutex_);
+      recording->done = true;
       return;
     }
+  }
+  std::string run_error;
+  const bool ok = recording->capture->Run(&run_error);
+  recording->portal->CloseSession(recording->session.session_handle);
 
-    state_ = State::kIdle;
-    if (!ok) {
-      message_ = run_error;
-    } else {
-      message_.clear();
+  std::unique_ptr<PipeWireCapture> capture;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // SaveReplay reads the capture under the lock, so it is detached here
+    // and torn down outside.
+    capture = std::move(recording->capture);
+    if (active_.get() == recording) {
+      // The stream ended without StopRecording, e.g. the portal was closed.
+      live_metrics_.store(nullptr, std::memory_order_release);
+      finalizing_.push_back(std::move(active_));
+      SetStateLocked(State::kIdle, ok ? std::string() : run_error);
     }
-  });
+  }
+  // This recording's encoder threads are joined by now. A recording started
+  // since may still add its own events until the session stops; they are
+  // written along with ours.
+  capture.reset();
+  FinishTrace(recording);
 
-  return true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  EmitLocked(*recording, ok ? "complete" : "failed", ok ? std::string() : run_error);
+  recording->done = true;
 }
 
 bool ScreenRecorderNative::StopRecording(std::string* error_out) {
-  std::thread join_thread;
+  std::unique_ptr<Recording> canceled;
+  StartCallback done;
   {
     std::lock_guard<std::mutex> lock(mutex_);
+    ReapFinishedLocked();
     if (state_ == State::kIdle) {
       return true;
     }
     if (state_ == State::kStarting) {
-      *error_out = "Recorder is still starting";
-      return false;
-    }
-    state_ = State::kStopping;
-    if (capture_) {
-      capture_->RequestStop();
-    }
-    if (worker_.joinable()) {
-      join_thread = std::move(worker_);
+      canceled = std::move(starting_);
+      done = std::move(canceled->on_started);
+      SetStateLocked(State::kIdle, kStartCanceled);
+    } else if (state_ == State::kTuning) {
+      // The recording thread reports the cancellation once its current
+      // measurement ends, then exits without starting capture.
+      live_metrics_.store(nullptr, std::memory_order_release);
+      finalizing_.push_back(std::move(active_));
+      SetStateLocked(State::kIdle, kStartCanceled);
+    } else {
+      if (active_->capture) {
+        active_->capture->RequestStop();
+      }
+      EmitLocked(*active_, "finalizing", std::string());
+      live_metrics_.store(nullptr, std::memory_order_release);
+      finalizing_.push_back(std::move(active_));
+      SetStateLocked(State::kIdle, std::string());
     }
   }
+  if (canceled) {
+    FinishTrace(canceled.get());
+  }
+  // Destroying the portal client abandons its negotiation and closes the
+  // session it may have created.
+  canceled.reset();
+  if (done) {
+    done(false, kStartCanceled);
+  }
+  return true;
+}
 
-  if (join_thread.joinable()) {
-    join_thread.join();
+bool ScreenRecorderNative::SaveReplay(const std::string& path,
+                                      double seconds,
+                                      ReplayCallback done,
+                                      std::string* error_out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ReapFinishedLocked();
+  if (state_ != State::kRecording || !active_ || !active_->capture) {
+    *error_out = "Recorder is not recording";
+    return false;
+  }
+  // Only the snapshot needs the capture; the clip is written without the lock
+  // and may outlive the recording.
+  std::shared_ptr<ReplayClip> clip = active_->capture->SnapshotReplay(seconds, error_out);
+  if (!clip) {
+    return false;
   }
+  auto save = std::make_unique<ReplaySave>();
+  ReplaySave* raw = save.get();
+  save->thread = std::thread([this, raw, clip, path, done = std::move(done)]() {
+    std::string error;
+    const bool ok = clip->Write(path, &error);
+    done(ok, error);
+    std::lock_guard<std::mutex> lock(mutex_);
+    raw->done = true;
+  });
+  replay_saves_.push_back(std::move(save));
   return true;
 }
 
@@ -151,3 +344,95 @@ void ScreenRecorderNative::GetStatus(std::string* state_out, std::string* messag
   *state_out = StateToString(state_);
   *message_out = message_;
 }
+
+bool ScreenRecorderNative::GetStats(RecorderStats* stats_out, std::string* error_out) const {
+  // The lock keeps the recording thread from releasing the capture meanwhile.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (state_ != State::kRecording || !active_ || !active_->capture) {
+    *error_out = "Recorder is not recording";
+    return false;
+  }
+  const PipeWireCapture& capture = *active_->capture;
+  stats_out->capture = capture.GetStats();
+  stats_out->encoders.clear();
+  stats_out->transports.clear();
+  stats_out->progress.clear();
+  for (size_t i = 0; i < capture.output_count(); ++i) {
+    stats_out->encoders.push_back(capture.GetEncoderStats(i));
+    stats_out->transports.push_back(capture.GetTransportStats(i));
+    stats_out->progress.push_back(capture.GetEncoderProgress(i));
+  }
+  return true;
+}
+
+bool ScreenRecorderNative::ReadMetrics(PipeWireCapture::Metrics* metrics_out) const {
+  const Seqlock<PipeWireCapture::Metrics>* metrics = live_metrics_.load(std::memory_order_acquire);
+  return metrics && metrics->Load(metrics_out);
+}
+
+size_t ScreenRecorderNative::FinalizingCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<size_t>(
+      std::count_if(finalizing_.begin(), finalizing_.end(),
+                    [](const std::unique_ptr<Recording>& recording) { return !recording->done; }));
+}
+
+void ScreenRecorderNative::EmitLocked(const Recording& recording,
+                                      const char* stage,
+                                      const std::string& error) {
+  if (finalize_callback_) {
+    finalize_callback_(FinalizeEvent {
+        recording.output_path, stage, error, recording.trace_file, recording.trace_error});
+  }
+}
+
+void ScreenRecorderNative::FinishTrace(Recording* recording) {
+  if (!recording->tracing) {
+    return;
+  }
+  recording->tracing = false;
+  Tracer::Stop();
+  std::string error;
+  if (Tracer::WriteJson(recording->options.trace_path, &error)) {
+    recording->trace_file = recording->options.trace_path;
+  } else {
+    recording->trace_error = error;
+  }
+}
+
+void ScreenRecorderNative::SetStateLocked(State state, const std::string& message) {
+  StateEvent event;
+  event.message = message;
+  SetStateLocked(state, std::move(event));
+}
+
+void ScreenRecorderNative::SetStateLocked(State state, StateEvent event) {
+  state_ = state;
+  message_ = event.message;
+  if (state_callback_) {
+    event.state = StateToString(state);
+    state_callback_(event);
+  }
+}
+
+void ScreenRecorderNative::ReapFinishedLocked() {
+  // A done recording only has to return from its thread function, which
+  // needs no lock, so these joins are immediate.
+  auto finished = std::stable_partition(
+      finalizing_.begin(), finalizing_.end(),
+      [](const std::unique_ptr<Recording>& recording) { return !recording->done; });
+  for (auto it = finished; it != finalizing_.end(); ++it) {
+    if ((*it)->thread.joinable()) {
+      (*it)->thread.join();
+    }
+  }
+  finalizing_.erase(finished, finalizing_.end());
+
+  auto saved = std::stable_partition(
+      replay_saves_.begin(), replay_saves_.end(),
+      [](const std::unique_ptr<ReplaySave>& save) { return !save->done; });
+  for (auto it = saved; it != replay_saves_.end(); ++it) {
+    (*it)->thread.join();
+  }
+  replay_saves_.erase(saved, replay_saves_.end());
+}
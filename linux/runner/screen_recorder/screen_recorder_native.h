@@ -1,45 +1,158 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "capture/pipewire_capture.h"
 #include "portal/portal_client.h"
+#include "recording_options.h"
 
 class ScreenRecorderNative {
  public:
+  // Progress of a recording after it stops: "finalizing" once capture is
+  // asked to end, then "complete" or "failed" when its file is closed.
+  struct FinalizeEvent {
+    std::string path;
+    std::string stage;
+    std::string error;
+    // Where the recording's trace was written, if it was traced.
+    std::string trace_path;
+    // Why a requested trace was not written.
+    std::string trace_error;
+  };
+  // Runs on whichever thread moved the recording along, with the recorder
+  // locked; it must hand the event off rather than call back in.
+  using FinalizeCallback = std::function<void(const FinalizeEvent&)>;
+  // A change of the recorder state. Entering "recording" carries how long
+  // each portal step and the whole start took; "idle" after a failed start
+  // carries the error.
+  struct StateEvent {
+    std::string state;
+    std::string message;
+    std::vector<PortalStepTiming> portal_timings;
+    int64_t time_to_recording_us = 0;
+    // The portal session was reopened from a stored restore token.
+    bool portal_restored = false;
+  };
+  // Same threading contract as FinalizeCallback.
+  using StateCallback = std::function<void(const StateEvent&)>;
+  // Counters and latency summaries of the running recording; encoder and
+  // transport entries are per output, primary first.
+  struct RecorderStats {
+    PipeWireCapture::Stats capture;
+    std::vector<EncoderWorker::Stats> encoders;
+    std::vector<TransportStats> transports;
+    std::vector<EncoderProgress> progress;
+  };
+  // Called once when a start finishes, fails or is canceled: on the main loop,
+  // or on the recording thread after encoder tuning, without the recorder
+  // locked. It must hand the result off to the main loop.
+  using StartCallback = std::function<void(bool ok, const std::string& error)>;
+  // Called once a replay file is written or has failed, on the thread that
+  // wrote it, without the recorder locked.
+  using ReplayCallback = std::function<void(bool ok, const std::string& error)>;
+
   ScreenRecorderNative();
   ~ScreenRecorderNative();
 
-  bool StartRecording(const std::string& output_path,
-                      uint32_t fps,
-                      bool capture_audio,
-                      const std::string& audio_device,
-                      int output_height,
-                      std::string* error_out);
+  void SetFinalizeCallback(FinalizeCallback callback);
+  void SetStateCallback(StateCallback callback);
+  // Begins the portal handshake and returns without waiting for the user to
+  // pick a screen; |done| reports the outcome. Returns false, without calling
+  // |done|, when the recorder cannot start at all.
+  bool StartRecording(const RecordingOptions& options, StartCallback done, std::string* error_out);
+  // Cancels a start still waiting on the portal. Otherwise returns as soon
+  // as capture is asked to stop; the encoders drain and the file is closed
+  // in the background, reported through the callback. A new recording may
+  // start right away.
   bool StopRecording(std::string* error_out);
+  // Takes the replay ring of the running recording and writes it to |path|
+  // on a thread of its own; |done| reports the outcome. Returns false, without
+  // calling |done|, when there is nothing to save.
+  bool SaveReplay(const std::string& path,
+                  double seconds,
+                  ReplayCallback done,
+                  std::string* error_out);
   void GetStatus(std::string* state_out, std::string* message_out) const;
+  bool GetStats(RecorderStats* stats_out, std::string* error_out) const;
+  // Latest metrics snapshot of the running recording without taking the
+  // recorder lock. Main thread only, since recordings are freed there.
+  bool ReadMetrics(PipeWireCapture::Metrics* metrics_out) const;
+  // Stopped recordings whose files are not closed yet.
+  size_t FinalizingCount() const;
 
  private:
   enum class State {
     kIdle,
     kStarting,
+    // The portal granted a stream; encoder presets are being measured
+    // before capture begins.
+    kTuning,
     kRecording,
-    kStopping,
+  };
+
+  // One capture session, from the portal handshake until its file is closed.
+  struct Recording {
+    std::unique_ptr<PortalClient> portal;
+    PortalSession session;
+    RecordingOptions options;
+    // Set until capture begins.
+    StartCallback on_started;
+    // Announced once tuning is over.
+    StateEvent recording_event;
+    std::chrono::steady_clock::time_point start_time;
+    // Released by the recording's own thread once Run returns.
+    std::unique_ptr<PipeWireCapture> capture;
+    // Written by the capture thread, kept here so it outlives the capture.
+    Seqlock<PipeWireCapture::Metrics> metrics;
+    std::string output_path;
+    std::thread thread;
+    bool done = false;
+    // Owns the process-wide trace session until it ends.
+    bool tracing = false;
+    std::string trace_file;
+    std::string trace_error;
   };
 
   static const char* StateToString(State state);
 
+  void OnPortalReady(Recording* recording,
+                     std::optional<PortalSession> session,
+                     const std::string& error,
+                     const std::vector<PortalStepTiming>& timings);
+  void RunRecording(Recording* recording);
+  // Ends the recording's trace session, if it owns one, and writes it out.
+  static void FinishTrace(Recording* recording);
+  void SetStateLocked(State state, const std::string& message);
+  void SetStateLocked(State state, StateEvent event);
+  void EmitLocked(const Recording& recording, const char* stage, const std::string& error);
+  // A replay file being written.
+  struct ReplaySave {
+    std::thread thread;
+    bool done = false;
+  };
+
+  // Joins the threads of recordings and replay saves that have finished.
+  void ReapFinishedLocked();
+
   mutable std::mutex mutex_;
   State state_ = State::kIdle;
   std::string message_;
+  FinalizeCallback finalize_callback_;
+  StateCallback state_callback_;
 
-  std::unique_ptr<PortalClient> portal_;
-  std::optional<PortalSession> session_;
-  std::unique_ptr<PipeWireCapture> capture_;
-  std::thread worker_;
+  std::unique_ptr<Recording> starting_;
+  std::unique_ptr<Recording> active_;
+  // Metrics of |active_|, readable without the lock.
+  std::atomic<const Seqlock<PipeWireCapture::Metrics>*> live_metrics_ {nullptr};
+  std::vector<std::unique_ptr<Recording>> finalizing_;
+  std::vector<std::unique_ptr<ReplaySave>> replay_saves_;
 };
@@ -23,6 +23,11 @@
 struct _ScreenRecorderPlugin {
   GObject parent_instance;
   std::unique_ptr<ScreenRecorderNative> native;
+  // Pushes state, finalize and metrics events to Dart.
+  FlEventChannel* event_channel;
+  // Polls the metrics snapshot while Dart listens.
+  guint metrics_timer;
+  int64_t last_metrics_ns;
 };
 
 G_DEFINE_TYPE(ScreenRecorderPlugin, screen_recorder_plugin, g_object_get_type())
@@ -126,9 +131,290 @@ std::string DetectRecommendedAudioDevice() {
   return "default";
 }
 
+void ReadStringField(FlValue* map, const char* key, std::string* out) {
+  FlValue* value = fl_value_lookup_string(map, key);
+  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+    *out = fl_value_get_string(value);
+  }
+}
+
+void ReadIntField(FlValue* map, const char* key, int* out) {
+  FlValue* value = fl_value_lookup_string(map, key);
+  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+    *out = static_cast<int>(fl_value_get_int(value));
+  }
+}
+
+// |value| is either a built-in profile name or a map that overrides fields of
+// the profile named by its "name" entry (the default profile without one).
+bool ParseEncoderProfile(FlValue* value, EncoderProfile* profile, std::string* error_out) {
+  if (!value || fl_value_get_type(value) == FL_VALUE_TYPE_NULL) {
+    return true;
+  }
+  const bool is_map = fl_value_get_type(value) == FL_VALUE_TYPE_MAP;
+  if (!is_map && fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    *error_out = "encoderProfile must be a profile name or a map";
+    return false;
+  }
+  std::string name;
+  if (is_map) {
+    ReadStringField(value, "name", &name);
+  } else {
+    name = fl_value_get_string(value);
+  }
+  if (!name.empty()) {
+    const EncoderProfile* named = FindEncoderProfile(name);
+    if (!named) {
+      *error_out = "Unknown encoder profile: " + name;
+      return false;
+    }
+    *profile = *named;
+  }
+  if (is_map) {
+    ReadStringField(value, "codec", &profile->codec);
+    ReadStringField(value, "preset", &profile->preset);
+    ReadStringField(value, "pixelFormat", &profile->pixel_format);
+    ReadIntField(value, "crf", &profile->crf);
+    ReadIntField(value, "bitrateKbps", &profile->bitrate_kbps);
+    ReadIntField(value, "threads", &profile->threads);
+    ReadIntField(value, "slices", &profile->slices);
+    ReadIntField(value, "gop", &profile->gop);
+  }
+  return true;
+}
+
+// Parses the "outputs" list of {path, outputHeight, encoderProfile} maps.
+// Omitted profiles default to |base_profile|.
+bool ParseExtraOutputs(FlValue* value,
+                       const EncoderProfile& base_profile,
+                       std::vector<RecordingOutput>* outputs,
+                       std::string* error_out) {
+  if (!value || fl_value_get_type(value) == FL_VALUE_TYPE_NULL) {
+    return true;
+  }
+  if (fl_value_get_type(value) != FL_VALUE_TYPE_LIST) {
+    *error_out = "outputs must be a list of maps";
+    return false;
+  }
+  for (size_t i = 0; i < fl_value_get_length(value); ++i) {
+    FlValue* entry = fl_value_get_list_value(value, i);
+    if (fl_value_get_type(entry) != FL_VALUE_TYPE_MAP) {
+      *error_out = "outputs must be a list of maps";
+      return false;
+    }
+    RecordingOutput output;
+    output.encoder_profile = base_profile;
+    ReadStringField(entry, "path", &output.output_path);
+    if (output.output_path.empty()) {
+      *error_out = "Every output needs a path";
+      return false;
+    }
+    ReadIntField(entry, "outputHeight", &output.output_height);
+    output.output_height = std::max(output.output_height, 0);
+    if (!ParseEncoderProfile(fl_value_lookup_string(entry, "encoderProfile"),
+                             &output.encoder_profile, error_out)) {
+      return false;
+    }
+    outputs->push_back(std::move(output));
+  }
+  return true;
+}
+
+// Metrics are checked at the rate the capture thread publishes them.
+constexpr guint kMetricsPollMs = 250;
+
+// An event on its way from any thread to the main loop, where the channel
+// may be used.
+struct PendingEvent {
+  FlEventChannel* channel;
+  FlValue* event;
+};
+
+gboolean SendPendingEvent(gpointer data) {
+  auto* pending = static_cast<PendingEvent*>(data);
+  fl_event_channel_send(pending->channel, pending->event, nullptr, nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+void FreePendingEvent(gpointer data) {
+  auto* pending = static_cast<PendingEvent*>(data);
+  g_object_unref(pending->channel);
+  fl_value_unref(pending->event);
+  delete pending;
+}
+
+// Takes ownership of |event|.
+void SendOnMainLoop(FlEventChannel* channel, FlValue* event) {
+  auto* pending = new PendingEvent {FL_EVENT_CHANNEL(g_object_ref(channel)), event};
+  g_idle_add_full(G_PRIORITY_DEFAULT, SendPendingEvent, pending, FreePendingEvent);
+}
+
+// A method call answered from any thread; the reply is sent on the main loop.
+struct PendingResponse {
+  std::shared_ptr<FlMethodCall> call;
+  FlMethodResponse* response;
+};
+
+gboolean SendPendingResponse(gpointer data) {
+  auto* pending = static_cast<PendingResponse*>(data);
+  fl_method_call_respond(pending->call.get(), pending->response, nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+void FreePendingResponse(gpointer data) {
+  auto* pending = static_cast<PendingResponse*>(data);
+  g_object_unref(pending->response);
+  delete pending;
+}
+
+// Takes ownership of |response|.
+void RespondOnMainLoop(std::shared_ptr<FlMethodCall> call, FlMethodResponse* response) {
+  auto* pending = new PendingResponse {std::move(call), response};
+  g_idle_add_full(G_PRIORITY_DEFAULT, SendPendingResponse, pending, FreePendingResponse);
+}
+
+FlValue* FinalizeEventToValue(const ScreenRecorderNative::FinalizeEvent& event) {
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "type", fl_value_new_string("finalize"));
+  fl_value_set_string_take(map, "path", fl_value_new_string(event.path.c_str()));
+  fl_value_set_string_take(map, "stage", fl_value_new_string(event.stage.c_str()));
+  fl_value_set_string_take(map, "error", fl_value_new_string(event.error.c_str()));
+  if (!event.trace_path.empty()) {
+    fl_value_set_string_take(map, "tracePath", fl_value_new_string(event.trace_path.c_str()));
+  }
+  if (!event.trace_error.empty()) {
+    fl_value_set_string_take(map, "traceError", fl_value_new_string(event.trace_error.c_str()));
+  }
+  return map;
+}
+
+FlValue* StateEventToValue(const ScreenRecorderNative::StateEvent& event) {
+  FlValue* timings = fl_value_new_map();
+  for (const auto& timing : event.portal_timings) {
+    fl_value_set_string_take(timings, timing.step.c_str(), fl_value_new_int(timing.duration_us));
+  }
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "type", fl_value_new_string("state"));
+  fl_value_set_string_take(map, "state", fl_value_new_string(event.state.c_str()));
+  fl_value_set_string_take(map, "message", fl_value_new_string(event.message.c_str()));
+  fl_value_set_string_take(map, "portalTimingsUs", timings);
+  fl_value_set_string_take(map, "timeToRecordingUs", fl_value_new_int(event.time_to_recording_us));
+  fl_value_set_string_take(map, "portalRestored", fl_value_new_bool(event.portal_restored));
+  return map;
+}
+
+FlValue* SummaryToValue(const LatencyHistogram::Summary& summary) {
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "count", fl_value_new_int(static_cast<int64_t>(summary.count)));
+  fl_value_set_string_take(map, "min", fl_value_new_int(static_cast<int64_t>(summary.min)));
+  fl_value_set_string_take(map, "mean", fl_value_new_int(static_cast<int64_t>(summary.mean)));
+  fl_value_set_string_take(map, "p50", fl_value_new_int(static_cast<int64_t>(summary.p50)));
+  fl_value_set_string_take(map, "p90", fl_value_new_int(static_cast<int64_t>(summary.p90)));
+  fl_value_set_string_take(map, "p99", fl_value_new_int(static_cast<int64_t>(summary.p99)));
+  fl_value_set_string_take(map, "p999", fl_value_new_int(static_cast<int64_t>(summary.p999)));
+  fl_value_set_string_take(map, "max", fl_value_new_int(static_cast<int64_t>(summary.max)));
+  return map;
+}
+
+void SetCount(FlValue* map, const char* key, uint64_t value) {
+  fl_value_set_string_take(map, key, fl_value_new_int(static_cast<int64_t>(value)));
+}
+
+FlValue* MetricsToValue(const PipeWireCapture::Metrics& metrics) {
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "type", fl_value_new_string("metrics"));
+  fl_value_set_string_take(map, "timestampNs", fl_value_new_int(metrics.published_ns));
+  SetCount(map, "framesCaptured", metrics.frames_captured);
+  SetCount(map, "framesUnchanged", metrics.frames_unchanged);
+  SetCount(map, "framesDuplicated", metrics.frames_duplicated);
+  SetCount(map, "framesDropped", metrics.frames_dropped);
+  SetCount(map, "compositorDrops", metrics.compositor_drops);
+  SetCount(map, "framesEncoded", metrics.frames_encoded);
+  SetCount(map, "queueDepth", metrics.queue_depth);
+  SetCount(map, "copyP50Ns", metrics.copy_p50_ns);
+  SetCount(map, "copyP99Ns", metrics.copy_p99_ns);
+  SetCount(map, "callbackIntervalP50Ns", metrics.callback_interval_p50_ns);
+  SetCount(map, "callbackIntervalP99Ns", metrics.callback_interval_p99_ns);
+  SetCount(map, "frameWriteP99Ns", metrics.frame_write_p99_ns);
+  if (metrics.encoder_progress) {
+    fl_value_set_string_take(map, "encoderSpeed", fl_value_new_float(metrics.encoder_speed));
+    fl_value_set_string_take(map, "encoderFps", fl_value_new_float(metrics.encoder_fps));
+    fl_value_set_string_take(map, "encoderBitrateKbps",
+                             fl_value_new_float(metrics.encoder_bitrate_kbps));
+    fl_value_set_string_take(map, "encoderOutTimeUs",
+                             fl_value_new_int(metrics.encoder_out_time_us));
+    SetCount(map, "encoderDupFrames", metrics.encoder_dup_frames);
+    SetCount(map, "encoderDropFrames", metrics.encoder_drop_frames);
+  }
+  return map;
+}
+
+FlValue* ProgressToValue(const EncoderProgress& progress) {
+  FlValue* map = fl_value_new_map();
+  SetCount(map, "frames", progress.frames);
+  fl_value_set_string_take(map, "fps", fl_value_new_float(progress.fps));
+  fl_value_set_string_take(map, "speed", fl_value_new_float(progress.speed));
+  fl_value_set_string_take(map, "bitrateKbps", fl_value_new_float(progress.bitrate_kbps));
+  fl_value_set_string_take(map, "outTimeUs", fl_value_new_int(progress.out_time_us));
+  SetCount(map, "dupFrames", progress.dup_frames);
+  SetCount(map, "dropFrames", progress.drop_frames);
+  return map;
+}
+
+FlValue* StatsToValue(const ScreenRecorderNative::RecorderStats& stats) {
+  const PipeWireCapture::Stats& capture_stats = stats.capture;
+  FlValue* capture = fl_value_new_map();
+  SetCount(capture, "framesFull", capture_stats.frames_full);
+  SetCount(capture, "framesPartial", capture_stats.frames_partial);
+  SetCount(capture, "framesUnchanged", capture_stats.frames_unchanged);
+  SetCount(capture, "framesDuplicated", capture_stats.frames_duplicated);
+  SetCount(capture, "framesDropped", capture_stats.frames_dropped);
+  SetCount(capture, "framesCorrupted", capture_stats.frames_corrupted);
+  SetCount(capture, "compositorDrops", capture_stats.compositor_drops);
+  SetCount(capture, "bytesCopied", capture_stats.bytes_copied);
+  fl_value_set_string_take(capture, "dequeueToCopyNs",
+                           SummaryToValue(capture_stats.dequeue_to_copy_ns));
+  fl_value_set_string_take(capture, "copyNs", SummaryToValue(capture_stats.copy_ns));
+  fl_value_set_string_take(capture, "callbackIntervalNs",
+                           SummaryToValue(capture_stats.callback_interval_ns));
+
+  FlValue* outputs = fl_value_new_list();
+  for (size_t i = 0; i < stats.encoders.size(); ++i) {
+    const EncoderWorker::Stats& encoder = stats.encoders[i];
+    const TransportStats& transport = stats.transports[i];
+    FlValue* output = fl_value_new_map();
+    SetCount(output, "queueDepth", encoder.queue_depth);
+    SetCount(output, "maxQueueDepth", encoder.max_queue_depth);
+    SetCount(output, "framesEnqueued", encoder.frames_enqueued);
+    // A full writer queue drops the frame for this output only.
+    SetCount(output, "framesDropped", encoder.enqueue_failures);
+    SetCount(output, "framesWritten", encoder.frames_written);
+    SetCount(output, "audioFramesWritten", encoder.audio_frames_written);
+    SetCount(output, "writerStallNs", encoder.writer_stall_ns);
+    SetCount(output, "audioWriteNs", encoder.audio_write_ns);
+    SetCount(output, "pipeBytes", transport.bytes);
+    SetCount(output, "pipeSyscalls", transport.syscalls);
+    SetCount(output, "pipeBlockedNs", transport.blocked_ns);
+    fl_value_set_string_take(output, "zeroCopy", fl_value_new_bool(transport.zero_copy));
+    fl_value_set_string_take(output, "frameWriteNs", SummaryToValue(transport.frame_write_ns));
+    if (stats.progress[i].reported) {
+      fl_value_set_string_take(output, "encoderProgress", ProgressToValue(stats.progress[i]));
+    }
+    fl_value_append_take(outputs, output);
+  }
+
+  FlValue* map = fl_value_new_map();
+  fl_value_set_string_take(map, "capture", capture);
+  fl_value_set_string_take(map, "outputs", outputs);
+  return map;
+}
+
 }  // namespace
 
-static FlMethodResponse* start_recording(ScreenRecorderPlugin* self, FlValue* args) {
+// Returns nullptr once the start is under way; |method_call| is answered when
+// the portal handshake ends.
+static FlMethodResponse* start_recording(ScreenRecorderPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
   if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
         "invalid_args", "Expected map args with path and fps", nullptr));
@@ -139,6 +425,17 @@ static FlMethodResponse* start_recording(ScreenRecorderPlugin* self, FlValue* ar
   FlValue* audio_v = fl_value_lookup_string(args, "audio");
   FlValue* audio_device_v = fl_value_lookup_string(args, "audioDevice");
   FlValue* output_height_v = fl_value_lookup_string(args, "outputHeight");
+  FlValue* vfr_v = fl_value_lookup_string(args, "variableFrameRate");
+  FlValue* encoder_v = fl_value_lookup_string(args, "encoder");
+  FlValue* encoder_profile_v = fl_value_lookup_string(args, "encoderProfile");
+  FlValue* autotune_v = fl_value_lookup_string(args, "autotuneEncoder");
+  FlValue* container_v = fl_value_lookup_string(args, "container");
+  FlValue* fragment_v = fl_value_lookup_string(args, "fragmentDurationMs");
+  FlValue* replay_v = fl_value_lookup_string(args, "replayBufferMb");
+  FlValue* outputs_v = fl_value_lookup_string(args, "outputs");
+  FlValue* restore_key_v = fl_value_lookup_string(args, "portalRestoreKey");
+  FlValue* trace_path_v = fl_value_lookup_string(args, "tracePath");
+  FlValue* timing_sidecar_v = fl_value_lookup_string(args, "timingSidecar");
   if (!path_v || fl_value_get_type(path_v) != FL_VALUE_TYPE_STRING || !fps_v ||
       fl_value_get_type(fps_v) != FL_VALUE_TYPE_INT) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new(
@@ -166,17 +463,88 @@ static FlMethodResponse* start_recording(ScreenRecorderPlugin* self, FlValue* ar
     resolved_audio_device = DetectRecommendedAudioDevice();
   }
 
+  RecordingOptions options;
+  options.output_path = path;
+  options.fps = fps;
+  options.capture_audio = capture_audio;
+  options.audio_device = resolved_audio_device;
+  options.output_height = output_height;
+  options.variable_frame_rate =
+      vfr_v && fl_value_get_type(vfr_v) == FL_VALUE_TYPE_BOOL ? fl_value_get_bool(vfr_v) : false;
+  const std::string encoder =
+      encoder_v && fl_value_get_type(encoder_v) == FL_VALUE_TYPE_STRING
+          ? fl_value_get_string(encoder_v)
+          : "ffmpeg";
+  if (encoder == "ffmpeg") {
+    options.encoder_backend = EncoderBackend::kFfmpegCli;
+  } else if (encoder == "libav") {
+    options.encoder_backend = EncoderBackend::kLibav;
+  } else {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "encoder must be \"ffmpeg\" or \"libav\"", nullptr));
+  }
+  std::string profile_error;
+  if (!ParseEncoderProfile(encoder_profile_v, &options.encoder_profile, &profile_error)) {
+    return FL_METHOD_RESPONSE(
+        fl_method_error_response_new("invalid_args", profile_error.c_str(), nullptr));
+  }
+  options.autotune_encoder = autotune_v && fl_value_get_type(autotune_v) == FL_VALUE_TYPE_BOOL
+                                 ? fl_value_get_bool(autotune_v)
+                                 : false;
+  const std::string container =
+      container_v && fl_value_get_type(container_v) == FL_VALUE_TYPE_STRING
+          ? fl_value_get_string(container_v)
+          : "mp4";
+  if (container == "mp4") {
+    options.container = OutputContainer::kMp4;
+  } else if (container == "fmp4") {
+    options.container = OutputContainer::kFragmentedMp4;
+  } else if (container == "mkv") {
+    options.container = OutputContainer::kMatroska;
+  } else {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "container must be \"mp4\", \"fmp4\" or \"mkv\"", nullptr));
+  }
+  if (fragment_v && fl_value_get_type(fragment_v) == FL_VALUE_TYPE_INT &&
+      fl_value_get_int(fragment_v) > 0) {
+    options.fragment_duration_ms = static_cast<uint32_t>(fl_value_get_int(fragment_v));
+  }
+  if (replay_v && fl_value_get_type(replay_v) == FL_VALUE_TYPE_INT &&
+      fl_value_get_int(replay_v) > 0) {
+    options.replay_buffer_bytes = static_cast<uint64_t>(fl_value_get_int(replay_v)) << 20;
+  }
+  std::string outputs_error;
+  if (!ParseExtraOutputs(outputs_v, options.encoder_profile, &options.extra_outputs,
+                         &outputs_error)) {
+    return FL_METHOD_RESPONSE(
+        fl_method_error_response_new("invalid_args", outputs_error.c_str(), nullptr));
+  }
+  if (restore_key_v && fl_value_get_type(restore_key_v) == FL_VALUE_TYPE_STRING) {
+    options.portal_restore_key = fl_value_get_string(restore_key_v);
+  }
+  if (trace_path_v && fl_value_get_type(trace_path_v) == FL_VALUE_TYPE_STRING) {
+    options.trace_path = fl_value_get_string(trace_path_v);
+  }
+  options.timing_sidecar =
+      timing_sidecar_v && fl_value_get_type(timing_sidecar_v) == FL_VALUE_TYPE_BOOL
+          ? fl_value_get_bool(timing_sidecar_v)
+          : true;
+
+  std::shared_ptr<FlMethodCall> pending_call(FL_METHOD_CALL(g_object_ref(method_call)),
+                                             g_object_unref);
+  // Runs on the recording thread when encoder tuning delayed the start.
+  auto done = [pending_call](bool ok, const std::string& error) {
+    FlMethodResponse* response =
+        ok ? FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)))
+           : FL_METHOD_RESPONSE(
+                 fl_method_error_response_new("start_failed", error.c_str(), nullptr));
+    RespondOnMainLoop(pending_call, response);
+  };
   std::string error;
-  if (!self->native->StartRecording(path,
-                                    fps,
-                                    capture_audio,
-                                    resolved_audio_device,
-                                    output_height,
-                                    &error)) {
+  if (!self->native->StartRecording(options, done, &error)) {
     return FL_METHOD_RESPONSE(fl_method_error_response_new("start_failed", error.c_str(), nullptr));
   }
-
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)));
+  return nullptr;
 }
 
 static FlMethodResponse* get_recommended_audio_device() {
@@ -215,6 +583,40 @@ static FlMethodResponse* stop_recording(ScreenRecorderPlugin* self) {
   return FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)));
 }
 
+static FlMethodResponse* save_replay(ScreenRecorderPlugin* self, FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* path_v = args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                        ? fl_value_lookup_string(args, "path")
+                        : nullptr;
+  FlValue* seconds_v = path_v ? fl_value_lookup_string(args, "seconds") : nullptr;
+  if (!path_v || fl_value_get_type(path_v) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "invalid_args", "Missing required args: path(string)", nullptr));
+  }
+  double seconds = 0;
+  if (seconds_v && fl_value_get_type(seconds_v) == FL_VALUE_TYPE_INT) {
+    seconds = static_cast<double>(fl_value_get_int(seconds_v));
+  } else if (seconds_v && fl_value_get_type(seconds_v) == FL_VALUE_TYPE_FLOAT) {
+    seconds = fl_value_get_float(seconds_v);
+  }
+
+  std::shared_ptr<FlMethodCall> pending_call(FL_METHOD_CALL(g_object_ref(method_call)),
+                                             g_object_unref);
+  // Runs on the thread that wrote the file.
+  auto done = [pending_call](bool ok, const std::string& error) {
+    FlMethodResponse* response =
+        ok ? FL_METHOD_RESPONSE(fl_method_success_response_new(fl_value_new_bool(true)))
+           : FL_METHOD_RESPONSE(
+                 fl_method_error_response_new("replay_failed", error.c_str(), nullptr));
+    RespondOnMainLoop(pending_call, response);
+  };
+  std::string error;
+  if (!self->native->SaveReplay(fl_value_get_string(path_v), seconds, done, &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new("replay_failed", error.c_str(), nullptr));
+  }
+  return nullptr;
+}
+
 static FlMethodResponse* get_status(ScreenRecorderPlugin* self) {
   std::string state;
   std::string message;
@@ -223,34 +625,62 @@ static FlMethodResponse* get_status(ScreenRecorderPlugin* self) {
   FlValue* map = fl_value_new_map();
   fl_value_set_string_take(map, "state", fl_value_new_string(state.c_str()));
   fl_value_set_string_take(map, "message", fl_value_new_string(message.c_str()));
+  fl_value_set_string_take(
+      map, "finalizing", fl_value_new_int(static_cast<int64_t>(self->native->FinalizingCount())));
   return FL_METHOD_RESPONSE(fl_method_success_response_new(map));
 }
 
+static FlMethodResponse* get_stats(ScreenRecorderPlugin* self) {
+  ScreenRecorderNative::RecorderStats stats;
+  std::string error;
+  if (!self->native->GetStats(&stats, &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new("not_recording", error.c_str(), nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(StatsToValue(stats)));
+}
+
 static void screen_recorder_plugin_handle_method_call(ScreenRecorderPlugin* self,
                                                       FlMethodCall* method_call) {
   g_autoptr(FlMethodResponse) response = nullptr;
   const gchar* method = fl_method_call_get_name(method_call);
 
   if (strcmp(method, "startRecording") == 0) {
-    response = start_recording(self, fl_method_call_get_args(method_call));
+    response = start_recording(self, method_call);
   } else if (strcmp(method, "getRecommendedAudioDevice") == 0) {
     response = get_recommended_audio_device();
   } else if (strcmp(method, "getDisplayResolution") == 0) {
     response = get_display_resolution();
   } else if (strcmp(method, "stopRecording") == 0) {
     response = stop_recording(self);
+  } else if (strcmp(method, "saveReplay") == 0) {
+    response = save_replay(self, method_call);
   } else if (strcmp(method, "getStatus") == 0) {
     response = get_status(self);
+  } else if (strcmp(method, "getStats") == 0) {
+    response = get_stats(self);
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
   }
 
-  fl_method_call_respond(method_call, response, nullptr);
+  if (response) {
+    fl_method_call_respond(method_call, response, nullptr);
+  }
 }
 
 static void screen_recorder_plugin_dispose(GObject* object) {
   auto* self = SCREEN_RECORDER_PLUGIN(object);
+  // Waits for recordings still being finalized.
   self->native.reset();
+  if (self->metrics_timer != 0) {
+    g_source_remove(self->metrics_timer);
+    self->metrics_timer = 0;
+  }
+  if (self->event_channel) {
+    // Queued events may keep the channel alive; it must not call back here.
+    fl_event_channel_set_stream_handlers(self->event_channel, nullptr, nullptr, nullptr, nullptr);
+    g_object_unref(self->event_channel);
+    self->event_channel = nullptr;
+  }
   G_OBJECT_CLASS(screen_recorder_plugin_parent_class)->dispose(object);
 }
 
@@ -267,6 +697,40 @@ static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
   screen_recorder_plugin_handle_method_call(plugin, method_call);
 }
 
+// Sends the latest metrics snapshot if the capture thread published a new
+// one. Reading it never takes the recorder lock.
+static gboolean push_metrics_cb(gpointer user_data) {
+  auto* self = SCREEN_RECORDER_PLUGIN(user_data);
+  PipeWireCapture::Metrics metrics;
+  if (self->native->ReadMetrics(&metrics) && metrics.published_ns != self->last_metrics_ns) {
+    self->last_metrics_ns = metrics.published_ns;
+    g_autoptr(FlValue) event = MetricsToValue(metrics);
+    fl_event_channel_send(self->event_channel, event, nullptr, nullptr);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static FlMethodErrorResponse* event_listen_cb(FlEventChannel* channel,
+                                              FlValue* args,
+                                              gpointer user_data) {
+  auto* self = SCREEN_RECORDER_PLUGIN(user_data);
+  if (self->metrics_timer == 0) {
+    self->metrics_timer = g_timeout_add(kMetricsPollMs, push_metrics_cb, self);
+  }
+  return nullptr;
+}
+
+static FlMethodErrorResponse* event_cancel_cb(FlEventChannel* channel,
+                                              FlValue* args,
+                                              gpointer user_data) {
+  auto* self = SCREEN_RECORDER_PLUGIN(user_data);
+  if (self->metrics_timer != 0) {
+    g_source_remove(self->metrics_timer);
+    self->metrics_timer = 0;
+  }
+  return nullptr;
+}
+
 void screen_recorder_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
   ScreenRecorderPlugin* plugin = SCREEN_RECORDER_PLUGIN(
       g_object_new(screen_recorder_plugin_get_type(), nullptr));
@@ -279,5 +743,20 @@ void screen_recorder_plugin_register_with_registrar(FlPluginRegistrar* registrar
   fl_method_channel_set_method_call_handler(channel, method_call_cb, g_object_ref(plugin),
                                             g_object_unref);
 
+  plugin->event_channel = fl_event_channel_new(fl_plugin_registrar_get_messenger(registrar),
+                                               "screen_recorder/events",
+                                               FL_METHOD_CODEC(codec));
+  // Unowned: dispose detaches the handlers before the plugin goes away.
+  fl_event_channel_set_stream_handlers(plugin->event_channel, event_listen_cb, event_cancel_cb,
+                                       plugin, nullptr);
+  FlEventChannel* event_channel = plugin->event_channel;
+  plugin->native->SetFinalizeCallback(
+      [event_channel](const ScreenRecorderNative::FinalizeEvent& event) {
+        SendOnMainLoop(event_channel, FinalizeEventToValue(event));
+      });
+  plugin->native->SetStateCallback([event_channel](const ScreenRecorderNative::StateEvent& event) {
+    SendOnMainLoop(event_channel, StateEventToValue(event));
+  });
+
   g_object_unref(plugin);
 }
@@ -0,0 +1,194 @@
+// Summarizes the timing sidecar of a recording (<output>.timing.jsonl): frame
+// rate actually captured, duplicates and drops, callback stalls, writer
+// blocking and, at a constant frame rate, how far video drifted from the
+// audio clock, followed by the seconds that look worst.
+//
+//   timing_report recording.mp4.timing.jsonl
+//   timing_report --worst 10 --gap-ms 50 *.timing.jsonl
+
+#include "timing_sidecar.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct ReportConfig {
+  size_t worst = 5;
+  // Callback gaps above this count as stalls.
+  uint32_t gap_ms = 100;
+};
+
+double Ms(int64_t us) {
+  return static_cast<double>(us) / 1000.0;
+}
+
+// A long gap between callbacks, or a whole second without any.
+bool Stalled(const TimingSecond& second, const ReportConfig& config) {
+  return second.max_gap_us > config.gap_ms * 1000 ||
+         (second.received == 0 && second.duration_ms > 0);
+}
+
+bool Troubled(const TimingSecond& second, const ReportConfig& config) {
+  return second.dropped > 0 || second.compositor_drops > 0 || Stalled(second, config);
+}
+
+void PrintSecond(const TimingSecond& second, bool has_av_offset) {
+  std::printf("  %6us  received %4u  unique %4u  duplicated %4u  dropped %3u  compositor %3u"
+              "  gap %8.1f ms  writer %7.1f ms",
+              second.second, second.received, second.unique, second.duplicated, second.dropped,
+              second.compositor_drops, Ms(second.max_gap_us),
+              Ms(static_cast<int64_t>(second.writer_block_us)));
+  if (has_av_offset) {
+    std::printf("  offset %+8.1f ms", Ms(second.av_offset_us));
+  }
+  std::printf("\n");
+}
+
+void PrintReport(const std::string& path,
+                 const TimingSidecarHeader& header,
+                 const std::vector<TimingSecond>& seconds,
+                 const ReportConfig& config) {
+  uint64_t duration_ms = 0;
+  uint64_t received = 0;
+  uint64_t unique = 0;
+  uint64_t duplicated = 0;
+  uint64_t dropped = 0;
+  uint64_t compositor_drops = 0;
+  uint64_t writer_block_us = 0;
+  size_t stalled_seconds = 0;
+  const TimingSecond* worst_gap = nullptr;
+  const TimingSecond* worst_writer = nullptr;
+  int64_t min_offset_us = seconds.empty() ? 0 : seconds.front().av_offset_us;
+  int64_t max_offset_us = min_offset_us;
+  for (const TimingSecond& second : seconds) {
+    duration_ms += second.duration_ms;
+    received += second.received;
+    unique += second.unique;
+    duplicated += second.duplicated;
+    dropped += second.dropped;
+    compositor_drops += second.compositor_drops;
+    writer_block_us += second.writer_block_us;
+    if (Stalled(second, config)) {
+      ++stalled_seconds;
+    }
+    if (!worst_gap || second.max_gap_us > worst_gap->max_gap_us) {
+      worst_gap = &second;
+    }
+    if (!worst_writer || second.writer_block_us > worst_writer->writer_block_us) {
+      worst_writer = &second;
+    }
+    min_offset_us = std::min(min_offset_us, second.av_offset_us);
+    max_offset_us = std::max(max_offset_us, second.av_offset_us);
+  }
+
+  const double duration_s = static_cast<double>(duration_ms) / 1000.0;
+  std::printf("%s\n", path.c_str());
+  std::printf("  %dx%d %s %u fps, %s encoder, %.1f s\n", header.width, header.height,
+              header.variable_frame_rate ? "VFR up to" : "CFR", header.fps,
+              header.encoder.empty() ? "unknown" : header.encoder.c_str(), duration_s);
+  if (seconds.empty()) {
+    std::printf("  no frames were captured\n\n");
+    return;
+  }
+  const uint64_t emitted = unique + duplicated;
+  std::printf("  frames      received %" PRIu64 " (%.1f/s), unique %" PRIu64 " (%.1f/s)\n",
+              received, static_cast<double>(received) / std::max(duration_s, 0.001), unique,
+              static_cast<double>(unique) / std::max(duration_s, 0.001));
+  std::printf("              duplicated %" PRIu64 " (%.1f%% of output), dropped %" PRIu64
+              ", compositor drops %" PRIu64 "\n",
+              duplicated, emitted ? 100.0 * static_cast<double>(duplicated) / emitted : 0.0,
+              dropped, compositor_drops);
+  std::printf("  callbacks   worst gap %.1f ms at %us, %zu second(s) stalled over %u ms\n",
+              Ms(worst_gap->max_gap_us), worst_gap->second, stalled_seconds, config.gap_ms);
+  std::printf("  writer      blocked %.1f ms in total, worst %.1f ms at %us\n",
+              Ms(static_cast<int64_t>(writer_block_us)),
+              Ms(static_cast<int64_t>(worst_writer->writer_block_us)), worst_writer->second);
+  // Variable frame rate sidecars carry no offset; see TimingSecond.
+  const bool has_av_offset = !header.variable_frame_rate;
+  if (has_av_offset) {
+    const int64_t drift_us = seconds.back().av_offset_us - seconds.front().av_offset_us;
+    std::printf("  a/v offset  %+.1f ms at the end, range %+.1f..%+.1f ms, drift %+.2f ms/min\n",
+                Ms(seconds.back().av_offset_us), Ms(min_offset_us), Ms(max_offset_us),
+                duration_s > 0 ? Ms(drift_us) * 60.0 / duration_s : 0.0);
+  }
+
+  std::vector<const TimingSecond*> troubled;
+  for (const TimingSecond& second : seconds) {
+    if (Troubled(second, config)) {
+      troubled.push_back(&second);
+    }
+  }
+  std::sort(troubled.begin(), troubled.end(), [](const TimingSecond* a, const TimingSecond* b) {
+    const uint64_t lost_a = a->dropped + a->compositor_drops;
+    const uint64_t lost_b = b->dropped + b->compositor_drops;
+    return lost_a != lost_b ? lost_a > lost_b : a->max_gap_us > b->max_gap_us;
+  });
+  if (troubled.size() > config.worst) {
+    troubled.resize(config.worst);
+  }
+  if (!troubled.empty()) {
+    std::printf("  worst seconds:\n");
+    for (const TimingSecond* second : troubled) {
+      PrintSecond(*second, has_av_offset);
+    }
+  }
+  std::printf("\n");
+}
+
+void PrintUsage(const char* argv0) {
+  std::fprintf(stderr, "usage: %s [--worst N] [--gap-ms MS] SIDECAR...\n", argv0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kWorst = 1,
+    kGapMs,
+  };
+  static const struct option kOptions[] = {
+      {"worst", required_argument, nullptr, kWorst},
+      {"gap-ms", required_argument, nullptr, kGapMs},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  ReportConfig config;
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+    switch (option) {
+      case kWorst:
+        config.worst = std::strtoul(optarg, nullptr, 10);
+        break;
+      case kGapMs:
+        config.gap_ms = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  int status = 0;
+  for (int i = optind; i < argc; ++i) {
+    TimingSidecarHeader header;
+    std::vector<TimingSecond> seconds;
+    std::string error;
+    if (!ReadTimingSidecar(argv[i], &header, &seconds, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      status = 1;
+      continue;
+    }
+    PrintReport(argv[i], header, seconds, config);
+  }
+  return status;
+}
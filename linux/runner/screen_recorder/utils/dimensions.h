@@ -2,6 +2,7 @@
 #define SCREEN_RECORDER_DIMENSIONS_H
 
 #include <algorithm>
+#include <cmath>
 #include <utility>
 
 namespace screen_recorder {
@@ -19,6 +20,17 @@ inline std::pair<int, int> MakeEvenDimensions(int width, int height) {
   return {width, height};
 }
 
+// Output preset is a max target only. Never upscale above captured source size.
+// Returns the even encoded size for a |width| x |height| source limited to
+// |output_height| rows (0 keeps the source size).
+inline std::pair<int, int> ComputeOutputDimensions(int width, int height, int output_height) {
+  const int target_height = (output_height > 0 && output_height < height) ? output_height : height;
+  const int scaled_width =
+      std::max(2, static_cast<int>(std::round((static_cast<double>(width) * target_height) /
+                                              static_cast<double>(height))));
+  return {(scaled_width / 2) * 2, (target_height / 2) * 2};
+}
+
 }  // namespace utils
 }  // namespace screen_recorder
 
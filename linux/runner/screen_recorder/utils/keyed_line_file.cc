@@ -0,0 +1,110 @@
+#include "keyed_line_file.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace {
+
+std::vector<std::string> ReadLines(const std::string& path) {
+  std::vector<std::string> lines;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+  return lines;
+}
+
+bool MatchesKey(const std::string& line, const std::string& key) {
+  return line.size() > key.size() && line.compare(0, key.size(), key) == 0 &&
+         line[key.size()] == '\t';
+}
+
+}  // namespace
+
+std::string UserFilePath(const char* xdg_var, const char* home_dir, const char* name) {
+  std::string base;
+  if (const char* xdg = getenv(xdg_var); xdg && *xdg) {
+    base = xdg;
+  } else if (const char* home = getenv("HOME"); home && *home) {
+    base = home;
+    // Each level of e.g. ".local/state" may be missing.
+    const std::string dirs = home_dir;
+    for (size_t pos = 0;;) {
+      const size_t slash = dirs.find('/', pos);
+      base += '/' + dirs.substr(pos, slash - pos);
+      mkdir(base.c_str(), 0700);
+      if (slash == std::string::npos) {
+        break;
+      }
+      pos = slash + 1;
+    }
+  } else {
+    return std::string();
+  }
+  mkdir(base.c_str(), 0700);
+  const std::string dir = base + "/screen_recorder";
+  mkdir(dir.c_str(), 0700);
+  return dir + '/' + name;
+}
+
+std::string LoadKeyedLine(const std::string& path, const std::string& key) {
+  if (path.empty() || key.empty()) {
+    return std::string();
+  }
+  for (const auto& line : ReadLines(path)) {
+    if (MatchesKey(line, key)) {
+      return line.substr(key.size() + 1);
+    }
+  }
+  return std::string();
+}
+
+bool StoreKeyedLine(const std::string& path, const std::string& key, const std::string& value) {
+  if (path.empty() || key.empty() || key.find('\n') != std::string::npos ||
+      value.find('\n') != std::string::npos) {
+    return false;
+  }
+  std::vector<std::string> lines;
+  for (auto& line : ReadLines(path)) {
+    if (!MatchesKey(line, key)) {
+      lines.push_back(std::move(line));
+    }
+  }
+  if (!value.empty()) {
+    lines.push_back(key + '\t' + value);
+  }
+
+  // mkostemp creates the file 0600 under a name no other session uses.
+  std::string temp = path + ".XXXXXX";
+  const int fd = mkostemp(&temp[0], O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  FILE* file = fdopen(fd, "w");
+  if (!file) {
+    close(fd);
+    unlink(temp.c_str());
+    return false;
+  }
+  bool ok = true;
+  for (const auto& line : lines) {
+    ok = ok && fputs(line.c_str(), file) >= 0 && fputc('\n', file) != EOF;
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+// Small per-user files of "<key>\t<value>" lines, such as caches and stored
+// portal tokens. Keys and values must not contain newlines. A key may contain
+// tabs only if no other key in the same file is a tab-delimited prefix of it.
+
+// Returns "<$|xdg_var| or $HOME/|home_dir|>/screen_recorder/|name|", creating
+// the directories private to the user, or an empty string when neither
+// variable is set.
+std::string UserFilePath(const char* xdg_var, const char* home_dir, const char* name);
+
+// Returns the value stored for |key|, or an empty string.
+std::string LoadKeyedLine(const std::string& path, const std::string& key);
+// Stores |value| for |key|; an empty value removes the key. The file is
+// rewritten to a private temporary in the same directory and renamed over
+// the old one, so readers see either the old or the new file. Updates are not
+// locked against each other: of two sessions storing at once, the last rename
+// wins and the other's entry is lost.
+bool StoreKeyedLine(const std::string& path, const std::string& key, const std::string& value);
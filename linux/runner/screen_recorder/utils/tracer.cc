@@ -0,0 +1,258 @@
+#include "tracer.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct TraceEvent {
+  const char* category;
+  const char* name;
+  int64_t start_ns;
+  // Negative for instant events.
+  int64_t duration_ns;
+  const char* arg_name;
+  int64_t arg;
+};
+
+constexpr size_t kChunkEvents = 4096;
+// Roughly 48 MB of events per thread; anything beyond is counted and dropped.
+constexpr size_t kMaxChunksPerThread = 256;
+
+// Only the owning thread appends. |count| is published with release, so a
+// reader that loads it with acquire sees every event below it.
+struct TraceChunk {
+  TraceEvent events[kChunkEvents];
+  std::atomic<size_t> count {0};
+  std::atomic<TraceChunk*> next {nullptr};
+};
+
+class ThreadBuffer {
+ public:
+  ThreadBuffer() : head_(new TraceChunk), tail_(head_) {}
+  ~ThreadBuffer() {
+    FreeChunksAfterHead();
+    delete head_;
+  }
+  ThreadBuffer(const ThreadBuffer&) = delete;
+  ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+
+  // Owning thread only.
+  void Append(const TraceEvent& event) {
+    size_t count = tail_->count.load(std::memory_order_relaxed);
+    if (count == kChunkEvents) {
+      if (chunks_ == kMaxChunksPerThread) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      auto* chunk = new TraceChunk;
+      tail_->next.store(chunk, std::memory_order_release);
+      tail_ = chunk;
+      ++chunks_;
+      count = 0;
+    }
+    tail_->events[count] = event;
+    tail_->count.store(count + 1, std::memory_order_release);
+  }
+
+  // Only while no thread appends.
+  void Reset() {
+    FreeChunksAfterHead();
+    head_->count.store(0, std::memory_order_relaxed);
+    tail_ = head_;
+    chunks_ = 1;
+    dropped_.store(0, std::memory_order_relaxed);
+  }
+
+  const TraceChunk* head() const { return head_; }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  int64_t tid = 0;
+  std::atomic<const char*> name {nullptr};
+  // The thread has exited; the buffer is kept until its events are written.
+  std::atomic<bool> retired {false};
+
+ private:
+  void FreeChunksAfterHead() {
+    TraceChunk* chunk = head_->next.exchange(nullptr, std::memory_order_relaxed);
+    while (chunk) {
+      TraceChunk* next = chunk->next.load(std::memory_order_relaxed);
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  TraceChunk* head_;
+  TraceChunk* tail_;
+  size_t chunks_ = 1;
+  std::atomic<uint64_t> dropped_ {0};
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+// Never destroyed: thread_local destructors may run after static ones.
+Registry& GetRegistry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+// Marks the thread's buffer retired when the thread exits.
+struct ThreadSlot {
+  ~ThreadSlot() {
+    if (buffer) {
+      buffer->retired.store(true, std::memory_order_release);
+    }
+  }
+
+  ThreadBuffer* buffer = nullptr;
+  const char* name = nullptr;
+};
+
+thread_local ThreadSlot t_slot;
+
+// Registering takes the lock once per thread; appends never do.
+ThreadBuffer* CurrentBuffer() {
+  if (!t_slot.buffer) {
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->tid = static_cast<int64_t>(syscall(SYS_gettid));
+    buffer->name.store(t_slot.name, std::memory_order_relaxed);
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    t_slot.buffer = buffer.get();
+    registry.buffers.push_back(std::move(buffer));
+  }
+  return t_slot.buffer;
+}
+
+// Chrome trace timestamps are microseconds.
+void PrintMicros(FILE* file, int64_t ns) {
+  std::fprintf(file, "%" PRId64 ".%03d", ns / 1000, static_cast<int>(ns % 1000));
+}
+
+void PrintEvent(FILE* file, const TraceEvent& event, int pid, int64_t tid) {
+  std::fprintf(file, ",\n{\"ph\":\"%s\",\"cat\":\"%s\",\"name\":\"%s\",\"pid\":%d,\"tid\":%" PRId64
+                     ",\"ts\":",
+               event.duration_ns < 0 ? "i" : "X", event.category, event.name, pid, tid);
+  PrintMicros(file, event.start_ns);
+  if (event.duration_ns < 0) {
+    std::fprintf(file, ",\"s\":\"t\"");
+  } else {
+    std::fprintf(file, ",\"dur\":");
+    PrintMicros(file, event.duration_ns);
+  }
+  if (event.arg_name) {
+    std::fprintf(file, ",\"args\":{\"%s\":%" PRId64 "}", event.arg_name, event.arg);
+  }
+  std::fprintf(file, "}");
+}
+
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_ {false};
+
+int64_t Tracer::NowNs() {
+  struct timespec now {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void Tracer::Start() {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<std::unique_ptr<ThreadBuffer>> live;
+  for (auto& buffer : registry.buffers) {
+    if (!buffer->retired.load(std::memory_order_acquire)) {
+      buffer->Reset();
+      live.push_back(std::move(buffer));
+    }
+  }
+  registry.buffers = std::move(live);
+  enabled_.store(true, std::memory_order_release);
+}
+
+void Tracer::Stop() {
+  enabled_.store(false, std::memory_order_release);
+}
+
+bool Tracer::WriteJson(const std::string& path, std::string* error_out) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file) {
+    *error_out = "Failed to open trace file: " + std::string(std::strerror(errno));
+    return false;
+  }
+  const int pid = static_cast<int>(getpid());
+  uint64_t dropped = 0;
+  std::fprintf(file,
+               "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+               "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,"
+               "\"args\":{\"name\":\"screen_recorder\"}}",
+               pid);
+  {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& buffer : registry.buffers) {
+      const char* name = buffer->name.load(std::memory_order_relaxed);
+      if (name) {
+        std::fprintf(file,
+                     ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%" PRId64
+                     ",\"args\":{\"name\":\"%s\"}}",
+                     pid, buffer->tid, name);
+      }
+      for (const TraceChunk* chunk = buffer->head(); chunk;
+           chunk = chunk->next.load(std::memory_order_acquire)) {
+        const size_t count = chunk->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+          PrintEvent(file, chunk->events[i], pid, buffer->tid);
+        }
+      }
+      dropped += buffer->dropped();
+    }
+  }
+  std::fprintf(file, "\n],\"otherData\":{\"droppedEvents\":%" PRIu64 "}}\n", dropped);
+
+  const bool ok = !ferror(file);
+  if (fclose(file) != 0 || !ok) {
+    *error_out = "Failed writing trace file";
+    return false;
+  }
+  return true;
+}
+
+void Tracer::SetThreadName(const char* name) {
+  t_slot.name = name;
+  if (t_slot.buffer) {
+    t_slot.buffer->name.store(name, std::memory_order_relaxed);
+  }
+}
+
+void Tracer::Complete(const char* category,
+                      const char* name,
+                      int64_t start_ns,
+                      int64_t duration_ns,
+                      const char* arg_name,
+                      int64_t arg) {
+  if (!enabled()) {
+    return;
+  }
+  CurrentBuffer()->Append({category, name, start_ns, duration_ns < 0 ? 0 : duration_ns, arg_name,
+                           arg});
+}
+
+void Tracer::Instant(const char* category, const char* name, const char* arg_name, int64_t arg) {
+  if (!enabled()) {
+    return;
+  }
+  CurrentBuffer()->Append({category, name, NowNs(), -1, arg_name, arg});
+}
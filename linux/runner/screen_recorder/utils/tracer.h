@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Opt-in recorder of scoped timing events, written out in the Chrome trace
+// event format (chrome://tracing, ui.perfetto.dev). Each thread appends to its
+// own buffer without locks or syscalls; while tracing is off every event site
+// costs one relaxed load. Timestamps are CLOCK_MONOTONIC, the clock PipeWire
+// stamps buffers with.
+//
+// Names, categories and argument names are stored as pointers, so they must
+// be string literals or otherwise live for the rest of the process.
+class Tracer {
+ public:
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static int64_t NowNs();
+
+  // Begins a session and drops the events of the previous one. Threads of the
+  // previous session must no longer be emitting.
+  static void Start();
+  static void Stop();
+  // Writes the events of the stopped session to |path|.
+  static bool WriteJson(const std::string& path, std::string* error_out);
+
+  // Labels the calling thread in the trace; may be called before Start.
+  static void SetThreadName(const char* name);
+
+  // A span of |duration_ns| starting at |start_ns|, with an optional integer
+  // argument.
+  static void Complete(const char* category,
+                       const char* name,
+                       int64_t start_ns,
+                       int64_t duration_ns,
+                       const char* arg_name = nullptr,
+                       int64_t arg = 0);
+  static void Instant(const char* category,
+                      const char* name,
+                      const char* arg_name = nullptr,
+                      int64_t arg = 0);
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+// Emits a Complete event covering its own lifetime when tracing was enabled
+// at construction.
+class TraceScope {
+ public:
+  TraceScope(const char* category, const char* name)
+      : category_(category), name_(name), start_ns_(Tracer::enabled() ? Tracer::NowNs() : -1) {}
+  ~TraceScope() {
+    if (start_ns_ >= 0) {
+      Tracer::Complete(category_, name_, start_ns_, Tracer::NowNs() - start_ns_, arg_name_, arg_);
+    }
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  void SetArg(const char* name, int64_t value) {
+    arg_name_ = name;
+    arg_ = value;
+  }
+
+ private:
+  const char* category_;
+  const char* name_;
+  int64_t start_ns_;
+  const char* arg_name_ = nullptr;
+  int64_t arg_ = 0;
+};